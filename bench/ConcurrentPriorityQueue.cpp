@@ -0,0 +1,157 @@
+/**
+ * Throughput of ConcurrentPriorityQueue in Strict and Relaxed ordering against a
+ * std::priority_queue behind a std::mutex, at several thread counts.
+ *
+ * Each thread runs a mix of pushes and pops, a push of a random key followed by an
+ * attempt to pop the minimum, which keeps the queue at a steady size and stresses both
+ * sides at once.  The queue is filled with a backlog first so pops rarely find it empty.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude bench/ConcurrentPriorityQueue.cpp src/Concurrent.cpp
+ *
+ * Usage: ConcurrentPriorityQueue [max threads] [operations per thread]
+ */
+
+#include <Concurrent/ConcurrentPriorityQueue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace Concurrent;
+
+typedef std::chrono::steady_clock clock_type;
+
+static constexpr int Backlog = 10000;
+
+class MutexQueue
+{
+public:
+	void push(uint32_t item)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push(item);
+	}
+
+	bool tryPopMin(uint32_t& out)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		if (mQueue.empty())
+			return false;
+
+		out = mQueue.top();
+		mQueue.pop();
+
+		return true;
+	}
+
+private:
+	std::mutex mMutex;
+	std::priority_queue< uint32_t, std::vector<uint32_t>, std::greater<uint32_t> > mQueue;
+};
+
+static uint32_t nextRandom(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return state;
+}
+
+/**
+ * Returns millions of operations, pushes and pops together, per second.
+ */
+template<typename queue_t>
+static double run(queue_t& queue, int threads, int operations)
+{
+	uint32_t seed = 12345;
+
+	for (int i = 0; i < Backlog; ++i)
+		queue.push(nextRandom(seed) % 1000000);
+
+	std::atomic<int> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> workers;
+
+	for (int t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&, t]()
+		{
+			uint32_t state = 7919u * (uint32_t)(t + 1);
+			uint32_t item;
+
+			ready.fetch_add(1);
+
+			while (false == go.load())
+				std::this_thread::yield();
+
+			for (int i = 0; i < operations; ++i)
+			{
+				queue.push(nextRandom(state) % 1000000);
+				queue.tryPopMin(item);
+			}
+		});
+	}
+
+	while (ready.load() < threads)
+		std::this_thread::yield();
+
+	clock_type::time_point start = clock_type::now();
+	go.store(true);
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	std::chrono::duration<double> elapsed = clock_type::now() - start;
+	return 2.0 * threads * operations / elapsed.count() / 1e6;
+}
+
+template<typename make_t>
+static double best(make_t&& make, int threads, int operations)
+{
+	const int Repeats = 3;
+	double result = 0.0;
+
+	for (int i = 0; i < Repeats; ++i)
+	{
+		auto queue = make();
+		result = std::max(result, run(*queue, threads, operations));
+	}
+
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	int maxThreads = (argc > 1) ? std::atoi(argv[1]) : 8;
+	int operations = (argc > 2) ? std::atoi(argv[2]) : 200000;
+
+	typedef ConcurrentPriorityQueue<uint32_t> queue_t;
+
+	std::printf("%u hardware threads, %d push/pop pairs per thread, best of 3, Mops/s\n",
+		std::thread::hardware_concurrency(), operations);
+	std::printf("%-8s %12s %12s %12s\n", "threads", "mutex", "strict", "relaxed");
+
+	for (int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		double locked = best([]() { return std::make_unique<MutexQueue>(); }, threads, operations);
+		double strict = best([]() { return std::make_unique<queue_t>(queue_t::Ordering::Strict); }, threads, operations);
+		double relaxed = best([]() { return std::make_unique<queue_t>(queue_t::Ordering::Relaxed); }, threads, operations);
+
+		std::printf("%-8d %12.2f %12.2f %12.2f\n", threads, locked, strict, relaxed);
+	}
+
+	return 0;
+}
@@ -0,0 +1,305 @@
+/**
+ * Push throughput into a message loop whose handler is busy, comparing the two ways a
+ * push has had of waking the loop:
+ *
+ *  trigger  Every push sets a manual-reset event, and the loop resets it on every
+ *           wakeup, as MessageLoop did with Condition::trigger() and reset().
+ *
+ *  parked   The loop parks on an EventCount once the queue is empty, and a push only
+ *           wakes it if it is parked, as MessageLoopBase does now.
+ *
+ * Both loops drain the same MpscQueue with the same handler, so the difference measured is
+ * only the wake path.  Condition is used for the event on Windows.  Elsewhere it is
+ * modelled with std::mutex and std::condition_variable.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude bench/MessageLoopPush.cpp src/Futex.cpp
+ *
+ * Usage: MessageLoopPush [producers] [messages per producer] [handler ns]
+ */
+
+#include <Concurrent/MpscQueue.h>
+#include <Concurrent/Internal/EventCount.h>
+
+#ifdef _WIN32
+#	include <Concurrent/Condition.h>
+#else
+#	include <condition_variable>
+#	include <mutex>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+#include <vector>
+
+using namespace Concurrent;
+
+typedef std::chrono::steady_clock clock_type;
+
+#ifdef _WIN32
+typedef Condition Event;
+#else
+/**
+ * A manual-reset event with the semantics of Condition.
+ */
+class Event
+{
+public:
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mChanged.wait(lock, [this]() { return mSet; });
+	}
+
+	void trigger()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mSet = true;
+		}
+
+		mChanged.notify_all();
+	}
+
+	void reset()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mSet = false;
+	}
+
+private:
+	std::mutex mMutex;
+	std::condition_variable mChanged;
+	bool mSet = false;
+};
+#endif
+
+/**
+ * Spins for about the given number of nanoseconds, standing in for handler work.
+ */
+static void work(int64_t nanoseconds)
+{
+	if (nanoseconds <= 0)
+		return;
+
+	clock_type::time_point end = clock_type::now() + std::chrono::nanoseconds(nanoseconds);
+
+	while (clock_type::now() < end);
+}
+
+class TriggerLoop
+{
+public:
+	TriggerLoop(int64_t handlerNs)
+		: mHandlerNs(handlerNs), mContinue(true), mHandled(0)
+	{
+		mThread = std::thread([this]() { loop(); });
+	}
+
+	~TriggerLoop()
+	{
+		mContinue.store(false);
+		mEvent.trigger();
+		mThread.join();
+	}
+
+	void push(uint64_t value)
+	{
+		mQueue.push(value);
+		mEvent.trigger();
+	}
+
+	uint64_t handled() const
+	{
+		return mHandled.load(std::memory_order_relaxed);
+	}
+
+private:
+	void loop()
+	{
+		while (false == mQueue.isEmpty() || mContinue)
+		{
+			mEvent.wait();
+			mEvent.reset();
+
+			uint64_t value;
+
+			while (mQueue.tryPop(value))
+			{
+				work(mHandlerNs);
+				mHandled.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	int64_t mHandlerNs;
+	MpscQueue<uint64_t> mQueue;
+	Event mEvent;
+	std::atomic<bool> mContinue;
+	std::atomic<uint64_t> mHandled;
+	std::thread mThread;
+};
+
+class ParkedLoop
+{
+public:
+	ParkedLoop(int64_t handlerNs)
+		: mHandlerNs(handlerNs), mContinue(true), mHandled(0)
+	{
+		mThread = std::thread([this]() { loop(); });
+	}
+
+	~ParkedLoop()
+	{
+		mContinue.store(false, std::memory_order_release);
+		mMessageReady.notifyAll();
+		mThread.join();
+	}
+
+	void push(uint64_t value)
+	{
+		mQueue.push(value);
+		mMessageReady.notifyOne();
+	}
+
+	uint64_t handled() const
+	{
+		return mHandled.load(std::memory_order_relaxed);
+	}
+
+private:
+	void loop()
+	{
+		while (true)
+		{
+			uint64_t value;
+
+			while (mQueue.tryPop(value))
+			{
+				work(mHandlerNs);
+				mHandled.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			if (false == mContinue.load(std::memory_order_acquire))
+			{
+				if (false == mQueue.isEmpty())
+					continue;
+
+				return;
+			}
+
+			uint32_t key = mMessageReady.prepareWait();
+
+			if (false == mQueue.isEmpty() || false == mContinue.load(std::memory_order_acquire))
+			{
+				mMessageReady.cancelWait();
+				continue;
+			}
+
+			mMessageReady.commitWait(key);
+		}
+	}
+
+	int64_t mHandlerNs;
+	MpscQueue<uint64_t> mQueue;
+	EventCount mMessageReady;
+	std::atomic<bool> mContinue;
+	std::atomic<uint64_t> mHandled;
+	std::thread mThread;
+};
+
+struct Result
+{
+	double pushesPerSecond;
+	double handledPerSecond;
+};
+
+/**
+ * Times producers pushing messages each into the loop, and then the loop catching up.
+ */
+template<typename loop_t>
+static Result run(int producers, uint64_t messages, int64_t handlerNs)
+{
+	loop_t loop(handlerNs);
+
+	std::atomic<int> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int p = 0; p < producers; ++p)
+	{
+		threads.emplace_back([&]()
+		{
+			ready.fetch_add(1);
+
+			while (false == go.load())
+				std::this_thread::yield();
+
+			for (uint64_t i = 0; i < messages; ++i)
+				loop.push(i);
+		});
+	}
+
+	while (ready.load() < producers)
+		std::this_thread::yield();
+
+	clock_type::time_point start = clock_type::now();
+	go.store(true);
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	clock_type::time_point pushed = clock_type::now();
+	uint64_t total = messages * (uint64_t)producers;
+
+	while (loop.handled() < total)
+		std::this_thread::yield();
+
+	clock_type::time_point handled = clock_type::now();
+
+	std::chrono::duration<double> pushTime = pushed - start;
+	std::chrono::duration<double> handleTime = handled - start;
+
+	return Result{ (double)total / pushTime.count(), (double)total / handleTime.count() };
+}
+
+int main(int argc, char** argv)
+{
+	int maxProducers = (argc > 1) ? std::atoi(argv[1]) : 4;
+	uint64_t messages = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 200000;
+	int64_t handlerNs = (argc > 3) ? std::atoll(argv[3]) : 200;
+
+	const int Repeats = 3;
+
+	std::printf("%u hardware threads, %llu messages per producer, %lld ns handler, best of %d\n",
+		std::thread::hardware_concurrency(), (unsigned long long)messages, (long long)handlerNs, Repeats);
+	std::printf("%-10s %-8s %16s %16s\n", "producers", "wake", "pushes/s", "handled/s");
+
+	for (int producers = 1; producers <= maxProducers; producers *= 2)
+	{
+		Result trigger = { 0.0, 0.0 };
+		Result parked = { 0.0, 0.0 };
+
+		for (int i = 0; i < Repeats; ++i)
+		{
+			Result t = run<TriggerLoop>(producers, messages, handlerNs);
+			Result p = run<ParkedLoop>(producers, messages, handlerNs);
+
+			if (t.pushesPerSecond > trigger.pushesPerSecond)
+				trigger = t;
+
+			if (p.pushesPerSecond > parked.pushesPerSecond)
+				parked = p;
+		}
+
+		std::printf("%-10d %-8s %16.0f %16.0f\n", producers, "trigger", trigger.pushesPerSecond, trigger.handledPerSecond);
+		std::printf("%-10d %-8s %16.0f %16.0f\n", producers, "parked", parked.pushesPerSecond, parked.handledPerSecond);
+	}
+
+	return 0;
+}
@@ -0,0 +1,364 @@
+#ifndef _CONCURRENT_ACTOR_POOL_H_
+#define _CONCURRENT_ACTOR_POOL_H_
+
+#include "RWLock.h"
+#include "Concurrent.h"
+#include "ReadLocker.h"
+#include "WriteLocker.h"
+#include "MessageLoop.h"
+
+#include "Internal/EventCount.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  Handles messages for a large number of keyed entities on a fixed set of shard
+	 *  MessageLoops, instead of one loop per entity.
+	 *
+	 *  Each key is handled by one shard at a time, so messages for a key are handled in
+	 *  the order they were pushed and never concurrently, while different keys proceed in
+	 *  parallel across shards.  A key starts on the shard its hash selects.  moveKey() moves
+	 *  a hot key to another shard without breaking its ordering: new messages for the key
+	 *  are held back until the old shard has handled everything it already had queued for
+	 *  the key, and are then released to the new shard.
+	 *
+	 *  key_t must be default constructible and copyable.
+	 */
+	template<typename key_t, typename msg_t, typename hash_t = std::hash<key_t>>
+	class ActorPool
+	{
+	public:
+		typedef std::function<void(const key_t&, const msg_t&)> handler_t;
+		typedef MessageLoopBase::Execution Execution;
+
+		ActorPool(const ActorPool&) = delete;
+		ActorPool& operator=(const ActorPool&) = delete;
+
+		/**
+		 * @brief
+		 *  Creates a pool of shardCount shard loops, which is hardwareConcurrency() if zero.
+		 *  msgHandler is called for every message, concurrently from different shards.
+		 */
+		ActorPool(handler_t&& msgHandler, size_t shardCount = 0, Execution execution = Execution::Task)
+			: mHandler(std::move(msgHandler)), mMovesInFlight(0)
+		{
+			mShardCount = (0 != shardCount) ? shardCount : std::max(1u, hardwareConcurrency());
+			mShards = std::make_unique<Shard[]>(mShardCount);
+
+			for (size_t i = 0; i < mShardCount; ++i)
+			{
+				Shard* shard = &mShards[i];
+
+				shard->loop = std::make_unique< MessageLoop<Envelope> >(
+					[this, shard](const Envelope& envelope) { handle(*shard, envelope); },
+					execution);
+			}
+		}
+
+		/**
+		 * @brief
+		 *  Handles every message already pushed before returning.
+		 */
+		virtual ~ActorPool()
+		{
+			// A move in progress still has to release held messages into its target
+			// shard, so all moves must finish before any shard is torn down.
+			while (0 != mMovesInFlight.load(std::memory_order_acquire))
+			{
+				uint32_t key = mMovesDone.prepareWait();
+
+				if (0 == mMovesInFlight.load(std::memory_order_acquire))
+				{
+					mMovesDone.cancelWait();
+					break;
+				}
+
+				mMovesDone.commitWait(key);
+			}
+
+			for (size_t i = 0; i < mShardCount; ++i)
+				mShards[i].loop.reset();
+		}
+
+		void push(const key_t& key, const msg_t& msg)
+		{
+			pushMessage(key, msg);
+		}
+
+		void push(const key_t& key, msg_t&& msg)
+		{
+			pushMessage(key, std::move(msg));
+		}
+
+		/**
+		 * @brief
+		 *  Moves key to the shard at index shard.  Returns false if the index is out of
+		 *  range, or key is already being moved.
+		 */
+		bool moveKey(const key_t& key, size_t shard)
+		{
+			if (shard >= mShardCount)
+				return false;
+
+			Shard& home = homeShard(key);
+			size_t from;
+
+			{
+				WriteLocker lock(&home.routeLock);
+
+				auto found = home.routes.find(key);
+
+				if (found == home.routes.end())
+				{
+					from = homeIndex(key);
+
+					if (from == shard)
+						return true;
+
+					found = home.routes.emplace(key, Route()).first;
+				}
+				else if (found->second.gated)
+				{
+					return false;
+				}
+				else
+				{
+					from = found->second.shard;
+
+					if (from == shard)
+						return true;
+				}
+
+				found->second.shard = shard;
+				found->second.gated = true;
+
+				mMovesInFlight.fetch_add(1, std::memory_order_relaxed);
+
+				// Pushed under the lock, so no message for the key can reach the old
+				// shard after the marker.
+				Envelope marker;
+				marker.key = key;
+
+				mShards[from].loop->push(std::move(marker));
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  The index of the shard currently handling key.
+		 */
+		size_t shardOf(const key_t& key)
+		{
+			Shard& home = homeShard(key);
+			ReadLocker lock(&home.routeLock);
+
+			auto found = home.routes.find(key);
+			return (found == home.routes.end()) ? homeIndex(key) : found->second.shard;
+		}
+
+		/**
+		 * @brief
+		 *  The number of shard loops.
+		 */
+		size_t shardCount() const
+		{
+			return mShardCount;
+		}
+
+		/**
+		 * @brief
+		 *  The number of messages queued on shard and not yet handled.
+		 */
+		size_t shardDepth(size_t shard) const
+		{
+			return mShards[shard].depth.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief
+		 *  The queue depth of every shard, indexed by shard.
+		 */
+		std::vector<size_t> shardDepths() const
+		{
+			std::vector<size_t> depths(mShardCount);
+
+			for (size_t i = 0; i < mShardCount; ++i)
+				depths[i] = shardDepth(i);
+
+			return depths;
+		}
+
+	private:
+		/**
+		 * @brief
+		 *  A message for a key, or a marker for a move of the key away from the shard
+		 *  when msg is empty.
+		 */
+		struct Envelope
+		{
+			key_t key;
+			std::optional<msg_t> msg;
+		};
+
+		/**
+		 * @brief
+		 *  Where a moved key is handled.  While gated, new messages for the key are kept
+		 *  in held until the marker reaches the old shard.
+		 */
+		struct Route
+		{
+			size_t shard = 0;
+			bool gated = false;
+			std::vector<msg_t> held;
+		};
+
+		/**
+		 * @brief
+		 *  A shard loop, along with the routes of moved keys whose hash selects this shard.
+		 *  Pushes for a key take its home shard's route lock for reading, so a move only
+		 *  contends with pushes to keys of the same home shard.
+		 */
+		struct alignas(CacheLineSize) Shard
+		{
+			std::unique_ptr< MessageLoop<Envelope> > loop;
+			std::atomic<size_t> depth = 0;
+
+			RWLock routeLock;
+			std::unordered_map<key_t, Route, hash_t> routes;
+		};
+
+		size_t homeIndex(const key_t& key) const
+		{
+			return mHash(key) % mShardCount;
+		}
+
+		Shard& homeShard(const key_t& key)
+		{
+			return mShards[homeIndex(key)];
+		}
+
+		template<typename item_t>
+		void pushMessage(const key_t& key, item_t&& msg)
+		{
+			Shard& home = homeShard(key);
+
+			{
+				ReadLocker lock(&home.routeLock);
+
+				size_t target = homeIndex(key);
+
+				if (false == home.routes.empty())
+				{
+					auto found = home.routes.find(key);
+
+					if (found != home.routes.end())
+					{
+						if (false == found->second.gated)
+							target = found->second.shard;
+						else
+							target = mShardCount;
+					}
+				}
+
+				if (target < mShardCount)
+				{
+					deliver(target, key, std::forward<item_t>(msg));
+					return;
+				}
+			}
+
+			// The key is being moved.  Holding its message needs the write lock, and the
+			// move may have completed while it was being acquired.
+			WriteLocker lock(&home.routeLock);
+
+			auto found = home.routes.find(key);
+
+			if (found == home.routes.end())
+				deliver(homeIndex(key), key, std::forward<item_t>(msg));
+			else if (found->second.gated)
+				found->second.held.emplace_back(std::forward<item_t>(msg));
+			else
+				deliver(found->second.shard, key, std::forward<item_t>(msg));
+		}
+
+		template<typename item_t>
+		void deliver(size_t shard, const key_t& key, item_t&& msg)
+		{
+			Envelope envelope;
+			envelope.key = key;
+			envelope.msg.emplace(std::forward<item_t>(msg));
+
+			mShards[shard].depth.fetch_add(1, std::memory_order_relaxed);
+			mShards[shard].loop->push(std::move(envelope));
+		}
+
+		void handle(Shard& shard, const Envelope& envelope)
+		{
+			if (envelope.msg)
+			{
+				mHandler(envelope.key, *envelope.msg);
+				shard.depth.fetch_sub(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				release(envelope.key);
+			}
+		}
+
+		/**
+		 * @brief
+		 *  Called when a move marker has been reached on the key's old shard, so the
+		 *  messages held for it can go to the new one.
+		 */
+		void release(const key_t& key)
+		{
+			size_t homeIndexValue = homeIndex(key);
+			Shard& home = mShards[homeIndexValue];
+
+			{
+				WriteLocker lock(&home.routeLock);
+
+				auto found = home.routes.find(key);
+				Route& route = found->second;
+
+				for (msg_t& msg : route.held)
+					deliver(route.shard, key, std::move(msg));
+
+				if (route.shard == homeIndexValue)
+				{
+					home.routes.erase(found);
+				}
+				else
+				{
+					route.held.clear();
+					route.gated = false;
+				}
+			}
+
+			mMovesInFlight.fetch_sub(1, std::memory_order_release);
+			mMovesDone.notifyAll();
+		}
+
+		handler_t mHandler;
+		hash_t mHash;
+
+		size_t mShardCount;
+		std::unique_ptr<Shard[]> mShards;
+
+		std::atomic<size_t> mMovesInFlight;
+		EventCount mMovesDone;
+	};
+}
+
+#endif // _CONCURRENT_ACTOR_POOL_H_
\ No newline at end of file
@@ -0,0 +1,489 @@
+#ifndef _CONCURRENT_BOUNDED_QUEUE_H_
+#define _CONCURRENT_BOUNDED_QUEUE_H_
+
+#include "Config.h"
+#include "Concurrent.h"
+
+#include "Internal/EventCount.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  A fixed capacity multi-producer/multi-consumer queue.
+	 *
+	 *  Storage for all Capacity items is part of the queue object itself, so pushing never
+	 *  allocates.  Each slot of the ring carries a sequence counter that tells producers and
+	 *  consumers whether it is free or holds an item for the current lap, so claiming a slot
+	 *  is a single compare-and-swap on the shared position.
+	 *
+	 *  The try* functions never block.  push() and pop() block while the queue is full or
+	 *  empty respectively, parking the thread on the platform futex rather than spinning, and
+	 *  the *For() variants give up after a timeout.  Notifying a parked thread only costs
+	 *  anything when a thread is actually parked.
+	 *
+	 *  Once a slot is claimed it must be published, or the ring stalls at that position.
+	 *  T must therefore be nothrow move constructible and assignable, and items that are
+	 *  copied or constructed from arguments by a constructor that can throw are built
+	 *  before a slot is claimed and then moved in.
+	 */
+	template<typename T, size_t Capacity>
+	class BoundedQueue
+	{
+		static_assert(Capacity >= 2 && 0 == (Capacity & (Capacity - 1)),
+			"BoundedQueue capacity must be a power of two.");
+
+		static_assert(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_move_assignable_v<T>,
+			"BoundedQueue items must be nothrow move constructible and assignable.");
+
+	public:
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		/**
+		 * @brief
+		 *  Creates an empty queue.
+		 */
+		BoundedQueue()
+		{
+			for (size_t i = 0; i < Capacity; ++i)
+				mSlots[i].sequence.store(i, std::memory_order_relaxed);
+
+			mEnqueuePos.store(0, std::memory_order_relaxed);
+			mDequeuePos.store(0, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief
+		 *  Destroys any items remaining in the queue.
+		 */
+		virtual ~BoundedQueue()
+		{
+			std::optional<T> discard;
+			while (tryDequeue(discard))
+				discard.reset();
+		}
+
+		/**
+		 * @brief
+		 *  Copies item into the queue if there is space.  Returns false if the queue is full.
+		 */
+		bool tryPush(const T& item)
+		{
+			return tryEnqueue(item);
+		}
+
+		/**
+		 * @brief
+		 *  Moves item into the queue if there is space.  Returns false if the queue is full,
+		 *  in which case item is left unchanged.
+		 */
+		bool tryPush(T&& item)
+		{
+			return tryEnqueue(std::move(item));
+		}
+
+		/**
+		 * @brief
+		 *  Constructs an item in the queue from the passed arguments if there is space.
+		 *  Returns false if the queue is full.
+		 */
+		template<typename ...args_t>
+		bool tryEmplace(args_t&& ...args)
+		{
+			return tryEnqueue(std::forward<args_t>(args)...);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes as many items from the front of the range [first, last) as there is space
+		 *  for, claiming all of the slots with a single compare-and-swap.  Use
+		 *  std::make_move_iterator() to move the items instead of copying them.
+		 *
+		 *  If constructing an item from the range can throw, as copying usually can, the
+		 *  items that could fit are first copied into temporaries, so that an exception is
+		 *  thrown before any slot is claimed.
+		 *
+		 * @return
+		 *  The number of items pushed.  Items after those are left untouched.
+		 */
+		template<typename iterator_t>
+		size_t tryPushBulk(iterator_t first, iterator_t last)
+		{
+			size_t wanted = std::min((size_t)std::distance(first, last), Capacity);
+
+			if constexpr (std::is_nothrow_constructible_v<T, decltype(*first)>)
+			{
+				return publishBulk(first, wanted);
+			}
+			else
+			{
+				std::vector<T> items;
+				items.reserve(wanted);
+
+				for (size_t i = 0; i < wanted; ++i, ++first)
+					items.emplace_back(*first);
+
+				return publishBulk(std::make_move_iterator(items.begin()), wanted);
+			}
+		}
+
+		/**
+		 * @brief
+		 *  Copies item into the queue, blocking while the queue is full.
+		 */
+		void push(const T& item)
+		{
+			waitUntil([&]() { return tryEnqueue(item); }, mNotFull, nullptr);
+		}
+
+		/**
+		 * @brief
+		 *  Moves item into the queue, blocking while the queue is full.
+		 */
+		void push(T&& item)
+		{
+			waitUntil([&]() { return tryEnqueue(std::move(item)); }, mNotFull, nullptr);
+		}
+
+		/**
+		 * @brief
+		 *  Copies item into the queue, blocking for at most timeout while the queue is full.
+		 *  Returns false if the queue was still full when the time expired.
+		 */
+		template<typename rep_t, typename period_t>
+		bool pushFor(const T& item, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+			return waitUntil([&]() { return tryEnqueue(item); }, mNotFull, &deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Moves item into the queue, blocking for at most timeout while the queue is full.
+		 *  Returns false if the queue was still full when the time expired, in which case
+		 *  item is left unchanged.
+		 */
+		template<typename rep_t, typename period_t>
+		bool pushFor(T&& item, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+			return waitUntil([&]() { return tryEnqueue(std::move(item)); }, mNotFull, &deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Attempts to pop an item from the queue, if there is something to
+		 *  de-queue, it is placed in destination and true is returned.
+		 *  Otherwise, destination remains unchanged and false is returned.
+		 */
+		bool tryPop(T& destination)
+		{
+			return tryDequeue(destination);
+		}
+
+		/**
+		 * @brief
+		 *  Attempts to pop an item from the queue, if there is something to
+		 *  de-queue, it is placed in destination and true is returned.
+		 *  Otherwise, destination remains unchanged and false is returned.
+		 */
+		bool tryPop(std::optional<T>& destination)
+		{
+			return tryDequeue(destination);
+		}
+
+		/**
+		 * @brief
+		 *  Pops up to maxCount items from the queue, writing them to destination in order.
+		 *  All of the slots are claimed with a single compare-and-swap.  Returns the number
+		 *  of items popped.
+		 *
+		 *  If writing to destination throws, for example a back_inserter that cannot grow,
+		 *  the claimed items not yet written are destroyed so their slots are still freed,
+		 *  and the exception is rethrown.
+		 */
+		template<typename output_iterator_t>
+		size_t tryPopBulk(output_iterator_t destination, size_t maxCount)
+		{
+			size_t pos;
+			size_t count = claim(mDequeuePos, 1, std::min(maxCount, Capacity), pos);
+			size_t i = 0;
+
+			try
+			{
+				for (; i < count; ++i)
+				{
+					Slot& slot = mSlots[(pos + i) & Mask];
+
+					*destination = std::move(*slot.item());
+					++destination;
+
+					releaseSlot(slot, pos + i);
+				}
+			}
+			catch (...)
+			{
+				for (; i < count; ++i)
+					releaseSlot(mSlots[(pos + i) & Mask], pos + i);
+
+				mNotFull.notifyAll();
+				throw;
+			}
+
+			if (count > 1)
+				mNotFull.notifyAll();
+			else if (count == 1)
+				mNotFull.notifyOne();
+
+			return count;
+		}
+
+		/**
+		 * @brief
+		 *  Pops an item into destination, blocking while the queue is empty.
+		 */
+		void pop(T& destination)
+		{
+			waitUntil([&]() { return tryDequeue(destination); }, mNotEmpty, nullptr);
+		}
+
+		/**
+		 * @brief
+		 *  Pops an item into destination, blocking while the queue is empty.
+		 */
+		void pop(std::optional<T>& destination)
+		{
+			waitUntil([&]() { return tryDequeue(destination); }, mNotEmpty, nullptr);
+		}
+
+		/**
+		 * @brief
+		 *  Pops an item into destination, blocking for at most timeout while the queue is
+		 *  empty.  Returns false, leaving destination unchanged, if the time expired.
+		 */
+		template<typename rep_t, typename period_t>
+		bool popFor(T& destination, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+			return waitUntil([&]() { return tryDequeue(destination); }, mNotEmpty, &deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Pops an item into destination, blocking for at most timeout while the queue is
+		 *  empty.  Returns false, leaving destination unchanged, if the time expired.
+		 */
+		template<typename rep_t, typename period_t>
+		bool popFor(std::optional<T>& destination, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+			return waitUntil([&]() { return tryDequeue(destination); }, mNotEmpty, &deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Inspector to determine if the queue is empty.  The result is only a snapshot
+		 *  when other threads are using the queue.
+		 */
+		bool isEmpty() const
+		{
+			size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+			const Slot& slot = mSlots[pos & Mask];
+
+			return (slot.sequence.load(std::memory_order_acquire) != pos + 1);
+		}
+
+		/**
+		 * @brief
+		 *  The maximum number of items the queue can hold.
+		 */
+		static constexpr size_t capacity()
+		{
+			return Capacity;
+		}
+
+	private:
+		static constexpr size_t Mask = Capacity - 1;
+
+		struct Slot
+		{
+			std::atomic<size_t> sequence;
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+			T* item()
+			{
+				return std::launder(reinterpret_cast<T*>(&storage));
+			}
+		};
+
+		/**
+		 * @brief
+		 *  Claims up to maxCount consecutive positions from position, where the slot for
+		 *  position p is ready when its sequence is p + offset.  The claim is a single
+		 *  compare-and-swap covering every slot that was seen to be ready, which is safe
+		 *  because a ready slot can only be changed by whoever claims its position.
+		 *
+		 * @return
+		 *  The number of positions claimed, with the first placed in start.
+		 */
+		size_t claim(std::atomic<size_t>& position, size_t offset, size_t maxCount, size_t& start)
+		{
+			if (0 == maxCount)
+				return 0;
+
+			size_t pos = position.load(std::memory_order_relaxed);
+
+			while (true)
+			{
+				size_t seq = mSlots[pos & Mask].sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t)seq - (intptr_t)(pos + offset);
+
+				if (diff < 0)
+					return 0;
+
+				if (diff > 0)
+				{
+					pos = position.load(std::memory_order_relaxed);
+					continue;
+				}
+
+				size_t count = 1;
+
+				while (count < maxCount &&
+				       mSlots[(pos + count) & Mask].sequence.load(std::memory_order_acquire) == pos + count + offset)
+				{
+					++count;
+				}
+
+				if (position.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+				{
+					start = pos;
+					return count;
+				}
+			}
+		}
+
+		template<typename ...args_t>
+		bool tryEnqueue(args_t&& ...args)
+		{
+			if constexpr (std::is_nothrow_constructible_v<T, args_t&&...>)
+			{
+				size_t pos;
+
+				if (0 == claim(mEnqueuePos, 0, 1, pos))
+					return false;
+
+				Slot& slot = mSlots[pos & Mask];
+
+				new(&slot.storage) T(std::forward<args_t>(args)...);
+				slot.sequence.store(pos + 1, std::memory_order_release);
+
+				mNotEmpty.notifyOne();
+				return true;
+			}
+			else
+			{
+				// Built first, so a throwing constructor cannot strand a claimed slot.
+				return tryEnqueue(T(std::forward<args_t>(args)...));
+			}
+		}
+
+		/**
+		 * @brief
+		 *  Claims slots for up to wanted items and moves or copies them in from first,
+		 *  which must not throw.
+		 */
+		template<typename iterator_t>
+		size_t publishBulk(iterator_t first, size_t wanted)
+		{
+			size_t pos;
+			size_t count = claim(mEnqueuePos, 0, wanted, pos);
+
+			for (size_t i = 0; i < count; ++i, ++first)
+			{
+				Slot& slot = mSlots[(pos + i) & Mask];
+
+				new(&slot.storage) T(*first);
+				slot.sequence.store(pos + i + 1, std::memory_order_release);
+			}
+
+			if (count > 1)
+				mNotEmpty.notifyAll();
+			else if (count == 1)
+				mNotEmpty.notifyOne();
+
+			return count;
+		}
+
+		void releaseSlot(Slot& slot, size_t pos)
+		{
+			slot.item()->~T();
+			slot.sequence.store(pos + Capacity, std::memory_order_release);
+		}
+
+		template<typename out_t>
+		bool tryDequeue(out_t& out)
+		{
+			size_t pos;
+
+			if (0 == claim(mDequeuePos, 1, 1, pos))
+				return false;
+
+			Slot& slot = mSlots[pos & Mask];
+
+			out = std::move(*slot.item());
+			releaseSlot(slot, pos);
+
+			mNotFull.notifyOne();
+			return true;
+		}
+
+		template<typename func_t>
+		static bool waitUntil(func_t&& attempt, EventCount& event, const std::chrono::steady_clock::time_point* deadline)
+		{
+			while (false == attempt())
+			{
+				uint32_t key = event.prepareWait();
+
+				if (attempt())
+				{
+					event.cancelWait();
+					return true;
+				}
+
+				if (deadline)
+				{
+					if (false == event.commitWaitUntil(key, *deadline))
+						return attempt();
+				}
+				else
+				{
+					event.commitWait(key);
+				}
+			}
+
+			return true;
+		}
+
+		alignas(CacheLineSize) std::atomic<size_t> mEnqueuePos;
+		alignas(CacheLineSize) std::atomic<size_t> mDequeuePos;
+
+		alignas(CacheLineSize) EventCount mNotEmpty;
+		alignas(CacheLineSize) EventCount mNotFull;
+
+		alignas(CacheLineSize) std::array<Slot, Capacity> mSlots;
+	};
+}
+
+#endif // _CONCURRENT_BOUNDED_QUEUE_H_
\ No newline at end of file
@@ -0,0 +1,562 @@
+#ifndef _CONCURRENT_BROADCAST_H_
+#define _CONCURRENT_BROADCAST_H_
+
+#include "Config.h"
+#include "RWLock.h"
+#include "Concurrent.h"
+#include "ReadLocker.h"
+#include "WriteLocker.h"
+
+#include "Internal/EventCount.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  A channel that delivers every published item to every subscriber.
+	 *
+	 *  Items are stored once in a ring of preallocated slots.  Each Subscription keeps its
+	 *  own cursor into the ring, and reads items in place through a callback, so fanning out
+	 *  to several consumers neither copies the item nor queues it more than once.  Publishers
+	 *  claim a slot with a single atomic increment.
+	 *
+	 *  A publisher may only reuse a slot once every subscriber has read it.  What happens
+	 *  when a subscriber falls a whole ring behind depends on the Policy:
+	 *
+	 *  - Block: the publisher waits for the slow subscriber to catch up.
+	 *  - Drop: the slow subscriber is detached, and from then on its reads fail and
+	 *          isDropped() returns true.  Publishers never wait on subscribers, except to let
+	 *          one that is being dropped finish the read it is in the middle of.  A subscriber
+	 *          is only slow if a whole ring of published items is waiting for it, so one that
+	 *          is held up by a publisher still writing an earlier item is not dropped.  The
+	 *          publisher that needs its slot waits for the earlier publishers instead.
+	 *
+	 *  Publishers only look at the subscriber cursors when they get within a ring of the
+	 *  slowest position they last saw, so while subscribers keep up publishing does not
+	 *  touch them at all.
+	 *
+	 *  T must be default constructible and move assignable, as the slots are constructed
+	 *  up front and items are assigned into them.
+	 */
+	template<typename T>
+	class Broadcast
+	{
+	private:
+		enum State : uint32_t
+		{
+			Idle,
+			Reading,
+			Dropped
+		};
+
+		struct alignas(CacheLineSize) Slot
+		{
+			std::atomic<uint64_t> sequence;
+			T item;
+		};
+
+		/**
+		 * @brief
+		 *  A subscriber's position.  next is the sequence of the next item it will read.
+		 *  state is only used under the Drop policy, so a publisher can tell whether the
+		 *  subscriber is in the middle of reading before detaching it.
+		 */
+		struct alignas(CacheLineSize) Cursor
+		{
+			std::atomic<uint64_t> next;
+			std::atomic<uint32_t> state;
+
+			Cursor()
+				: next(0), state(Idle)
+			{
+			}
+		};
+
+	public:
+		enum class Policy
+		{
+			Block,
+			Drop
+		};
+
+		Broadcast(const Broadcast&) = delete;
+		Broadcast& operator=(const Broadcast&) = delete;
+
+		/**
+		 * @brief
+		 *  A subscriber's view of the channel.  It receives every item published after
+		 *  it was constructed.
+		 *
+		 *  A Subscription must be destroyed before the Broadcast it reads from, and only
+		 *  one thread may read through a Subscription at a time.
+		 */
+		class Subscription
+		{
+			friend class Broadcast;
+
+		public:
+			Subscription(const Subscription&) = delete;
+			Subscription& operator=(const Subscription&) = delete;
+
+			Subscription(Broadcast& channel)
+				: mChannel(&channel)
+			{
+				mChannel->attach(&mCursor);
+			}
+
+			virtual ~Subscription()
+			{
+				mChannel->detach(&mCursor);
+			}
+
+			/**
+			 * @brief
+			 *  Calls func with a const reference to the next item, blocking until one is
+			 *  published.  Returns false if end() was called and every item has been read,
+			 *  or if the subscription was dropped.
+			 *
+			 *  The reference is only valid during the call.  Under the Drop policy publishers
+			 *  wait for func to return before reusing its slot, so it should be quick.
+			 */
+			template<typename func_t>
+			bool read(func_t&& func)
+			{
+				return mChannel->readItem(mCursor, func, false, nullptr);
+			}
+
+			/**
+			 * @brief
+			 *  Calls func with the next item if one is published, and returns true.  Returns
+			 *  false without blocking otherwise.
+			 */
+			template<typename func_t>
+			bool tryRead(func_t&& func)
+			{
+				return mChannel->readItem(mCursor, func, true, nullptr);
+			}
+
+			/**
+			 * @brief
+			 *  Calls func with the next item, blocking for at most timeout until one is
+			 *  published.  Returns false if the time expired, end() was called and every
+			 *  item has been read, or the subscription was dropped.
+			 */
+			template<typename func_t, typename rep_t, typename period_t>
+			bool readFor(func_t&& func, const std::chrono::duration<rep_t, period_t>& timeout)
+			{
+				auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+				return mChannel->readItem(mCursor, func, false, &deadline);
+			}
+
+			/**
+			 * @brief
+			 *  True if publishers detached this subscription for falling behind.  Only
+			 *  happens under the Drop policy.
+			 */
+			bool isDropped() const
+			{
+				return (Dropped == mCursor.state.load(std::memory_order_acquire));
+			}
+
+		private:
+			Broadcast* mChannel;
+			Cursor mCursor;
+		};
+
+		/**
+		 * @brief
+		 *  Creates a channel with a ring of capacity slots, which must be a power of two.
+		 */
+		Broadcast(size_t capacity, Policy policy = Policy::Block)
+			: mCapacity(capacity), mMask(capacity - 1), mPolicy(policy)
+		{
+			assert(capacity >= 2 && 0 == (capacity & (capacity - 1)));
+
+			mSlots = std::make_unique<Slot[]>(capacity);
+
+			// Each slot starts out looking like it was published one lap before
+			// the first sequence that will use it.
+			for (size_t i = 0; i < capacity; ++i)
+				mSlots[i].sequence.store((uint64_t)i - capacity, std::memory_order_relaxed);
+
+			mClaim.store(0, std::memory_order_relaxed);
+			mGating.store(0, std::memory_order_relaxed);
+			mPublishedEnd.store(0, std::memory_order_relaxed);
+			mEndCalled.store(false, std::memory_order_relaxed);
+		}
+
+		virtual ~Broadcast()
+		{
+		}
+
+		/**
+		 * @brief
+		 *  Publishes a copy of item to all subscribers, blocking under the Block policy
+		 *  while a subscriber is a full ring behind.  Returns false if end() was called.
+		 */
+		bool publish(const T& item)
+		{
+			return publishItem(item, false);
+		}
+
+		/**
+		 * @brief
+		 *  Publishes item to all subscribers using move semantics, blocking under the
+		 *  Block policy while a subscriber is a full ring behind.  Returns false if end()
+		 *  was called.
+		 */
+		bool publish(T&& item)
+		{
+			return publishItem(std::move(item), false);
+		}
+
+		/**
+		 * @brief
+		 *  Publishes a copy of item if it can be done without waiting on a subscriber.
+		 *  Returns false if the ring is full or end() was called.
+		 */
+		bool tryPublish(const T& item)
+		{
+			return publishItem(item, true);
+		}
+
+		/**
+		 * @brief
+		 *  Publishes item using move semantics if it can be done without waiting on a
+		 *  subscriber.  Returns false, leaving item unchanged, if the ring is full or end()
+		 *  was called.
+		 */
+		bool tryPublish(T&& item)
+		{
+			return publishItem(std::move(item), true);
+		}
+
+		/**
+		 * @brief
+		 *  Marks the end of publishing.  Subscribers can read the items already published,
+		 *  after which their reads return false.  Subsequent publishes fail.
+		 */
+		void end()
+		{
+			mEndCalled.store(true, std::memory_order_release);
+			mPublished.notifyAll();
+		}
+
+		/**
+		 * @brief
+		 *  The number of slots in the ring.
+		 */
+		size_t capacity() const
+		{
+			return mCapacity;
+		}
+
+	private:
+		template<typename item_t>
+		bool publishItem(item_t&& item, bool trying)
+		{
+			if (mEndCalled.load(std::memory_order_acquire))
+				return false;
+
+			uint64_t sequence;
+
+			if (trying)
+			{
+				sequence = mClaim.load(std::memory_order_relaxed);
+
+				do
+				{
+					if (false == hasSpace(sequence))
+						return false;
+				}
+				while (false == mClaim.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed));
+			}
+			else
+			{
+				sequence = mClaim.fetch_add(1, std::memory_order_relaxed);
+				waitForSpace(sequence);
+			}
+
+			Slot& slot = mSlots[sequence & mMask];
+
+			// With no subscribers to gate on, the publisher of the previous lap may
+			// still be writing this slot.
+			for (uint32_t spins = 0; slot.sequence.load(std::memory_order_acquire) != sequence - mCapacity; ++spins)
+			{
+				if (spins < 64)
+					spinPause();
+				else
+					std::this_thread::yield();
+			}
+
+			slot.item = std::forward<item_t>(item);
+			slot.sequence.store(sequence, std::memory_order_release);
+
+			mPublished.notifyAll();
+
+			// A publisher may be waiting for earlier items to be published before it
+			// can tell whether a subscriber is really a ring behind.
+			if (Policy::Drop == mPolicy)
+				mSpace.notifyAll();
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  True if every subscriber is done with the slot that sequence will reuse.
+		 */
+		bool hasSpace(uint64_t sequence)
+		{
+			if (sequence < mGating.load(std::memory_order_acquire) + mCapacity)
+				return true;
+
+			uint64_t gating = refreshGating(sequence);
+			return (sequence < gating + mCapacity);
+		}
+
+		void waitForSpace(uint64_t sequence)
+		{
+			while (false == hasSpace(sequence))
+			{
+				uint32_t key = mSpace.prepareWait();
+
+				if (hasSpace(sequence))
+				{
+					mSpace.cancelWait();
+					return;
+				}
+
+				mSpace.commitWait(key);
+			}
+		}
+
+		/**
+		 * @brief
+		 *  Advances and returns the end of the published items, the sequence below which
+		 *  every item has been published.  Publishers can finish out of order, so this
+		 *  trails the claim position by the items still being written.
+		 */
+		uint64_t advancePublished()
+		{
+			uint64_t start = mPublishedEnd.load(std::memory_order_acquire);
+			uint64_t end = start;
+
+			// A slot's sequence only moves forward, a lap at a time, so one at or past
+			// end means end has been published, and possibly read and reused since.
+			while ((int64_t)(mSlots[end & mMask].sequence.load(std::memory_order_acquire) - end) >= 0)
+				++end;
+
+			while (start < end && false == mPublishedEnd.compare_exchange_weak(start, end, std::memory_order_acq_rel))
+				;
+
+			return std::max(start, end);
+		}
+
+		/**
+		 * @brief
+		 *  Recomputes the slowest subscriber position, first detaching any subscriber that
+		 *  is holding up sequence if the policy is Drop.  Only subscribers that are a ring
+		 *  behind the published items are detached, so claims that are still being written
+		 *  do not count against them.
+		 */
+		uint64_t refreshGating(uint64_t sequence)
+		{
+			ReadLocker lock(&mCursorLock);
+
+			// With no subscribers nothing gates, but a subscriber attaching later starts
+			// at the claim position, so that is the highest safe value.
+			uint64_t gating = mClaim.load(std::memory_order_acquire);
+			uint64_t dropBelow = 0;
+
+			if (Policy::Drop == mPolicy)
+				dropBelow = std::min(sequence, advancePublished());
+
+			for (Cursor* cursor : mCursors)
+			{
+				if (Policy::Drop == mPolicy && cursor->next.load(std::memory_order_acquire) + mCapacity <= dropBelow)
+					drop(cursor);
+
+				if (Dropped != cursor->state.load(std::memory_order_acquire))
+					gating = std::min(gating, cursor->next.load(std::memory_order_acquire));
+			}
+
+			mGating.store(gating, std::memory_order_release);
+			return gating;
+		}
+
+		/**
+		 * @brief
+		 *  Detaches cursor.  A subscriber that is reading is allowed to finish first, as it
+		 *  may be reading the very slot that is about to be reused.
+		 */
+		void drop(Cursor* cursor)
+		{
+			for (uint32_t spins = 0; ; ++spins)
+			{
+				uint32_t expected = Idle;
+
+				if (cursor->state.compare_exchange_weak(expected, Dropped, std::memory_order_acq_rel))
+				{
+					mPublished.notifyAll();
+					return;
+				}
+
+				if (Dropped == expected)
+					return;
+
+				if (spins < 64)
+					spinPause();
+				else
+					std::this_thread::yield();
+			}
+		}
+
+		void attach(Cursor* cursor)
+		{
+			WriteLocker lock(&mCursorLock);
+
+			cursor->next.store(mClaim.load(std::memory_order_acquire), std::memory_order_relaxed);
+			mCursors.push_back(cursor);
+		}
+
+		void detach(Cursor* cursor)
+		{
+			{
+				WriteLocker lock(&mCursorLock);
+				mCursors.erase(std::find(mCursors.begin(), mCursors.end(), cursor));
+			}
+
+			mSpace.notifyAll();
+		}
+
+		/**
+		 * @brief
+		 *  Starts a read under the Drop policy.  Returns false if the cursor was dropped.
+		 */
+		bool beginRead(Cursor& cursor)
+		{
+			if (Policy::Block == mPolicy)
+				return true;
+
+			while (true)
+			{
+				uint32_t expected = Idle;
+
+				if (cursor.state.compare_exchange_weak(expected, Reading, std::memory_order_acq_rel))
+					return true;
+
+				if (Dropped == expected)
+					return false;
+			}
+		}
+
+		void endRead(Cursor& cursor)
+		{
+			if (Policy::Drop == mPolicy)
+				cursor.state.store(Idle, std::memory_order_release);
+		}
+
+		/**
+		 * @brief
+		 *  Passes the item at cursor to func and advances past it.  Returns false if there
+		 *  is no item yet, or the cursor was dropped.
+		 */
+		template<typename func_t>
+		bool tryReadItem(Cursor& cursor, func_t& func)
+		{
+			if (false == beginRead(cursor))
+				return false;
+
+			uint64_t next = cursor.next.load(std::memory_order_relaxed);
+			Slot& slot = mSlots[next & mMask];
+
+			if (slot.sequence.load(std::memory_order_acquire) != next)
+			{
+				endRead(cursor);
+				return false;
+			}
+
+			func(static_cast<const T&>(slot.item));
+
+			cursor.next.store(next + 1, std::memory_order_release);
+			endRead(cursor);
+
+			mSpace.notifyAll();
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  True if there is nothing more cursor can read.
+		 */
+		bool isFinished(Cursor& cursor)
+		{
+			if (Dropped == cursor.state.load(std::memory_order_acquire))
+				return true;
+
+			return (mEndCalled.load(std::memory_order_acquire) &&
+			        cursor.next.load(std::memory_order_relaxed) == mClaim.load(std::memory_order_acquire));
+		}
+
+		template<typename func_t>
+		bool readItem(Cursor& cursor, func_t& func, bool trying, const std::chrono::steady_clock::time_point* deadline)
+		{
+			while (true)
+			{
+				if (tryReadItem(cursor, func))
+					return true;
+
+				if (trying || isFinished(cursor))
+					return false;
+
+				uint32_t key = mPublished.prepareWait();
+
+				if (tryReadItem(cursor, func))
+				{
+					mPublished.cancelWait();
+					return true;
+				}
+
+				if (isFinished(cursor))
+				{
+					mPublished.cancelWait();
+					return false;
+				}
+
+				if (nullptr == deadline)
+					mPublished.commitWait(key);
+				else if (false == mPublished.commitWaitUntil(key, *deadline))
+					trying = true;
+			}
+		}
+
+		alignas(CacheLineSize) std::atomic<uint64_t> mClaim;
+		alignas(CacheLineSize) std::atomic<uint64_t> mGating;
+		std::atomic<uint64_t> mPublishedEnd;
+		std::atomic<bool> mEndCalled;
+
+		size_t mCapacity;
+		size_t mMask;
+		Policy mPolicy;
+
+		std::unique_ptr<Slot[]> mSlots;
+
+		RWLock mCursorLock;
+		std::vector<Cursor*> mCursors;
+
+		EventCount mPublished;
+		EventCount mSpace;
+	};
+}
+
+#endif // _CONCURRENT_BROADCAST_H_
\ No newline at end of file
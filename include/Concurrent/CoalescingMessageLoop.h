@@ -0,0 +1,182 @@
+#ifndef _CONCURRENT_COALESCING_MESSAGE_LOOP_H_
+#define _CONCURRENT_COALESCING_MESSAGE_LOOP_H_
+
+#include "Mutex.h"
+#include "MutexLocker.h"
+
+#include "Internal/MessageLoopBase.h"
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  A MessageLoop where each message has a key, and at most one message per key is
+	 *  waiting to be handled at any time.
+	 *
+	 *  Pushing a message for a key that already has one pending updates the pending
+	 *  message in place instead of queueing another.  By default the newer message replaces
+	 *  the older one, but a merge function can be supplied to combine them instead.  Under
+	 *  bursts of updates to the same entities, handler work scales with the number of
+	 *  distinct keys rather than with the rate of pushes.
+	 *
+	 *  Keys are handled in the order their first pending message was pushed.  Once the
+	 *  handler has been given a key's message, a later push for that key is queued again.
+	 */
+	template<typename key_t, typename msg_t, typename hash_t = std::hash<key_t>>
+	class CoalescingMessageLoop : public MessageLoopBase
+	{
+	public:
+		typedef std::function<void(const key_t&, const msg_t&)> handler_t;
+
+		/**
+		 * @brief
+		 *  Combines incoming into pending, which is the message already waiting for the key.
+		 */
+		typedef std::function<void(msg_t& pending, msg_t&& incoming)> merge_t;
+
+	private:
+		/**
+		 * @brief
+		 *  The most messages taken from the pending set under one lock.
+		 */
+		static constexpr size_t BatchSize = 64;
+
+		handler_t mHandler;
+		merge_t mMerge;
+
+		mutable Mutex mLock;
+		std::unordered_map<key_t, msg_t, hash_t> mPending;
+		std::deque<key_t> mOrder;
+
+		std::vector< std::pair<key_t, msg_t> > mBatch;
+
+		/**
+		 * @brief
+		 *  The next entry of mBatch to give to the handler.  Entries from here on are left
+		 *  over if a handler throws, and are handled first on the next call.
+		 */
+		size_t mBatchNext;
+
+		template<typename item_t>
+		void pushMessage(const key_t& key, item_t&& msg)
+		{
+			{
+				MutexLocker lock(&mLock);
+
+				auto found = mPending.find(key);
+
+				if (found != mPending.end())
+				{
+					if (mMerge)
+						mMerge(found->second, msg_t(std::forward<item_t>(msg)));
+					else
+						found->second = std::forward<item_t>(msg);
+
+					return;
+				}
+
+				mPending.emplace(key, std::forward<item_t>(msg));
+				mOrder.push_back(key);
+			}
+
+			notifyPushed(1);
+		}
+
+	protected:
+		virtual bool hasMessages() const override
+		{
+			if (mBatchNext < mBatch.size())
+				return true;
+
+			MutexLocker lock(&mLock);
+			return (false == mOrder.empty());
+		}
+
+		virtual void handleMessages(size_t maxCount, size_t& handled) override
+		{
+			while (handled < maxCount)
+			{
+				if (mBatch.empty())
+				{
+					MutexLocker lock(&mLock);
+
+					size_t count = std::min({ maxCount - handled, BatchSize, mOrder.size() });
+
+					for (size_t i = 0; i < count; ++i)
+					{
+						auto found = mPending.find(mOrder.front());
+
+						mBatch.emplace_back(std::move(mOrder.front()), std::move(found->second));
+						mPending.erase(found);
+						mOrder.pop_front();
+					}
+				}
+
+				if (mBatch.empty())
+					break;
+
+				while (mBatchNext < mBatch.size() && handled < maxCount)
+				{
+					// Moved out so the message is released once it is handled, even if
+					// the handler throws.
+					std::pair<key_t, msg_t> entry = std::move(mBatch[mBatchNext++]);
+
+					++handled;
+					mHandler(entry.first, entry.second);
+				}
+
+				if (mBatchNext == mBatch.size())
+				{
+					mBatch.clear();
+					mBatchNext = 0;
+				}
+			}
+		}
+
+	public:
+		/**
+		 * @brief
+		 *  Creates a loop where a newer message for a key replaces the pending one.
+		 */
+		CoalescingMessageLoop(handler_t&& msgHandler, Execution execution = Execution::Task)
+			: CoalescingMessageLoop(std::move(msgHandler), merge_t(), execution)
+		{
+		}
+
+		/**
+		 * @brief
+		 *  Creates a loop where a newer message for a key is combined into the pending one
+		 *  with merge.  merge is called while holding the loop's lock, so it should be quick.
+		 */
+		CoalescingMessageLoop(handler_t&& msgHandler, merge_t&& merge, Execution execution = Execution::Task)
+			: mHandler(std::move(msgHandler)), mMerge(std::move(merge)), mBatchNext(0)
+		{
+			mBatch.reserve(BatchSize);
+			startLoop(execution);
+		}
+
+		~CoalescingMessageLoop()
+		{
+			stopLoop();
+		}
+
+		void push(const key_t& key, const msg_t& msg)
+		{
+			pushMessage(key, msg);
+		}
+
+		void push(const key_t& key, msg_t&& msg)
+		{
+			pushMessage(key, std::move(msg));
+		}
+	};
+}
+
+#endif // _CONCURRENT_COALESCING_MESSAGE_LOOP_H_
\ No newline at end of file
@@ -3,6 +3,9 @@
 
 #include "Config.h"
 
+#include <cstddef>
+#include <type_traits>
+
 /**
  * @brief
  *  Contains all classes and functionality of the Concurrent library.
@@ -14,6 +17,38 @@ namespace Concurrent
 	 *  Returns the number of logical cores on the host system.
 	 */
 	CONCURRENT_EXPORT unsigned int hardwareConcurrency();
+
+	/**
+	 * @brief
+	 *  The cache line size assumed when padding data that is written by
+	 *  different threads to keep it from being falsely shared.
+	 */
+	constexpr size_t CacheLineSize = 64;
+
+	/**
+	 * @brief
+	 *  True for queue types that only one thread may pop from at a time.  Queues that
+	 *  are specialized here can not back a consumer that is popped from other threads,
+	 *  such as a Producer waited on by a Select or consumed from coroutines.
+	 */
+	template<typename queue_t>
+	struct IsSingleConsumer : std::false_type {};
+
+	/**
+	 * @brief
+	 *  Hints to the processor that the calling thread is busy-waiting, which saves power
+	 *  and frees execution resources for a sibling hyper-thread.
+	 */
+	inline void spinPause()
+	{
+#	if defined(_WIN32)
+		YieldProcessor();
+#	elif defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#	elif defined(__aarch64__)
+		asm volatile("yield");
+#	endif
+	}
 }
 
 #endif // _CONCURRENT_H_
\ No newline at end of file
@@ -0,0 +1,333 @@
+#ifndef _CONCURRENT_PRIORITY_QUEUE_H_
+#define _CONCURRENT_PRIORITY_QUEUE_H_
+
+#include "Config.h"
+#include "Concurrent.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  A priority queue that can be pushed to and popped from by any number of threads.
+	 *
+	 *  tryPopMin() removes the item that is least according to Compare, so the default
+	 *  std::less pops the smallest item first.
+	 *
+	 *  In Strict mode all items are kept in a single heap, and every pop returns the true
+	 *  minimum at the moment it was taken.  In Relaxed mode the items are spread across
+	 *  several heaps (twice hardwareConcurrency()) each with its own lock.  A push goes to a
+	 *  random uncontended heap, and a pop compares the tops of two random heaps and takes the
+	 *  lesser one.  Items therefore come out in approximately sorted order, typically
+	 *  within a small rank of the true minimum, but threads rarely contend with each other.
+	 */
+	template<typename T, typename Compare = std::less<T>>
+	class ConcurrentPriorityQueue
+	{
+	public:
+		enum class Ordering
+		{
+			Strict,
+			Relaxed
+		};
+
+		ConcurrentPriorityQueue(const ConcurrentPriorityQueue&) = delete;
+		ConcurrentPriorityQueue& operator=(const ConcurrentPriorityQueue&) = delete;
+
+		/**
+		 * @brief
+		 *  Creates an empty priority queue with the passed ordering guarantee.
+		 */
+		ConcurrentPriorityQueue(Ordering ordering = Ordering::Strict, const Compare& compare = Compare())
+			: mCompare(compare)
+		{
+			mHeapCount = (Ordering::Strict == ordering) ? 1 : std::max(2u, 2 * hardwareConcurrency());
+			mHeaps = std::make_unique<Heap[]>(mHeapCount);
+		}
+
+		virtual ~ConcurrentPriorityQueue()
+		{
+		}
+
+		/**
+		 * @brief
+		 *  Copies item into the queue.
+		 */
+		void push(const T& item)
+		{
+			HeapLocker lock(&lockForPush());
+			heapPush(*lock.heap(), item);
+		}
+
+		/**
+		 * @brief
+		 *  Moves item into the queue.
+		 */
+		void push(T&& item)
+		{
+			HeapLocker lock(&lockForPush());
+			heapPush(*lock.heap(), std::move(item));
+		}
+
+		/**
+		 * @brief
+		 *  Removes the least item from the queue, placing it in destination and returning
+		 *  true.  In Relaxed mode the item is only approximately the least.  If the queue
+		 *  is empty, destination remains unchanged and false is returned.
+		 */
+		bool tryPopMin(T& destination)
+		{
+			return popInto(destination);
+		}
+
+		/**
+		 * @brief
+		 *  Removes the least item from the queue, placing it in destination and returning
+		 *  true.  In Relaxed mode the item is only approximately the least.  If the queue
+		 *  is empty, destination remains unchanged and false is returned.
+		 */
+		bool tryPopMin(std::optional<T>& destination)
+		{
+			return popInto(destination);
+		}
+
+		/**
+		 * @brief
+		 *  Inspector to determine if the queue is empty.  The result is only a snapshot
+		 *  when other threads are using the queue.
+		 */
+		bool isEmpty() const
+		{
+			for (size_t i = 0; i < mHeapCount; ++i)
+			{
+				if (0 != mHeaps[i].size.load(std::memory_order_relaxed))
+					return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  The approximate number of items in the queue.
+		 */
+		size_t size() const
+		{
+			size_t total = 0;
+
+			for (size_t i = 0; i < mHeapCount; ++i)
+				total += mHeaps[i].size.load(std::memory_order_relaxed);
+
+			return total;
+		}
+
+	private:
+		struct alignas(CacheLineSize) Heap
+		{
+			std::atomic<bool> locked;
+			std::atomic<size_t> size;
+			std::vector<T> items;
+
+			Heap()
+				: locked(false), size(0)
+			{
+			}
+
+			bool tryLock()
+			{
+				return (false == locked.load(std::memory_order_relaxed) &&
+				        false == locked.exchange(true, std::memory_order_acquire));
+			}
+
+			void lock()
+			{
+				for (uint32_t spins = 0; false == tryLock(); ++spins)
+				{
+					if (spins >= 64)
+						std::this_thread::yield();
+				}
+			}
+
+			void unlock()
+			{
+				locked.store(false, std::memory_order_release);
+			}
+		};
+
+		/**
+		 * @brief
+		 *  Scope based release of a Heap.
+		 *
+		 *  The constructor takes ownership of a Heap the current thread has already
+		 *  locked, and the destructor unlocks it, even if a comparison or a copy of an
+		 *  item throws while the lock is held.
+		 */
+		class HeapLocker
+		{
+		public:
+			HeapLocker(const HeapLocker&) = delete;
+			HeapLocker& operator=(const HeapLocker&) = delete;
+
+			HeapLocker(Heap* heap)
+				: mHeap(heap)
+			{
+			}
+
+			~HeapLocker()
+			{
+				mHeap->unlock();
+			}
+
+			Heap* heap() const
+			{
+				return mHeap;
+			}
+
+		private:
+			Heap* mHeap;
+		};
+
+		/**
+		 * @brief
+		 *  Orders the heap so the least item according to mCompare is on top.
+		 */
+		bool heapOrder(const T& left, const T& right) const
+		{
+			return mCompare(right, left);
+		}
+
+		template<typename item_t>
+		void heapPush(Heap& heap, item_t&& item)
+		{
+			heap.items.push_back(std::forward<item_t>(item));
+			std::push_heap(heap.items.begin(), heap.items.end(),
+				[this](const T& left, const T& right) { return heapOrder(left, right); });
+
+			heap.size.store(heap.items.size(), std::memory_order_relaxed);
+		}
+
+		template<typename out_t>
+		void heapPop(Heap& heap, out_t& out)
+		{
+			std::pop_heap(heap.items.begin(), heap.items.end(),
+				[this](const T& left, const T& right) { return heapOrder(left, right); });
+
+			out = std::move(heap.items.back());
+			heap.items.pop_back();
+
+			heap.size.store(heap.items.size(), std::memory_order_relaxed);
+		}
+
+		Heap& lockForPush()
+		{
+			if (1 == mHeapCount)
+			{
+				mHeaps[0].lock();
+				return mHeaps[0];
+			}
+
+			while (true)
+			{
+				Heap& heap = mHeaps[randomIndex()];
+
+				if (heap.tryLock())
+					return heap;
+			}
+		}
+
+		template<typename out_t>
+		bool popInto(out_t& out)
+		{
+			if (1 == mHeapCount)
+				return popLocked(mHeaps[0], out);
+
+			// Sample a few pairs of heaps and pop from the better top.  If every
+			// sample comes up empty or contended, fall back to a full scan so that
+			// an item is never missed because of bad luck.
+			for (int attempt = 0; attempt < 4; ++attempt)
+			{
+				Heap* first = &mHeaps[randomIndex()];
+				Heap* second = &mHeaps[randomIndex()];
+
+				if (first == second)
+					continue;
+
+				if (false == first->tryLock())
+					continue;
+
+				HeapLocker firstLock(first);
+
+				if (false == second->tryLock())
+					continue;
+
+				HeapLocker secondLock(second);
+				Heap* best = nullptr;
+
+				if (first->items.empty())
+					best = second->items.empty() ? nullptr : second;
+				else if (second->items.empty())
+					best = first;
+				else
+					best = heapOrder(first->items.front(), second->items.front()) ? second : first;
+
+				if (best)
+				{
+					heapPop(*best, out);
+					return true;
+				}
+			}
+
+			size_t start = randomIndex();
+
+			for (size_t i = 0; i < mHeapCount; ++i)
+			{
+				Heap& heap = mHeaps[(start + i) % mHeapCount];
+
+				if (0 != heap.size.load(std::memory_order_relaxed) && popLocked(heap, out))
+					return true;
+			}
+
+			return false;
+		}
+
+		template<typename out_t>
+		bool popLocked(Heap& heap, out_t& out)
+		{
+			heap.lock();
+			HeapLocker lock(&heap);
+
+			if (heap.items.empty())
+				return false;
+
+			heapPop(heap, out);
+			return true;
+		}
+
+		size_t randomIndex() const
+		{
+			// xorshift, seeded differently per thread.
+			thread_local uint32_t state = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+
+			return state % mHeapCount;
+		}
+
+		Compare mCompare;
+
+		size_t mHeapCount;
+		std::unique_ptr<Heap[]> mHeaps;
+	};
+}
+
+#endif // _CONCURRENT_PRIORITY_QUEUE_H_
\ No newline at end of file
@@ -40,4 +40,14 @@
 #	include <libkern/OSAtomic.h>
 #endif
 
+/**
+ * \def CONCURRENT_COROUTINES
+ * Defined when the compiler supports C++20 coroutines, enabling the awaitable interfaces.
+ */
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#	if __has_include(<coroutine>)
+#		define CONCURRENT_COROUTINES
+#	endif
+#endif
+
 #endif // _CONCURRENT_CONFIG_H_
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef _CONCURRENT_COROUTINE_H_
+#define _CONCURRENT_COROUTINE_H_
+
+#include "Config.h"
+
+#ifdef CONCURRENT_COROUTINES
+
+#include <coroutine>
+#include <exception>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  Return type for fire-and-forget coroutines, such as consumers that loop on
+	 *  Producer::next().
+	 *
+	 *  The coroutine starts running as soon as it is called, continues on whatever thread
+	 *  resumes it, and frees itself when it finishes.  There is nothing to wait on, so
+	 *  results and completion must be reported through other means.  An exception escaping
+	 *  the coroutine terminates the program.
+	 *
+	 * @code
+	 *  Coroutine consumeAll(Producer<int>& producer)
+	 *  {
+	 *  	while (std::optional<int> item = co_await producer.next())
+	 *  		process(*item);
+	 *  }
+	 * @endcode
+	 */
+	class Coroutine
+	{
+	public:
+		struct promise_type
+		{
+			Coroutine get_return_object()
+			{
+				return Coroutine();
+			}
+
+			std::suspend_never initial_suspend() noexcept
+			{
+				return {};
+			}
+
+			std::suspend_never final_suspend() noexcept
+			{
+				return {};
+			}
+
+			void return_void()
+			{
+			}
+
+			void unhandled_exception()
+			{
+				std::terminate();
+			}
+		};
+	};
+}
+
+#endif // CONCURRENT_COROUTINES
+
+#endif // _CONCURRENT_COROUTINE_H_
\ No newline at end of file
@@ -0,0 +1,144 @@
+#ifndef _CONCURRENT_EVENT_COUNT_H_
+#define _CONCURRENT_EVENT_COUNT_H_
+
+#include "../Config.h"
+
+#include "Futex.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace Concurrent
+{
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Lets threads park until some lock-free condition may have changed, without any cost
+	 *  to the notifying side when nobody is parked.
+	 *
+	 *  A waiter calls prepareWait(), re-checks its condition, and then either calls
+	 *  cancelWait() if the condition was satisfied or commitWait() with the key returned
+	 *  from prepareWait() to sleep.  A notifier makes the condition true and then calls
+	 *  notifyOne() or notifyAll(), which only touch the futex when a waiter has registered.
+	 *  A notification that happens between prepareWait() and commitWait() is never lost.
+	 */
+	class EventCount
+	{
+	public:
+		EventCount(const EventCount&) = delete;
+		EventCount& operator=(const EventCount&) = delete;
+
+		EventCount()
+			: mEpoch(0), mWaiters(0)
+		{
+		}
+
+		/**
+		 * @brief
+		 *  Registers the calling thread as a waiter and returns the key to pass
+		 *  to commitWait().
+		 */
+		uint32_t prepareWait()
+		{
+			mWaiters.fetch_add(1, std::memory_order_seq_cst);
+			return mEpoch.load(std::memory_order_seq_cst);
+		}
+
+		/**
+		 * @brief
+		 *  Unregisters a waiter that found its condition satisfied after prepareWait().
+		 */
+		void cancelWait()
+		{
+			mWaiters.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief
+		 *  Sleeps until a notification is issued after the prepareWait() call
+		 *  that returned key.
+		 */
+		void commitWait(uint32_t key)
+		{
+			while (mEpoch.load(std::memory_order_acquire) == key)
+				Futex::wait(&mEpoch, key);
+
+			mWaiters.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief
+		 *  Sleeps until a notification is issued after the prepareWait() call that
+		 *  returned key, or until deadline passes.  Returns false on timeout.
+		 */
+		template<typename clock_t, typename duration_t>
+		bool commitWaitUntil(uint32_t key, const std::chrono::time_point<clock_t, duration_t>& deadline)
+		{
+			using namespace std::chrono;
+
+			bool notified = true;
+
+			while (mEpoch.load(std::memory_order_acquire) == key)
+			{
+				auto remaining = ceil<milliseconds>(deadline - clock_t::now());
+
+				if (remaining.count() <= 0 || false == Futex::waitFor(&mEpoch, key, remaining))
+				{
+					notified = (mEpoch.load(std::memory_order_acquire) != key);
+					break;
+				}
+			}
+
+			mWaiters.fetch_sub(1, std::memory_order_relaxed);
+			return notified;
+		}
+
+		/**
+		 * @brief
+		 *  Wakes a single parked waiter, if any.
+		 */
+		void notifyOne()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (0 != mWaiters.load(std::memory_order_relaxed))
+			{
+				mEpoch.fetch_add(1, std::memory_order_release);
+				Futex::wakeOne(&mEpoch);
+			}
+		}
+
+		/**
+		 * @brief
+		 *  Wakes all parked waiters.
+		 */
+		void notifyAll()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (0 != mWaiters.load(std::memory_order_relaxed))
+			{
+				mEpoch.fetch_add(1, std::memory_order_release);
+				Futex::wakeAll(&mEpoch);
+			}
+		}
+
+		/**
+		 * @brief
+		 *  True if any thread is between prepareWait() and the end of its wait.
+		 */
+		bool hasWaiters() const
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			return (0 != mWaiters.load(std::memory_order_relaxed));
+		}
+
+	private:
+		std::atomic<uint32_t> mEpoch;
+		std::atomic<uint32_t> mWaiters;
+	};
+}
+
+#endif // _CONCURRENT_EVENT_COUNT_H_
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef _CONCURRENT_FUTEX_H_
+#define _CONCURRENT_FUTEX_H_
+
+#include "../Config.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace Concurrent
+{
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Wraps the wait-on-address facility of the platform (WaitOnAddress on Windows,
+	 *  futex on Linux).
+	 *
+	 *  A thread blocked in wait() sleeps in the kernel without any user-space event object,
+	 *  and is released by a wake call on the same address.  Wakeups can be spurious, so callers
+	 *  must always re-check the value they are waiting on.
+	 */
+	class CONCURRENT_EXPORT Futex
+	{
+	public:
+		/**
+		 * @brief
+		 *  Blocks while the value at address is equal to expected.
+		 */
+		static void wait(std::atomic<uint32_t>* address, uint32_t expected);
+
+		/**
+		 * @brief
+		 *  Blocks while the value at address is equal to expected for at most the
+		 *  passed amount of time.  Returns false if the time expired.
+		 */
+		static bool waitFor(std::atomic<uint32_t>* address, uint32_t expected, std::chrono::milliseconds timeout);
+
+		/**
+		 * @brief
+		 *  Wakes a single thread blocked on address.
+		 */
+		static void wakeOne(std::atomic<uint32_t>* address);
+
+		/**
+		 * @brief
+		 *  Wakes all threads blocked on address.
+		 */
+		static void wakeAll(std::atomic<uint32_t>* address);
+	};
+}
+
+#endif // _CONCURRENT_FUTEX_H_
\ No newline at end of file
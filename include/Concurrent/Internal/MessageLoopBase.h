@@ -0,0 +1,133 @@
+#ifndef _CONCURRENT_MESSAGE_LOOP_BASE_H_
+#define _CONCURRENT_MESSAGE_LOOP_BASE_H_
+
+#include "../Config.h"
+#include "../FunctionTask.h"
+
+#include "EventCount.h"
+
+#include <atomic>
+#include <memory>
+
+namespace Concurrent
+{
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Runs the consuming side of a message loop, leaving storage and delivery of messages
+	 *  to the derived class.
+	 *
+	 *  A derived class calls startLoop() from its constructor and stopLoop() from its
+	 *  destructor, and calls notifyPushed() after each push.  The loop calls handleMessages()
+	 *  from a single thread at a time.
+	 */
+	class CONCURRENT_EXPORT MessageLoopBase
+	{
+	public:
+		/**
+		 * @brief
+		 *  How the loop gets a thread to handle messages on.
+		 */
+		enum class Execution
+		{
+			/**
+			 * @brief
+			 *  A task on the default Scheduler that runs for the life of the loop, waiting
+			 *  for messages while the queue is empty.
+			 */
+			Task,
+
+			/**
+			 * @brief
+			 *  A dedicated thread for the life of the loop.
+			 */
+			Thread,
+
+			/**
+			 * @brief
+			 *  A task is scheduled on the default Scheduler when messages arrive at an idle
+			 *  loop, and returns once the queue is empty.  An idle loop does not occupy a
+			 *  worker, so this suits large numbers of mostly idle loops.
+			 *
+			 *  If a handler throws, the exception leaves the task as it would any other, and
+			 *  a new task is scheduled for the messages that are left.
+			 */
+			OnDemand
+		};
+
+		MessageLoopBase(const MessageLoopBase&) = delete;
+		MessageLoopBase& operator=(const MessageLoopBase&) = delete;
+
+		MessageLoopBase();
+		virtual ~MessageLoopBase();
+
+	protected:
+		void startLoop(Execution execution);
+
+		/**
+		 * @brief
+		 *  Handles every message already pushed, and waits for the loop to finish.
+		 */
+		void stopLoop();
+
+		/**
+		 * @brief
+		 *  Tells the loop that count messages were added to the queue.
+		 */
+		void notifyPushed(size_t count);
+
+		/**
+		 * @brief
+		 *  True if there are messages waiting to be handled.
+		 */
+		virtual bool hasMessages() const = 0;
+
+		/**
+		 * @brief
+		 *  Pops and handles messages until handled reaches maxCount or none are left.
+		 *  handled is increased as messages are popped, before their handler runs, so that
+		 *  it is still accurate if a handler throws.
+		 */
+		virtual void handleMessages(size_t maxCount, size_t& handled) = 0;
+
+	private:
+		/**
+		 * @brief
+		 *  Kept alive by scheduled drains, so they can signal completion after the
+		 *  loop itself may have been destroyed.
+		 */
+		struct DrainTracker
+		{
+			EventCount idle;
+		};
+
+		void loop();
+		void drain();
+		void scheduleDrain();
+
+		Execution mExecution;
+
+		FunctionTask mLoopTask;
+		std::atomic<bool> mContinue;
+
+		/**
+		 * @brief
+		 *  In Task and Thread modes, the loop parks here once the queue is empty.  A push
+		 *  only makes a system call to wake it when it is actually parked.  In OnDemand
+		 *  mode, a drain parks here while a counted push has yet to link into the queue.
+		 */
+		EventCount mMessageReady;
+
+		/**
+		 * @brief
+		 *  In OnDemand mode, the number of messages pushed but not yet handled.  A push
+		 *  that raises it from zero schedules a drain, and a drain only returns once it has
+		 *  brought it back to zero, so at most one drain runs at a time.
+		 */
+		std::atomic<size_t> mPending;
+		std::shared_ptr<DrainTracker> mDrainTracker;
+	};
+}
+
+#endif // _CONCURRENT_MESSAGE_LOOP_BASE_H_
@@ -1,39 +1,209 @@
 #ifndef _CONCURRENT_OBJECT_POOL_INTERNAL_H_
 #define _CONCURRENT_OBJECT_POOL_INTERNAL_H_
 
-#include "Concurrent.h"
-#include "Producer.h"
+#include "../Mutex.h"
+#include "../Concurrent.h"
+#include "../MutexLocker.h"
 
+#include "EventCount.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace Concurrent
 {
-	template<typename T>
+	template<typename T, typename reset_t>
 	class PoolObject;
 
-	template<typename T>
+	/**
+	 * @brief
+	 *  Counters describing how an ObjectPool has been used.
+	 */
+	struct ObjectPoolStats
+	{
+		/**
+		 * @brief
+		 *  Gets satisfied with an idle object.
+		 */
+		uint64_t hits = 0;
+
+		/**
+		 * @brief
+		 *  Gets that had to construct a new object.
+		 */
+		uint64_t misses = 0;
+
+		/**
+		 * @brief
+		 *  Times a get blocked because the pool was at its maximum size.
+		 */
+		uint64_t blockedWaits = 0;
+
+		/**
+		 * @brief
+		 *  Idle objects destroyed by trim() or the idle timeout.
+		 */
+		uint64_t reclaimed = 0;
+
+		/**
+		 * @brief
+		 *  Objects currently constructed, idle or in use.
+		 */
+		size_t resident = 0;
+	};
+
+	template<typename T, typename reset_t>
 	class ObjectPool;
 
 	/**
 	 * @internal
 	 *
 	 * @brief
-	 *  Internal %ObjectPool data and structures that has shared ownership
-	 *  with an %ObjectPool and dependent PoolObjects.
+	 *  Internal %ObjectPool data and structures, owned jointly by an %ObjectPool and
+	 *  its PoolObjects.
+	 *
+	 *  Objects are constructed in place in slots, which are allocated in chunks of up to
+	 *  ChunkSize and never move, so an object keeps its address for the life of the pool.
+	 *  Only pointers to slots are passed around.
+	 *
+	 *  Idle slots are kept in magazines, small stacks of up to MagazineSize slots.  Each
+	 *  thread maps to one of a set of caches by its id, and each cache holds a loaded and a
+	 *  previous magazine.  Getting and returning items works on the loaded magazine, and
+	 *  swaps it with the previous one when it runs empty or full, so a thread that gets and
+	 *  returns items in turn only touches its own cache.  Only when both magazines are
+	 *  empty or full is a magazine exchanged with the shared depot.
+	 *
+	 *  Items idle in one thread's cache are not visible to other threads' fast paths, so a
+	 *  getter that would otherwise block because the pool is at its maximum size steals
+	 *  from the depot and from every cache first.
+	 *
+	 *  Idle time is measured in epochs of mIdleEpoch, which the owning pool advances on a
+	 *  timer while an idle timeout is set.  Slots are stamped with the epoch as they are
+	 *  returned, which only costs a relaxed load of a rarely written counter.
 	 */
-	template<typename T>
+	template<typename T, typename reset_t>
 	class ObjectPoolInternal
 	{
-		friend PoolObject<T>;
-		friend ObjectPool<T>;
+		friend PoolObject<T, reset_t>;
+		friend ObjectPool<T, reset_t>;
 
 	private:
+		/**
+		 * @brief
+		 *  The most slots held in one magazine.
+		 */
+		static constexpr size_t MagazineSize = 8;
 
 		/**
 		 * @brief
-		 *  The items in the pool that are not out in circulation.
+		 *  The most slots allocated together.
 		 */
-		Producer<T> mItemPool;
+		static constexpr size_t ChunkSize = 64;
+
+		struct Slot
+		{
+			alignas(T) unsigned char storage[sizeof(T)];
+			bool constructed = false;
+			uint32_t idleEpoch = 0;
+
+			T* object()
+			{
+				return std::launder(reinterpret_cast<T*>(storage));
+			}
+		};
+
+		struct Chunk
+		{
+			std::unique_ptr<Slot[]> slots;
+			size_t size;
+			size_t used;
+		};
+
+		struct Magazine
+		{
+			size_t count = 0;
+			Slot* slots[MagazineSize];
+
+			bool isEmpty() const
+			{
+				return (0 == count);
+			}
+
+			bool isFull() const
+			{
+				return (MagazineSize == count);
+			}
+
+			Slot* pop()
+			{
+				return slots[--count];
+			}
+
+			void push(Slot* slot)
+			{
+				slots[count++] = slot;
+			}
+
+			/**
+			 * @brief
+			 *  Moves the slots idle since before epoch minAge epochs ago into out.
+			 */
+			void removeIdle(uint32_t now, uint32_t minAge, std::vector<Slot*>& out)
+			{
+				size_t kept = 0;
+
+				for (size_t i = 0; i < count; ++i)
+				{
+					if (now - slots[i]->idleEpoch >= minAge)
+						out.push_back(slots[i]);
+					else
+						slots[kept++] = slots[i];
+				}
+
+				count = kept;
+			}
+		};
+
+		struct alignas(CacheLineSize) Cache
+		{
+			std::atomic<bool> locked = false;
+
+			/**
+			 * @brief
+			 *  Only written while locked, so it needs no read-modify-write.
+			 */
+			std::atomic<uint64_t> hits = 0;
+
+			Magazine loaded;
+			Magazine previous;
+
+			bool tryLock()
+			{
+				return (false == locked.exchange(true, std::memory_order_acquire));
+			}
+
+			void lock()
+			{
+				while (false == tryLock())
+				{
+					while (locked.load(std::memory_order_relaxed))
+						spinPause();
+				}
+			}
+
+			void unlock()
+			{
+				locked.store(false, std::memory_order_release);
+			}
+		};
 
 		/**
 		 * @brief
@@ -43,7 +213,8 @@ namespace Concurrent
 
 		/**
 		 * @brief
-		 *  Function to reinitialize an item when it is returned to the pool.
+		 *  Function to reinitialize an item when it is returned to the pool, after
+		 *  reset_t.  Empty if not needed.
 		 */
 		std::function<void(T&)> mReinit;
 
@@ -57,59 +228,502 @@ namespace Concurrent
 		 * @brief
 		 *  The total number of items, including those in cirulation and those inside the pool.
 		 */
-		std::atomic<int32_t> mCirculatingItems;
+		std::atomic<size_t> mCirculatingItems;
+
+		std::unique_ptr<Cache[]> mCaches;
+		size_t mCacheCount;
+
+		/**
+		 * @brief
+		 *  Magazines holding idle slots that are not in any cache.
+		 */
+		Mutex mDepotLock;
+		std::vector<Magazine> mDepot;
 
 		/**
 		 * @brief
-		 *  Attempts to get an item out of the pool.  If the pool is empty and the limit of circulating
-		 *  items has not been reached, a new item will be constructed.  Otherwise, the function will
-		 *  block until an item is returned.
-		 *  
-		 * @param out
-		 *  Container into which the pool item will be placed.
-		 *  
-		 * @return
-		 *  True if successful, false if there is an error.
+		 *  Slot storage.  Only the last chunk has slots that have not been handed out, apart
+		 *  from slots whose objects were reclaimed, which are kept in mFreeSlots.
 		 */
-		bool getItem(std::optional<T>& out)
+		Mutex mSlotLock;
+		std::vector<Chunk> mChunks;
+		std::vector<Slot*> mFreeSlots;
+		size_t mSlotCount;
+
+		std::atomic<uint32_t> mIdleEpoch;
+
+		std::atomic<uint64_t> mSharedHits;
+		std::atomic<uint64_t> mMisses;
+		std::atomic<uint64_t> mBlockedWaits;
+		std::atomic<uint64_t> mReclaimed;
+
+		/**
+		 * @brief
+		 *  Notified whenever an item is returned, for getters blocked at the maximum size.
+		 */
+		EventCount mItemReturned;
+
+		ObjectPoolInternal(size_t maxSize)
+			: mMaxSize(maxSize), mCirculatingItems(0), mSlotCount(0), mIdleEpoch(0),
+			  mSharedHits(0), mMisses(0), mBlockedWaits(0), mReclaimed(0)
 		{
-			if (false == mItemPool.tryConsume(out))
+			mCacheCount = std::max(1u, hardwareConcurrency());
+			mCaches = std::make_unique<Cache[]>(mCacheCount);
+		}
+
+		Cache& localCache()
+		{
+			thread_local size_t hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+			return mCaches[hash % mCacheCount];
+		}
+
+		/**
+		 * @brief
+		 *  Takes a slot from a locked cache, refilling it from the depot if both of
+		 *  its magazines are empty.
+		 */
+		Slot* takeCached(Cache& cache)
+		{
+			if (cache.loaded.isEmpty())
 			{
-				if (++mCirculatingItems > mMaxSize)
+				if (cache.previous.isEmpty())
 				{
-					--mCirculatingItems;
-					return mItemPool.consume(out);
+					MutexLocker lock(&mDepotLock);
+
+					if (mDepot.empty())
+						return nullptr;
+
+					cache.loaded = mDepot.back();
+					mDepot.pop_back();
 				}
 				else
 				{
-					// mCirculatingItems has already been incremented
-					// to account for this.
-					out.emplace(mConstructor());
+					std::swap(cache.loaded, cache.previous);
+				}
+			}
+
+			return cache.loaded.pop();
+		}
+
+		/**
+		 * @brief
+		 *  Puts a slot into a locked cache, moving a full magazine to the depot if both
+		 *  of its magazines are full.
+		 */
+		void putCached(Cache& cache, Slot* slot)
+		{
+			if (cache.loaded.isFull())
+			{
+				if (cache.previous.isFull())
+				{
+					MutexLocker lock(&mDepotLock);
+
+					mDepot.push_back(cache.previous);
+					cache.previous = cache.loaded;
+					cache.loaded.count = 0;
+				}
+				else
+				{
+					std::swap(cache.loaded, cache.previous);
+				}
+			}
+
+			cache.loaded.push(slot);
+		}
+
+		/**
+		 * @brief
+		 *  Puts a slot straight into the depot, for when the calling thread's cache is
+		 *  in use by another thread.
+		 */
+		void putDepot(Slot* slot)
+		{
+			MutexLocker lock(&mDepotLock);
+
+			if (mDepot.empty() || mDepot.back().isFull())
+				mDepot.emplace_back();
+
+			mDepot.back().push(slot);
+		}
+
+		Slot* takeDepot()
+		{
+			MutexLocker lock(&mDepotLock);
+
+			if (mDepot.empty())
+				return nullptr;
+
+			Slot* slot = mDepot.back().pop();
+
+			if (mDepot.back().isEmpty())
+				mDepot.pop_back();
+
+			return slot;
+		}
+
+		/**
+		 * @brief
+		 *  Takes a slot from anywhere it is idle: the depot, and then every cache.
+		 */
+		Slot* steal()
+		{
+			Slot* slot = takeDepot();
+
+			for (size_t i = 0; i < mCacheCount && nullptr == slot; ++i)
+			{
+				Cache& cache = mCaches[i];
+				cache.lock();
+
+				if (false == cache.loaded.isEmpty())
+					slot = cache.loaded.pop();
+				else if (false == cache.previous.isEmpty())
+					slot = cache.previous.pop();
+
+				cache.unlock();
+			}
+
+			return slot;
+		}
+
+		/**
+		 * @brief
+		 *  Counts one more item in circulation if the maximum size allows it.
+		 */
+		bool reserveNew()
+		{
+			size_t current = mCirculatingItems.load(std::memory_order_relaxed);
+
+			while (current < mMaxSize)
+			{
+				if (mCirculatingItems.compare_exchange_weak(current, current + 1, std::memory_order_relaxed))
 					return true;
+			}
+
+			return false;
+		}
+
+		/**
+		 * @brief
+		 *  Constructs a new item in an unused slot, after reserveNew() has counted it.  If
+		 *  construction throws, the slot and the count are given back before rethrowing,
+		 *  so a failed construction does not shrink the pool.
+		 */
+		Slot* constructNew()
+		{
+			Slot* slot = nullptr;
+
+			try
+			{
+				{
+					MutexLocker lock(&mSlotLock);
+
+					if (false == mFreeSlots.empty())
+					{
+						slot = mFreeSlots.back();
+						mFreeSlots.pop_back();
+					}
+					else if (mChunks.empty() || mChunks.back().used == mChunks.back().size)
+					{
+						Chunk chunk;
+						chunk.size = std::min(ChunkSize, mMaxSize - mSlotCount);
+						chunk.used = 0;
+						chunk.slots.reset(new Slot[chunk.size]);
+
+						mChunks.emplace_back(std::move(chunk));
+						mSlotCount += mChunks.back().size;
+
+						// Every slot fits in mFreeSlots without growing it, so giving one
+						// back never allocates.
+						mFreeSlots.reserve(mSlotCount);
+					}
+
+					if (nullptr == slot)
+					{
+						Chunk& chunk = mChunks.back();
+						slot = &chunk.slots[chunk.used++];
+					}
 				}
+
+				new (slot->storage) T(mConstructor());
+			}
+			catch (...)
+			{
+				if (slot)
+				{
+					MutexLocker lock(&mSlotLock);
+					mFreeSlots.push_back(slot);
+				}
+
+				mCirculatingItems.fetch_sub(1, std::memory_order_relaxed);
+
+				// Getters blocked at the maximum size can now construct.
+				mItemReturned.notifyAll();
+
+				throw;
 			}
 
-			return true;
+			slot->constructed = true;
+
+			return slot;
 		}
 
 		/**
 		 * @brief
-		 *  Retinitializes <i>in</i> and moves it back into the pool.
+		 *  Gets a slot holding an item from the pool.  If the pool is empty and the limit of
+		 *  circulating items has not been reached, a new item will be constructed.  Otherwise,
+		 *  the function will block until an item is returned.
 		 */
-		void returnItem(T&& in)
+		Slot* getItem()
 		{
-			if (mCirculatingItems < mMaxSize)
+			Cache& cache = localCache();
+			Slot* slot = nullptr;
+
+			if (cache.tryLock())
 			{
-				mReinit(in);
-				mItemPool.push(std::move(in));
+				slot = takeCached(cache);
+
+				if (slot)
+					cache.hits.store(cache.hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+				cache.unlock();
+			}
+			else if (nullptr != (slot = takeDepot()))
+			{
+				mSharedHits.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			if (slot)
+				return slot;
+
+			while (true)
+			{
+				if (reserveNew())
+				{
+					mMisses.fetch_add(1, std::memory_order_relaxed);
+					return constructNew();
+				}
+
+				uint32_t key = mItemReturned.prepareWait();
+
+				if (nullptr != (slot = steal()))
+				{
+					mItemReturned.cancelWait();
+					mSharedHits.fetch_add(1, std::memory_order_relaxed);
+
+					return slot;
+				}
+
+				if (reserveNew())
+				{
+					mItemReturned.cancelWait();
+					mMisses.fetch_add(1, std::memory_order_relaxed);
+
+					return constructNew();
+				}
+
+				mBlockedWaits.fetch_add(1, std::memory_order_relaxed);
+				mItemReturned.commitWait(key);
+			}
+		}
+
+		/**
+		 * @brief
+		 *  Resets the item in slot and puts the slot back into the pool.
+		 */
+		void returnItem(Slot* slot)
+		{
+			T& item = *slot->object();
+
+			reset_t()(item);
+
+			if (mReinit)
+				mReinit(item);
+
+			slot->idleEpoch = mIdleEpoch.load(std::memory_order_relaxed);
+
+			Cache& cache = localCache();
+
+			if (cache.tryLock())
+			{
+				putCached(cache, slot);
+				cache.unlock();
 			}
 			else
 			{
-				--mCirculatingItems;
+				putDepot(slot);
+			}
+
+			mItemReturned.notifyOne();
+		}
+
+		/**
+		 * @brief
+		 *  Constructs up to count new objects, as long as the maximum size allows, and
+		 *  puts them in the depot.  Returns the number constructed.
+		 */
+		size_t prewarm(size_t count)
+		{
+			Magazine magazine;
+			size_t constructed = 0;
+
+			auto flush = [&]()
+			{
+				if (false == magazine.isEmpty())
+				{
+					MutexLocker lock(&mDepotLock);
+					mDepot.push_back(magazine);
+
+					magazine.count = 0;
+				}
+			};
+
+			try
+			{
+				while (constructed < count && reserveNew())
+				{
+					Slot* slot = constructNew();
+					slot->idleEpoch = mIdleEpoch.load(std::memory_order_relaxed);
+
+					magazine.push(slot);
+					++constructed;
+
+					if (magazine.isFull())
+						flush();
+				}
+			}
+			catch (...)
+			{
+				// Keep the objects constructed before the failure.
+				flush();
+				mItemReturned.notifyAll();
+
+				throw;
+			}
+
+			flush();
+
+			if (0 != constructed)
+				mItemReturned.notifyAll();
+
+			return constructed;
+		}
+
+		/**
+		 * @brief
+		 *  Destroys the idle objects that were returned at least minAge epochs ago, or all
+		 *  idle objects if minAge is zero.  Returns the number destroyed.
+		 */
+		size_t reclaimIdle(uint32_t minAge)
+		{
+			std::vector<Slot*> expired;
+			uint32_t now = mIdleEpoch.load(std::memory_order_relaxed);
+
+			{
+				MutexLocker lock(&mDepotLock);
+
+				for (Magazine& magazine : mDepot)
+					magazine.removeIdle(now, minAge, expired);
+
+				mDepot.erase(std::remove_if(mDepot.begin(), mDepot.end(),
+					[](const Magazine& magazine) { return magazine.isEmpty(); }), mDepot.end());
+			}
+
+			for (size_t i = 0; i < mCacheCount; ++i)
+			{
+				Cache& cache = mCaches[i];
+				cache.lock();
+
+				cache.loaded.removeIdle(now, minAge, expired);
+				cache.previous.removeIdle(now, minAge, expired);
+
+				cache.unlock();
+			}
+
+			if (expired.empty())
+				return 0;
+
+			for (Slot* slot : expired)
+			{
+				slot->object()->~T();
+				slot->constructed = false;
+			}
+
+			{
+				MutexLocker lock(&mSlotLock);
+				mFreeSlots.insert(mFreeSlots.end(), expired.begin(), expired.end());
+			}
+
+			mCirculatingItems.fetch_sub(expired.size(), std::memory_order_relaxed);
+			mReclaimed.fetch_add(expired.size(), std::memory_order_relaxed);
+
+			// Getters blocked at the maximum size can now construct.
+			mItemReturned.notifyAll();
+
+			return expired.size();
+		}
+
+		ObjectPoolStats stats() const
+		{
+			ObjectPoolStats result;
+
+			result.hits = mSharedHits.load(std::memory_order_relaxed);
+
+			for (size_t i = 0; i < mCacheCount; ++i)
+				result.hits += mCaches[i].hits.load(std::memory_order_relaxed);
+
+			result.misses = mMisses.load(std::memory_order_relaxed);
+			result.blockedWaits = mBlockedWaits.load(std::memory_order_relaxed);
+			result.reclaimed = mReclaimed.load(std::memory_order_relaxed);
+			result.resident = mCirculatingItems.load(std::memory_order_relaxed);
+
+			return result;
+		}
+
+		/**
+		 * @brief
+		 *  The number of constructed objects sitting idle in the depot and caches.
+		 */
+		size_t idleCount()
+		{
+			size_t count = 0;
+
+			{
+				MutexLocker lock(&mDepotLock);
+
+				for (const Magazine& magazine : mDepot)
+					count += magazine.count;
+			}
+
+			for (size_t i = 0; i < mCacheCount; ++i)
+			{
+				Cache& cache = mCaches[i];
+				cache.lock();
+
+				count += cache.loaded.count + cache.previous.count;
+
+				cache.unlock();
+			}
+
+			return count;
+		}
+
+	public:
+		~ObjectPoolInternal()
+		{
+			// Every PoolObject holds a reference, so by now every object is idle.
+			assert(idleCount() == mCirculatingItems.load(std::memory_order_relaxed));
+
+			for (Chunk& chunk : mChunks)
+			{
+				for (size_t i = 0; i < chunk.used; ++i)
+				{
+					if (chunk.slots[i].constructed)
+						chunk.slots[i].object()->~T();
+				}
 			}
 		}
 	};
 }
 
 
-#endif // _CONCURRENT_OBJECT_POOL_INTERNAL_H_
\ No newline at end of file
+#endif // _CONCURRENT_OBJECT_POOL_INTERNAL_H_
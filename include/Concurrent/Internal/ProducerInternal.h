@@ -3,95 +3,403 @@
 
 #include "../Config.h"
 #include "../Queue.h"
+#include "../Mutex.h"
 #include "../RWLock.h"
-#include "../Condition.h"
+#include "../Scheduler.h"
+#include "../Concurrent.h"
+#include "../QueueStats.h"
 #include "../ReadLocker.h"
+#include "../MutexLocker.h"
 #include "../WriteLocker.h"
 
+#include "EventCount.h"
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+#ifdef CONCURRENT_COROUTINES
+#	include <coroutine>
+#endif
 
 namespace Concurrent
 {
 	/**
 	 * @internal
+	 *
+	 * @brief
+	 *  The part of a Producer's shared state that does not depend on the item type, so
+	 *  that a Select can wait on producers of different types.
+	 *
+	 *  Listeners are the EventCounts of Select objects watching this producer.  They are
+	 *  notified after every push and on end(), but the listener lock is only taken when at
+	 *  least one listener is attached.
 	 */
-	template<typename T>
-	struct ProducerInternal
+	class ProducerInternalBase
 	{
-		struct WaitRecord
+	public:
+		ProducerInternalBase()
+			: endCalled(false), mListenerCount(0)
 		{
-			bool success;
-			Condition* wakeUp;
-			std::optional<T> out;
-		};
+		}
+
+		virtual ~ProducerInternalBase()
+		{
+		}
 
 		std::atomic<bool> endCalled;
-		RWLock rwLock;
 
-		Queue<T> messages;
-		Queue<WaitRecord*> waiting;
+		/**
+		 * @brief
+		 *  True if there is at least one item waiting to be consumed.
+		 */
+		virtual bool hasMessages() const = 0;
 
-		void pushMessage(const T &item)
+		void addListener(EventCount* listener)
 		{
-			WriteLocker lock(&rwLock);
-			messages.push(item);
+			WriteLocker lock(&mListenerLock);
+
+			mListeners.push_back(listener);
+			mListenerCount.fetch_add(1, std::memory_order_seq_cst);
+		}
 
-			WaitRecord* record;
-			if (false == messages.isEmpty() && waiting.tryPop(record))
+		void removeListener(EventCount* listener)
+		{
+			WriteLocker lock(&mListenerLock);
+
+			auto found = std::find(mListeners.begin(), mListeners.end(), listener);
+
+			if (found != mListeners.end())
 			{
-				messages.tryPop(record->out);
-				record->success = true;
-				record->wakeUp->trigger();
+				mListeners.erase(found);
+				mListenerCount.fetch_sub(1, std::memory_order_seq_cst);
 			}
 		}
 
-		void pushMessage(T&& item)
+	protected:
+		/**
+		 * @brief
+		 *  Wakes attached listeners.  Must follow a full fence, which notifying an
+		 *  EventCount provides.
+		 */
+		void notifyListeners()
+		{
+			if (0 == mListenerCount.load(std::memory_order_relaxed))
+				return;
+
+			ReadLocker lock(&mListenerLock);
+
+			for (EventCount* listener : mListeners)
+				listener->notifyOne();
+		}
+
+	private:
+		std::atomic<uint32_t> mListenerCount;
+
+		RWLock mListenerLock;
+		std::vector<EventCount*> mListeners;
+	};
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Shared state of a Producer.
+	 *
+	 *  Pushing is a lock-free enqueue followed by a notification that only reaches
+	 *  the kernel if a consumer is parked.  A blocking consumer first spins briefly on the
+	 *  queue, and then parks on messageReady until a push or end() wakes it.
+	 *
+	 *  When highWatermark is non-zero the producer is bounded.  Each push reserves a
+	 *  place in count before enqueueing.  Once a push finds count at the high watermark,
+	 *  throttled is set and pushes park on spaceAvailable until consumers have drained
+	 *  count to the low watermark.
+	 *
+	 *  Coroutine consumers that find the queue empty register an AsyncWaiter instead of
+	 *  parking.  Pushes hand items directly to registered waiters and resume them on their
+	 *  scheduler.  As with listeners, the lock guarding the waiters is only taken while at
+	 *  least one is registered.
+	 *
+	 *  If withStats is true, items are held in queue_t instantiated for Stamped<T>, so they
+	 *  can carry their push time once stats are enabled.  Otherwise they are held in
+	 *  queue_t as is.
+	 */
+	template<typename T, typename queue_t = Queue<T>, bool withStats = false>
+	struct ProducerInternal : public ProducerInternalBase
+	{
+		/**
+		 * @brief
+		 *  Number of times a blocking consumer polls the queue before parking.
+		 */
+		static constexpr int SpinCount = 64;
+
+		typedef std::chrono::steady_clock::time_point time_point_t;
+
+		typename InstrumentedQueue<queue_t, T, withStats>::type messages;
+		EventCount messageReady;
+
+		std::atomic<QueueStats*> stats = nullptr;
+
+		size_t highWatermark = 0;
+		size_t lowWatermark = 0;
+
+		std::atomic<size_t> count = 0;
+		std::atomic<bool> throttled = false;
+		EventCount spaceAvailable;
+
+		ProducerInternal()
 		{
-			WriteLocker lock(&rwLock);
-			messages.push(std::move(item));
+		}
+
+		/**
+		 * @brief
+		 *  Creates the internals with a queue that allocates from resource.
+		 */
+		explicit ProducerInternal(std::pmr::memory_resource* resource)
+			: messages(resource)
+		{
+		}
 
-			WaitRecord* record;
-			if (false == messages.isEmpty() && waiting.tryPop(record))
+		virtual ~ProducerInternal()
+		{
+			delete stats.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes item if end() has not been called, blocking while the producer is
+		 *  throttled.  If deadline is not null, it gives up once the deadline passes.
+		 *  If trying is true, it gives up rather than block.
+		 */
+		template<typename item_t>
+		bool pushMessage(item_t&& item, const time_point_t* deadline = nullptr, bool trying = false)
+		{
+			if (endCalled.load(std::memory_order_acquire))
+				return false;
+
+			if (0 != highWatermark && false == reserve(deadline, trying))
+				return false;
+
+			if constexpr (withStats)
 			{
-				messages.tryPop(record->out);
-				record->success = true;
-				record->wakeUp->trigger();
+				QueueStats* currentStats = stats.load(std::memory_order_acquire);
+				int64_t stamp = 0;
+
+				if (currentStats)
+				{
+					currentStats->onPush(1);
+					stamp = QueueStats::now();
+				}
+
+				messages.emplace(std::forward<item_t>(item), stamp);
 			}
+			else
+			{
+				messages.push(std::forward<item_t>(item));
+			}
+
+			messageReady.notifyOne();
+			notifyListeners();
+			dispatchAsync();
+
+			return true;
 		}
 
-		bool getMessage(std::optional<T>& out, bool trying = false)
+		/**
+		 * @brief
+		 *  Claims a place for one more item in a bounded producer.
+		 */
+		bool reserve(const time_point_t* deadline, bool trying)
 		{
-			Condition ready;
-			WaitRecord record;
+			while (true)
 			{
-				ReadLocker lock(&rwLock);
+				if (endCalled.load(std::memory_order_acquire))
+					return false;
 
-				if (messages.tryPop(out))
-					return true;
-				else if (trying || endCalled)
+				if (false == throttled.load(std::memory_order_seq_cst))
+				{
+					size_t current = count.load(std::memory_order_relaxed);
+
+					while (current < highWatermark)
+					{
+						if (count.compare_exchange_weak(current, current + 1, std::memory_order_seq_cst))
+							return true;
+					}
+
+					throttled.store(true, std::memory_order_seq_cst);
+				}
+
+				// A consumer that drained below the low watermark before throttled
+				// was set will not have released anyone, so check for that before
+				// giving up, and again once registered as a waiter.
+				if (count.load(std::memory_order_seq_cst) <= lowWatermark)
+				{
+					release();
+					continue;
+				}
+
+				if (trying)
 					return false;
 
-				record.wakeUp = &ready;
+				uint32_t key = spaceAvailable.prepareWait();
+
+				if (count.load(std::memory_order_seq_cst) <= lowWatermark)
+				{
+					spaceAvailable.cancelWait();
+					release();
+					continue;
+				}
 
-				waiting.push(&record);
+				if (false == throttled.load(std::memory_order_seq_cst) || endCalled.load(std::memory_order_acquire))
+				{
+					spaceAvailable.cancelWait();
+					continue;
+				}
+
+				if (nullptr == deadline)
+					spaceAvailable.commitWait(key);
+				else if (false == spaceAvailable.commitWaitUntil(key, *deadline))
+					trying = true;
 			}
+		}
+
+		/**
+		 * @brief
+		 *  Clears the throttled state and wakes any blocked producers.
+		 */
+		void release()
+		{
+			if (throttled.exchange(false, std::memory_order_seq_cst))
+				spaceAvailable.notifyAll();
+		}
+
+		/**
+		 * @brief
+		 *  Pops an item, updating the count of a bounded producer.
+		 */
+		template<typename out_t>
+		bool popMessage(out_t& out)
+		{
+			if constexpr (withStats)
+			{
+				std::optional< Stamped<T> > stamped;
+
+				if (false == messages.tryPop(stamped))
+					return false;
 
-			ready.wait();
+				QueueStats* currentStats = stats.load(std::memory_order_acquire);
 
-			if (record.success)
+				if (currentStats)
+					currentStats->onPop(stamped->stamp, QueueStats::now());
+
+				out = std::move(stamped->item);
+			}
+			else if (false == messages.tryPop(out))
 			{
-				out = std::move(record.out);
+				return false;
+			}
+
+			onRemoved(1);
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  Pops up to maxCount items into destination, updating the count of a bounded
+		 *  producer once for the whole batch.
+		 */
+		template<typename output_iterator_t>
+		size_t popMessages(output_iterator_t destination, size_t maxCount)
+		{
+			size_t popped;
+
+			if constexpr (withStats)
+				popped = messages.tryPopBulk(UnstampingIterator<T, output_iterator_t>(destination, stats.load(std::memory_order_acquire)), maxCount);
+			else
+				popped = messages.tryPopBulk(destination, maxCount);
+
+			if (popped > 0)
+				onRemoved(popped);
+
+			return popped;
+		}
+
+		void onRemoved(size_t amount)
+		{
+			if (0 != highWatermark)
+			{
+				size_t remaining = count.fetch_sub(amount, std::memory_order_seq_cst) - amount;
+
+				if (remaining <= lowWatermark && throttled.load(std::memory_order_seq_cst))
+					release();
+			}
+		}
+
+		/**
+		 * @brief
+		 *  Pops an item into out.  Unless trying is true, blocks until an item is available,
+		 *  end() is called, or deadline passes if it is not null.
+		 */
+		bool getMessage(std::optional<T>& out, bool trying = false, const time_point_t* deadline = nullptr)
+		{
+			if (popMessage(out))
 				return true;
+			else if (trying)
+				return false;
+
+			for (int i = 0; i < SpinCount && false == endCalled.load(std::memory_order_acquire); ++i)
+			{
+				spinPause();
+
+				if (popMessage(out))
+					return true;
 			}
 
-			return false;
+			while (true)
+			{
+				// end() sets endCalled before notifying, so once it is seen every
+				// item pushed before end() is already in the queue.
+				if (endCalled.load(std::memory_order_acquire))
+					return popMessage(out);
+
+				uint32_t key = messageReady.prepareWait();
+
+				if (popMessage(out))
+				{
+					messageReady.cancelWait();
+					return true;
+				}
+
+				if (endCalled.load(std::memory_order_acquire))
+				{
+					messageReady.cancelWait();
+					return popMessage(out);
+				}
+
+				if (nullptr == deadline)
+				{
+					messageReady.commitWait(key);
+				}
+				else if (false == messageReady.commitWaitUntil(key, *deadline))
+				{
+					return popMessage(out);
+				}
+
+				if (popMessage(out))
+					return true;
+			}
 		}
 
-		bool getMessage(T &out, bool trying = false)
+		bool getMessage(T &out, bool trying = false, const time_point_t* deadline = nullptr)
 		{
 			std::optional<T> opt;
 
-			if (getMessage(opt, trying))
+			if (getMessage(opt, trying, deadline))
 			{
 				out = std::move(*opt);
 				return true;
@@ -102,16 +410,117 @@ namespace Concurrent
 
 		void end()
 		{
-			WriteLocker lock(&rwLock);
-			endCalled.store(true);
+			endCalled.store(true, std::memory_order_release);
+
+			messageReady.notifyAll();
+			spaceAvailable.notifyAll();
+			notifyListeners();
+			dispatchAsync();
+		}
+
+		virtual bool hasMessages() const override
+		{
+			return (false == messages.isEmpty());
+		}
+
+#ifdef CONCURRENT_COROUTINES
+		/**
+		 * @brief
+		 *  A suspended coroutine consumer.  result is left empty if end() was called and
+		 *  the queue has been drained.
+		 */
+		struct AsyncWaiter
+		{
+			std::coroutine_handle<> handle;
+			std::optional<T> result;
+			Scheduler* scheduler = nullptr;
+		};
+
+		Mutex asyncLock;
+		std::deque<AsyncWaiter*> asyncWaiters;
+		std::atomic<size_t> asyncWaiterCount = 0;
+
+		/**
+		 * @brief
+		 *  Tries to complete waiter without suspending, returning true if it has an item
+		 *  or end() has been called.
+		 */
+		bool readyAsync(AsyncWaiter& waiter)
+		{
+			if (popMessage(waiter.result))
+				return true;
 
-			WaitRecord* record;
-			while (waiting.tryPop(record))
+			if (endCalled.load(std::memory_order_acquire))
 			{
-				record->success = messages.tryPop(*record->out);
-				record->wakeUp->trigger();
+				popMessage(waiter.result);
+				return true;
 			}
+
+			return false;
+		}
+
+		/**
+		 * @brief
+		 *  Registers waiter to be resumed when an item arrives.  Returns false, without
+		 *  registering, if it was completed in the meantime and should not suspend.
+		 */
+		bool suspendAsync(AsyncWaiter* waiter)
+		{
+			MutexLocker lock(&asyncLock);
+
+			asyncWaiters.push_back(waiter);
+			asyncWaiterCount.fetch_add(1, std::memory_order_seq_cst);
+
+			// Pairs with the fence in the push path, so either the push sees this
+			// waiter or this check sees the pushed item.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (readyAsync(*waiter))
+			{
+				asyncWaiters.pop_back();
+				asyncWaiterCount.fetch_sub(1, std::memory_order_relaxed);
+
+				return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  Hands queued items to registered waiters in order, and resumes them.  After
+		 *  end() every remaining waiter is resumed.  Must follow a full fence, which
+		 *  notifying an EventCount provides.
+		 */
+		void dispatchAsync()
+		{
+			if (0 == asyncWaiterCount.load(std::memory_order_relaxed))
+				return;
+
+			MutexLocker lock(&asyncLock);
+
+			while (false == asyncWaiters.empty() && readyAsync(*asyncWaiters.front()))
+			{
+				AsyncWaiter* waiter = asyncWaiters.front();
+				asyncWaiters.pop_front();
+				asyncWaiterCount.fetch_sub(1, std::memory_order_relaxed);
+
+				// The waiter lives in the coroutine frame, so it must not be touched
+				// once the coroutine has been handed off for resumption.
+				std::coroutine_handle<> handle = waiter->handle;
+				Scheduler* scheduler = waiter->scheduler;
+
+				if (scheduler)
+					scheduler->addTask([handle]() { handle.resume(); });
+				else
+					Scheduler::runAsync([handle]() { handle.resume(); });
+			}
+		}
+#else
+		void dispatchAsync()
+		{
 		}
+#endif
 	};
 }
 
@@ -8,6 +8,7 @@
 #include <StdExt/Exceptions.h>
 
 #include <concurrent_queue.h>
+#include <memory_resource>
 #include <optional>
 
 namespace Concurrent
@@ -70,6 +71,12 @@ namespace Concurrent
 				setItemMove<std::is_move_constructible_v<T>>(std::move(item));
 			}
 
+			template<typename ...args_t>
+			Container(std::in_place_t, args_t&& ...args)
+			{
+				mItem.emplace(std::forward<args_t>(args)...);
+			}
+
 			Container& operator=(const Container& other)
 			{
 				throw StdExt::invalid_operation("Container should not be copied.");
@@ -88,9 +95,14 @@ namespace Concurrent
 			}
 		};
 		
-		concurrency::concurrent_queue<Container> mQueue;
+		concurrency::concurrent_queue< Container, std::pmr::polymorphic_allocator<Container> > mQueue;
 
 	public:
+		QueuePlatform(std::pmr::memory_resource* resource)
+			: mQueue(std::pmr::polymorphic_allocator<Container>(resource))
+		{
+		}
+
 		void push(const T& inItem)
 		{
 			mQueue.push(Container(inItem));
@@ -101,6 +113,12 @@ namespace Concurrent
 			mQueue.push(Container(std::move(inItem)));
 		}
 
+		template<typename ...args_t>
+		void emplace(args_t&& ...args)
+		{
+			mQueue.push(Container(std::in_place, std::forward<args_t>(args)...));
+		}
+
 		bool try_pop(T& outItem)
 		{
 			Container tempContainer;
@@ -1,131 +1,357 @@
 #ifndef _CONCURRENT_MESSAGE_LOOP_H_
 #define _CONCURRENT_MESSAGE_LOOP_H_
 
-#include "Queue.h"
-#include "Mutex.h"
-#include "Scheduler.h"
-#include "Condition.h"
-#include "MutexLocker.h"
-#include "FunctionTask.h"
+#include "MpscQueue.h"
+#include "QueueStats.h"
 
+#include "Internal/MessageLoopBase.h"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <thread>
 #include <vector>
+#include <iterator>
+#include <optional>
+#include <memory_resource>
 #include <functional>
+#include <type_traits>
 #include <initializer_list>
 
 namespace Concurrent
 {
-	template<typename msg_t>
-	class MessageLoop
+	/**
+	 * @brief
+	 *  Runs a handler for each message pushed, one at a time and in the order pushed.
+	 *
+	 *  If withStats is true, the loop can record queue stats with enableStats().  The flag
+	 *  is a template parameter so that loops without it queue messages exactly as pushed,
+	 *  with no per-message overhead.
+	 */
+	template<typename msg_t, bool withStats = false>
+	class MessageLoop : public MessageLoopBase
 	{
 	private:
 		std::function<void(const msg_t&)> mHandler;
-		FunctionTask mLoopTask;
-		Condition mHandleMessages;
+		std::function<void(std::vector<msg_t>&)> mBatchHandler;
+		size_t mBatchSize;
 
-		std::atomic<bool> mContinue;
+		typename InstrumentedQueue<MpscQueue<msg_t>, msg_t, withStats>::type mQueue;
 
-		Queue<msg_t> mQueue;
+		/**
+		 * @brief
+		 *  Reused between batches to keep its capacity.  It is emptied before each batch is
+		 *  popped as well as after, so a handler that throws does not leave messages in it
+		 *  to be handled again.
+		 */
+		std::vector<msg_t> mBatch;
 
-		void loop()
+		std::atomic<QueueStats*> mStats;
+
+		/**
+		 * @brief
+		 *  Returns the timestamp for items about to be pushed, and counts them if stats
+		 *  are enabled.
+		 */
+		int64_t stampPush(size_t count)
+		{
+			QueueStats* stats = mStats.load(std::memory_order_acquire);
+
+			if (nullptr == stats)
+				return 0;
+
+			stats->onPush(count);
+			return QueueStats::now();
+		}
+
+		template<typename iterator_t>
+		void pushRange(iterator_t first, iterator_t last, size_t count)
+		{
+			if constexpr (withStats)
+			{
+				int64_t stamp = stampPush(count);
+
+				mQueue.pushBulk(StampingIterator<msg_t, iterator_t>(first, stamp),
+				                StampingIterator<msg_t, iterator_t>(last, stamp));
+			}
+			else
+			{
+				mQueue.pushBulk(first, last);
+			}
+
+			notifyPushed(count);
+		}
+
+		void handleDirect(size_t maxCount, size_t& handled)
+		{
+			if (mBatchHandler)
+			{
+				while (handled < maxCount)
+				{
+					mBatch.clear();
+
+					size_t count = mQueue.tryPopBulk(std::back_inserter(mBatch), std::min(mBatchSize, maxCount - handled));
+
+					if (0 == count)
+						break;
+
+					handled += count;
+
+					mBatchHandler(mBatch);
+					mBatch.clear();
+				}
+			}
+			else
+			{
+				// Popped into a local, so that the message is destroyed as soon as it has
+				// been handled rather than held until the next one replaces it.
+				while (handled < maxCount)
+				{
+					std::optional<msg_t> message;
+
+					if (false == mQueue.tryPop(message))
+						break;
+
+					++handled;
+					mHandler(*message);
+				}
+			}
+		}
+
+		/**
+		 * @brief
+		 *  handleMessages() for loops with withStats set, which also records latency and
+		 *  handler time once stats are enabled.
+		 */
+		void handleInstrumented(size_t maxCount, size_t& handled)
 		{
-			while(!mQueue.isEmpty() || mContinue)
+			QueueStats* stats = mStats.load(std::memory_order_acquire);
+
+			if (mBatchHandler)
 			{
-				mHandleMessages.wait();
-				mHandleMessages.reset();
+				typedef std::back_insert_iterator< std::vector<msg_t> > inserter_t;
+
+				while (handled < maxCount)
+				{
+					mBatch.clear();
+
+					size_t count = mQueue.tryPopBulk(UnstampingIterator<msg_t, inserter_t>(std::back_inserter(mBatch), stats),
+					                                 std::min(mBatchSize, maxCount - handled));
+
+					if (0 == count)
+						break;
+
+					handled += count;
+
+					if (stats)
+					{
+						int64_t start = QueueStats::now();
+						mBatchHandler(mBatch);
+						stats->onHandled(QueueStats::now() - start);
+					}
+					else
+					{
+						mBatchHandler(mBatch);
+					}
+
+					mBatch.clear();
+				}
+			}
+			else
+			{
+				while (handled < maxCount)
+				{
+					std::optional< Stamped<msg_t> > message;
+
+					if (false == mQueue.tryPop(message))
+						break;
+
+					++handled;
 
-				msg_t currentMessage;
-				while (mQueue.tryPop(currentMessage))
-					mHandler(currentMessage);
+					if (stats)
+					{
+						int64_t start = QueueStats::now();
+						stats->onPop(message->stamp, start);
+
+						mHandler(message->item);
+						stats->onHandled(QueueStats::now() - start);
+					}
+					else
+					{
+						mHandler(message->item);
+					}
+				}
 			}
 		}
 
-		void startTask(bool runAsThread)
+	protected:
+		virtual bool hasMessages() const override
 		{
-			mLoopTask.setFunction(std::bind(&MessageLoop::loop, this));
+			return !mQueue.isEmpty();
+		}
 
-			if (runAsThread)
-				Scheduler::runAsThread(&mLoopTask);
+		virtual void handleMessages(size_t maxCount, size_t& handled) override
+		{
+			if constexpr (withStats)
+				handleInstrumented(maxCount, handled);
 			else
-				Scheduler::runAsync(&mLoopTask);
+				handleDirect(maxCount, handled);
 		}
 
 	public:
 		MessageLoop(const std::function<void(const msg_t&)>& msgHandler, bool runAsThread = false)
-			: mHandler(msgHandler), mContinue(true)
+			: MessageLoop(msgHandler, runAsThread ? Execution::Thread : Execution::Task)
 		{
-			startTask(runAsThread);
 		}
 
 		MessageLoop(std::function<void(const msg_t&)>&& msgHandler, bool runAsThread = false)
-			: mHandler(std::move(msgHandler)), mContinue(true)
+			: MessageLoop(std::move(msgHandler), runAsThread ? Execution::Thread : Execution::Task)
+		{
+		}
+
+		/**
+		 * @brief
+		 *  Creates a loop whose queue allocates its nodes from resource, which must
+		 *  outlive the loop.  A SlabResource sized with nodeSize() and nodeAlign() keeps
+		 *  pushes off the global heap.
+		 */
+		MessageLoop(const std::function<void(const msg_t&)>& msgHandler, Execution execution,
+		            std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: mHandler(msgHandler), mBatchSize(1), mQueue(resource), mStats(nullptr)
 		{
-			startTask(runAsThread);
+			startLoop(execution);
+		}
+
+		MessageLoop(std::function<void(const msg_t&)>&& msgHandler, Execution execution,
+		            std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: mHandler(std::move(msgHandler)), mBatchSize(1), mQueue(resource), mStats(nullptr)
+		{
+			startLoop(execution);
+		}
+
+		/**
+		 * @brief
+		 *  Creates a loop that passes messages to batchHandler in groups of up to batchSize,
+		 *  popped from the queue in one pass.  The vector is reused between calls and
+		 *  cleared after each one, so the handler may move messages out of it.
+		 */
+		MessageLoop(std::function<void(std::vector<msg_t>&)>&& batchHandler, size_t batchSize, bool runAsThread = false)
+			: MessageLoop(std::move(batchHandler), batchSize, runAsThread ? Execution::Thread : Execution::Task)
+		{
+		}
+
+		MessageLoop(std::function<void(std::vector<msg_t>&)>&& batchHandler, size_t batchSize, Execution execution,
+		            std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: mBatchHandler(std::move(batchHandler)), mBatchSize(std::max<size_t>(batchSize, 1)),
+			  mQueue(resource), mStats(nullptr)
+		{
+			mBatch.reserve(mBatchSize);
+			startLoop(execution);
 		}
 
 		~MessageLoop()
 		{
-			mContinue.store(false);
-			mHandleMessages.trigger();
+			stopLoop();
+			delete mStats.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief
+		 *  The size of the blocks the loop's queue allocates from its resource.
+		 */
+		static constexpr size_t nodeSize()
+		{
+			return decltype(mQueue)::nodeSize();
+		}
+
+		/**
+		 * @brief
+		 *  The alignment of the blocks the loop's queue allocates from its resource.
+		 */
+		static constexpr size_t nodeAlign()
+		{
+			return decltype(mQueue)::nodeAlign();
+		}
+
+		/**
+		 * @brief
+		 *  Starts recording queue depth, the time messages wait in the queue and the
+		 *  time the handler takes.  Messages pushed before this are not counted.  Only
+		 *  available when withStats is true.
+		 */
+		void enableStats()
+		{
+			static_assert(withStats, "enableStats() requires a MessageLoop with withStats set.");
 
-			mLoopTask.wait();
+			if (mStats.load(std::memory_order_acquire))
+				return;
+
+			QueueStats* stats = new QueueStats();
+			QueueStats* expected = nullptr;
+
+			if (false == mStats.compare_exchange_strong(expected, stats, std::memory_order_acq_rel))
+				delete stats;
+		}
+
+		/**
+		 * @brief
+		 *  A snapshot of the stats recorded since enableStats(), or all zeros if it was
+		 *  never called.
+		 */
+		QueueStats::Snapshot stats() const
+		{
+			static_assert(withStats, "stats() requires a MessageLoop with withStats set.");
+
+			QueueStats* stats = mStats.load(std::memory_order_acquire);
+			return stats ? stats->snapshot() : QueueStats::Snapshot();
 		}
 
 		void push(const msg_t& msg)
 		{
-			mQueue.push(msg);
-			mHandleMessages.trigger();
+			if constexpr (withStats)
+				mQueue.emplace(msg, stampPush(1));
+			else
+				mQueue.push(msg);
+
+			notifyPushed(1);
 		}
 
 		void push(msg_t&& msg)
 		{
-			mQueue.push(std::move(msg));
-			mHandleMessages.trigger();
+			if constexpr (withStats)
+				mQueue.emplace(std::move(msg), stampPush(1));
+			else
+				mQueue.push(std::move(msg));
+
+			notifyPushed(1);
 		}
 
 		template<size_t size>
 		void push(const std::array<msg_t, size>& list)
 		{
-			for(const msg_t& msg : list)
-				mQueue.push(msg);
-
-			mHandleMessages.trigger();
+			pushRange(list.begin(), list.end(), list.size());
 		}
 		
 		template<size_t size>
 		void push(std::array<msg_t, size>&& list)
 		{
-			for(size_t i = 0; i < list.size(); ++i)
-				mQueue.push(std::move(list[i]));
-
-			mHandleMessages.trigger();
+			pushRange(std::make_move_iterator(list.begin()), std::make_move_iterator(list.end()), list.size());
 		}
 
 		void push(const std::initializer_list<msg_t>& list)
 		{
-			for(const msg_t& msg : list)
-				mQueue.push(msg);
-
-			mHandleMessages.trigger();
+			pushRange(list.begin(), list.end(), list.size());
 		}
 
-		void push(const std::vector<msg_t> list)
+		void push(const std::vector<msg_t>& list)
 		{
-			for(const msg_t& msg : list)
-				mQueue.push(msg);
-
-			mHandleMessages.trigger();
+			pushRange(list.begin(), list.end(), list.size());
 		}
 
 		void push(std::vector<msg_t>&& list)
 		{
-			for(size_t i = 0; i < list.size(); ++i)
-				mQueue.push(std::move(list[i]));
+			pushRange(std::make_move_iterator(list.begin()), std::make_move_iterator(list.end()), list.size());
 
-			mHandleMessages.trigger();
 			list.clear();
 		}
 	};
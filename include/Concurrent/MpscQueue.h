@@ -0,0 +1,306 @@
+#ifndef _CONCURRENT_MPSC_QUEUE_H_
+#define _CONCURRENT_MPSC_QUEUE_H_
+
+#include "Config.h"
+#include "Concurrent.h"
+
+#include <atomic>
+#include <memory_resource>
+#include <new>
+#include <optional>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  An unbounded queue for any number of producing threads and exactly one
+	 *  consuming thread.
+	 *
+	 *  Items are linked into the queue with a single atomic exchange per push and are
+	 *  removed without any read-modify-write operations.  Between the exchange and the link
+	 *  of a concurrent push the consumer can briefly see the queue as empty even though the
+	 *  item is on its way in, which is harmless since the pushing thread will signal the
+	 *  consumer after push() returns.
+	 *
+	 *  Only one thread may call tryPop() or isEmpty() at a time.
+	 *
+	 *  The queue is not intrusive: each item is held in a node with an optional, and
+	 *  the nodes, including the stub the consumer sits on, are owned by the queue rather
+	 *  than embedded in the items.  This keeps the Queue interface of copying or moving
+	 *  items in and out, at the cost of one allocation per push.
+	 *
+	 *  Nodes are allocated from a memory resource.  Since they are allocated by the
+	 *  producers and freed by the consumer, a SlabResource sized for them avoids the
+	 *  fragmentation and cross-thread frees of the general heap.
+	 */
+	template<typename T>
+	class MpscQueue
+	{
+	public:
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+
+		/**
+		 * @brief
+		 *  Creates an empty queue that allocates nodes from resource.
+		 */
+		MpscQueue(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: mResource(resource)
+		{
+			Node* stub = newNode();
+
+			mHead.store(stub, std::memory_order_relaxed);
+			mTail = stub;
+		}
+
+		virtual ~MpscQueue()
+		{
+			deleteChain(mTail);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes an item onto the Queue.
+		 */
+		void push(const T& item)
+		{
+			emplace(item);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes an item onto the Queue.
+		 */
+		void push(T&& item)
+		{
+			emplace(std::move(item));
+		}
+
+		/**
+		 * @brief
+		 *  Constructs an item in the Queue from the passed arguments.
+		 */
+		template<typename ...args_t>
+		void emplace(args_t&& ...args)
+		{
+			Node* node = newNode();
+
+			try
+			{
+				node->item.emplace(std::forward<args_t>(args)...);
+			}
+			catch (...)
+			{
+				deleteNode(node);
+				throw;
+			}
+
+			link(node, node);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes the items in the range [first, last) onto the Queue in order.  Use
+		 *  std::make_move_iterator() to move the items instead of copying them.
+		 *
+		 *  The items are linked together first and then added to the Queue with a
+		 *  single atomic exchange, so they will not be interleaved with items from
+		 *  other producers.
+		 */
+		template<typename iterator_t>
+		void pushBulk(iterator_t first, iterator_t last)
+		{
+			if (first == last)
+				return;
+
+			Node* batchFirst = newNode();
+			Node* batchLast = batchFirst;
+
+			try
+			{
+				batchFirst->item.emplace(*first);
+
+				for (++first; first != last; ++first)
+				{
+					Node* node = newNode();
+
+					batchLast->next.store(node, std::memory_order_relaxed);
+					batchLast = node;
+
+					node->item.emplace(*first);
+				}
+			}
+			catch (...)
+			{
+				// Nothing has been published yet, so the partial batch is still private.
+				deleteChain(batchFirst);
+				throw;
+			}
+
+			link(batchFirst, batchLast);
+		}
+
+		/**
+		 * @brief
+		 *  Attempts to pop an item from the Queue, if there is something to
+		 *  de-queue, it is placed in destination and true is returned.
+		 *  Otherwise, destination remains unchanged and false is returned.
+		 *  Must only be called from the consuming thread.
+		 */
+		bool tryPop(T& destination)
+		{
+			Node* next = mTail->next.load(std::memory_order_acquire);
+
+			if (nullptr == next)
+				return false;
+
+			destination = std::move(*next->item);
+			release(next);
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  Attempts to pop an item from the Queue, if there is something to
+		 *  de-queue, it is placed in destination and true is returned.
+		 *  Otherwise, destination remains unchanged and false is returned.
+		 *  Must only be called from the consuming thread.
+		 */
+		bool tryPop(std::optional<T>& destination)
+		{
+			Node* next = mTail->next.load(std::memory_order_acquire);
+
+			if (nullptr == next)
+				return false;
+
+			destination = std::move(next->item);
+			release(next);
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  Pops up to maxCount items from the Queue, writing them to destination in order.
+		 *  Returns the number of items popped.  Must only be called from the consuming thread.
+		 */
+		template<typename output_iterator_t>
+		size_t tryPopBulk(output_iterator_t destination, size_t maxCount)
+		{
+			size_t count = 0;
+
+			while (count < maxCount)
+			{
+				Node* next = mTail->next.load(std::memory_order_acquire);
+
+				if (nullptr == next)
+					break;
+
+				*destination = std::move(*next->item);
+				++destination;
+				++count;
+
+				release(next);
+			}
+
+			return count;
+		}
+
+		/**
+		 * @brief
+		 *  Inspector to determine if the queue is empty.  Must only be called from the
+		 *  consuming thread.
+		 */
+		bool isEmpty() const
+		{
+			return (nullptr == mTail->next.load(std::memory_order_acquire));
+		}
+
+		/**
+		 * @brief
+		 *  The size of the blocks the queue allocates, for creating a SlabResource to
+		 *  serve them.
+		 */
+		static constexpr size_t nodeSize()
+		{
+			return sizeof(Node);
+		}
+
+		/**
+		 * @brief
+		 *  The alignment of the blocks the queue allocates.
+		 */
+		static constexpr size_t nodeAlign()
+		{
+			return alignof(Node);
+		}
+
+	private:
+		struct Node
+		{
+			std::atomic<Node*> next;
+			std::optional<T> item;
+
+			Node()
+				: next(nullptr)
+			{
+			}
+		};
+
+		Node* newNode()
+		{
+			return new (mResource->allocate(sizeof(Node), alignof(Node))) Node();
+		}
+
+		void deleteNode(Node* node)
+		{
+			node->~Node();
+			mResource->deallocate(node, sizeof(Node), alignof(Node));
+		}
+
+		void deleteChain(Node* node)
+		{
+			while (node)
+			{
+				Node* next = node->next.load(std::memory_order_relaxed);
+				deleteNode(node);
+				node = next;
+			}
+		}
+
+		void link(Node* first, Node* last)
+		{
+			Node* prev = mHead.exchange(last, std::memory_order_acq_rel);
+			prev->next.store(first, std::memory_order_release);
+		}
+
+		void release(Node* newTail)
+		{
+			newTail->item.reset();
+
+			deleteNode(mTail);
+			mTail = newTail;
+		}
+
+		/**
+		 * @brief
+		 *  The most recently pushed node, shared by all producers.
+		 */
+		alignas(CacheLineSize) std::atomic<Node*> mHead;
+
+		/**
+		 * @brief
+		 *  Consumer owned position.  The node it points to has already been consumed
+		 *  and the next node holds the oldest item.
+		 */
+		alignas(CacheLineSize) Node* mTail;
+
+		std::pmr::memory_resource* mResource;
+	};
+
+	template<typename T>
+	struct IsSingleConsumer< MpscQueue<T> > : std::true_type {};
+}
+
+#endif // _CONCURRENT_MPSC_QUEUE_H_
\ No newline at end of file
@@ -4,30 +4,63 @@
 
 #include "Internal/ObjectPoolInternal.h"
 
+#include "Timer.h"
+#include "Scheduler.h"
 #include "Concurrent.h"
+#include "FunctionTask.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cassert>
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <type_traits>
+#include <vector>
 
 namespace Concurrent
 {
+	/**
+	 * @brief
+	 *  Resets an object as it is returned to an ObjectPool.
+	 *
+	 *  This default does nothing.  Specialize it for a type, or pass another function
+	 *  object type as the reset_t parameter of ObjectPool, to reset objects with a call
+	 *  that is resolved at compile time instead of through a std::function.
+	 */
+	template<typename T>
+	struct PoolReset
+	{
+		void operator()(T&) const
+		{
+		}
+	};
+
 	/**
 	 * @brief
 	 *  A implementation of the Object Pool pattern.
 	 *
+	 *  Objects are constructed in place in slots that never move, and stay there for the
+	 *  life of the pool, so checking one out and returning it moves nothing and pointers
+	 *  into a pooled object stay valid.  Idle objects are cached per thread in small
+	 *  magazines in front of a shared depot, so a thread that repeatedly takes and returns
+	 *  objects does not contend with others.
+	 *
+	 *  reset_t is called on each object as it is returned, before any reinitialization
+	 *  function passed to init().
+	 *
+	 *  Objects are constructed on demand unless prewarm() is used to construct them ahead
+	 *  of time.  Idle objects are kept until trim() is called, or until they have been idle
+	 *  for longer than the timeout given to setIdleTimeout().
+	 *
 	 * @todo
 	 *  Make this more easily support the not having to supply a constructor paramater
 	 *  if the default constructor of T is desired.
 	 */
-	template<typename T>
+	template<typename T, typename reset_t = PoolReset<T>>
 	class ObjectPool
 	{
-		friend class PoolObject<T>;
-
-		static_assert(std::is_move_constructible<T>::value, "ObjectPool type must be move constructible.");
-	
-	private:
+		friend class PoolObject<T, reset_t>;
 
 	public:
 		ObjectPool(const ObjectPool&) = delete;
@@ -35,6 +68,7 @@ namespace Concurrent
 
 		typedef std::function<void(T&)> reintFunc;
 		typedef std::function<T()> constructFunc;
+		typedef ObjectPoolStats Stats;
 
 		/**
 		 * @brief
@@ -46,6 +80,7 @@ namespace Concurrent
 
 		virtual ~ObjectPool()
 		{
+			mIdleTimer.stop();
 		}
 		
 		template<typename type = T>
@@ -73,11 +108,7 @@ namespace Concurrent
 		 */
 		void init(constructFunc&& constructor, size_t maxSize = 0)
 		{
-			auto reInit = [](T&)
-			{
-			};
-		
-			init(std::move(constructor), std::move(reInit), maxSize);
+			init(std::move(constructor), reintFunc(), maxSize);
 		}
 
 		/**
@@ -115,6 +146,7 @@ namespace Concurrent
 		 *
 		 * @param reInit
 		 *  A function that is used to re-initialize objects when they are returned to the pool.
+		 *  May be empty.
 		 *  
 		 * @param maxSize
 		 *  The maximum number of objects in circulation.  This includes items in the pool
@@ -124,19 +156,136 @@ namespace Concurrent
 		 */
 		void init(std::function<T()>&& constructor, std::function<void(T&)>&& reInit, size_t maxSize = 0)
 		{
-			assert( mInternal.isNull() ); // init() can only be called once.
+			assert( !mInternal ); // init() can only be called once.
 
-			mInternal = Reference< ObjectPoolInternal<T> >::create();
-
-			mInternal->mCirculatingItems = 0;
-			mInternal->mMaxSize = (0 == maxSize) ? Concurrent::hardwareConcurrency() : maxSize;
+			mInternal.reset(new ObjectPoolInternal<T, reset_t>((0 == maxSize) ? Concurrent::hardwareConcurrency() : maxSize));
 
 			mInternal->mConstructor = std::move(constructor);
 			mInternal->mReinit = std::move(reInit);
 		}
 
+		/**
+		 * @brief
+		 *  Constructs up to count objects ahead of demand, so the first gets do not pay for
+		 *  construction.  Fewer are constructed if the maximum size would be exceeded.
+		 *
+		 * @param scheduler
+		 *  If not null, objects are constructed in parallel by tasks on scheduler.
+		 *  The call still blocks until all are constructed.
+		 *
+		 * @return
+		 *  The number of objects constructed.
+		 */
+		size_t prewarm(size_t count, Scheduler* scheduler = nullptr)
+		{
+			assert(mInternal); // Init has not been called.
+
+			if (nullptr == scheduler)
+				return mInternal->prewarm(count);
+
+			size_t taskCount = std::min<size_t>(std::max(1u, hardwareConcurrency()),
+				(count + PrewarmBatchSize - 1) / PrewarmBatchSize);
+
+			std::atomic<size_t> constructed = 0;
+			std::vector< std::unique_ptr<FunctionTask> > tasks;
+
+			for (size_t i = 0; i < taskCount; ++i)
+			{
+				size_t share = count / taskCount + ((i < count % taskCount) ? 1 : 0);
+
+				tasks.emplace_back(std::make_unique<FunctionTask>([this, share, &constructed]()
+				{
+					constructed.fetch_add(mInternal->prewarm(share), std::memory_order_relaxed);
+				}));
+
+				scheduler->addTask(tasks.back().get());
+			}
+
+			for (auto& task : tasks)
+				task->wait();
+
+			return constructed.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief
+		 *  Destroys every idle object in the pool, returning the number destroyed.
+		 *  Objects out in PoolObjects are not affected.
+		 */
+		size_t trim()
+		{
+			assert(mInternal); // Init has not been called.
+			return mInternal->reclaimIdle(0);
+		}
+
+		/**
+		 * @brief
+		 *  Destroys objects once they have been idle in the pool for longer than timeout.
+		 *  Objects are destroyed within about a quarter of timeout after that.  A timeout
+		 *  of zero keeps idle objects indefinitely, which is the default.
+		 */
+		void setIdleTimeout(std::chrono::milliseconds timeout)
+		{
+			assert(mInternal); // Init has not been called.
+
+			mIdleTimer.stop();
+
+			if (timeout.count() <= 0)
+				return;
+
+			Timer::interval_t interval = std::max(
+				std::chrono::duration_cast<Timer::interval_t>(timeout / IdleEpochsPerTimeout),
+				Timer::interval_t(1));
+
+			ObjectPoolInternal<T, reset_t>* internal = mInternal.get();
+
+			mIdleTimer.start([internal]()
+			{
+				// An object stamped with epoch e was returned before epoch e + 1 began, so
+				// once epoch e + IdleEpochsPerTimeout + 1 begins it has been idle for at
+				// least IdleEpochsPerTimeout full intervals.
+				internal->mIdleEpoch.fetch_add(1, std::memory_order_relaxed);
+				internal->reclaimIdle(IdleEpochsPerTimeout + 1);
+			},
+			interval);
+		}
+
+		/**
+		 * @brief
+		 *  Counters for hits, misses, blocked gets, reclaimed objects and the number of
+		 *  objects currently constructed.
+		 */
+		Stats stats() const
+		{
+			assert(mInternal); // Init has not been called.
+			return mInternal->stats();
+		}
+
 	private:
-		Reference< ObjectPoolInternal<T> > mInternal;
+		/**
+		 * @brief
+		 *  The fewest objects each task constructs in a parallel prewarm().
+		 */
+		static constexpr size_t PrewarmBatchSize = 16;
+
+		/**
+		 * @brief
+		 *  The number of timer intervals the idle timeout is divided into.
+		 */
+		static constexpr uint32_t IdleEpochsPerTimeout = 4;
+
+		/**
+		 * @brief
+		 *  Shared with every PoolObject, so the slots stay valid until the last handle is
+		 *  gone even if the pool is destroyed first.
+		 */
+		std::shared_ptr< ObjectPoolInternal<T, reset_t> > mInternal;
+
+		/**
+		 * @brief
+		 *  Declared after mInternal so it is stopped before the internal data is destroyed.
+		 */
+		Timer mIdleTimer;
 	};
 
 	/**
@@ -146,43 +295,68 @@ namespace Concurrent
 	 *  Objects of this class should only exist for a short amount of time.  They
 	 *  will aquire an object from an ObjectPool, blocking during construction
 	 *  until one becomes available, returning the object to the pool on destruction.
+	 *
+	 *  The handle shares ownership of the pool's internal data, so it may outlive the
+	 *  ObjectPool it came from.  The object is then returned to data no longer reachable
+	 *  from any pool, which is destroyed along with its objects once the last handle is.
+	 *  Taking that reference costs an atomic increment on a cache line shared by every
+	 *  handle of the pool, and moving a handle costs none.
 	 */
-	template<typename T>
+	template<typename T, typename reset_t = PoolReset<T>>
 	class PoolObject
 	{
 	public:
-		PoolObject(ObjectPool<T>* pool)
+		PoolObject(const PoolObject&) = delete;
+		PoolObject& operator=(const PoolObject&) = delete;
+
+		PoolObject(ObjectPool<T, reset_t>* pool)
 			: mInternal(pool->mInternal)
 		{
 			assert(mInternal); // Init has not been called on pool.
-			mInternal->getItem(mItem);
+			mSlot = mInternal->getItem();
 		};
 
+		PoolObject(PoolObject&& other)
+			: mInternal(std::move(other.mInternal)), mSlot(other.mSlot)
+		{
+			other.mSlot = nullptr;
+		}
+
 		virtual ~PoolObject()
 		{
 			free();
 		}
 
+		T* get()
+		{
+			return mSlot ? mSlot->object() : nullptr;
+		}
+
+		const T* get() const
+		{
+			return mSlot ? mSlot->object() : nullptr;
+		}
+
 		T* operator->()
 		{
-			assert(mItem); // Fails if free() has been called.
-			return mItem.operator->();
+			assert(mSlot); // Fails if free() has been called.
+			return mSlot->object();
 		}
 
 		const T* operator->() const
 		{
-			assert(mItem); // Fails if free() has been called.
-			return mItem.operator->();
+			assert(mSlot); // Fails if free() has been called.
+			return mSlot->object();
 		}
 
 		T& operator*()
 		{
-			return *mItem;
+			return *mSlot->object();
 		}
 
 		const T& operator*() const
 		{
-			return *mItem;
+			return *mSlot->object();
 		}
 
 		/**
@@ -192,20 +366,18 @@ namespace Concurrent
 		 */
 		void free()
 		{
-			if (mItem)
-				mInternal->returnItem(std::move(*mItem));
+			if (mSlot)
+			{
+				mInternal->returnItem(mSlot);
+				mSlot = nullptr;
+			}
 		}
 
 	private:
-		/**
-		 * @brief
-		 *	Optional so T does not have to be default constructable, and does
-		 *  not have to have a seperate allocation on the heap outside of
-		 *  Producer memory.
-		 */
-		std::optional<T> mItem;
+		typedef typename ObjectPoolInternal<T, reset_t>::Slot Slot;
 
-		Reference< ObjectPoolInternal<T> > mInternal;
+		std::shared_ptr< ObjectPoolInternal<T, reset_t> > mInternal;
+		Slot* mSlot;
 	};
 }
 
@@ -0,0 +1,152 @@
+#ifndef _CONCURRENT_PRIORITY_MESSAGE_LOOP_H_
+#define _CONCURRENT_PRIORITY_MESSAGE_LOOP_H_
+
+#include "MpscQueue.h"
+
+#include "Internal/MessageLoopBase.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  A MessageLoop with a separate lane for each priority level, so urgent messages such
+	 *  as shutdown or configuration changes do not wait behind a backlog of ordinary ones.
+	 *
+	 *  Valid priorities are in the range [0, maxPriority], and as with Scheduler higher
+	 *  values are handled first.  Messages within a lane are handled in the order they were
+	 *  pushed, but there is no ordering between lanes.
+	 *
+	 *  Strict priority can starve the lower lanes under sustained load.  If starvationLimit
+	 *  is non-zero, then after that many consecutive messages from lanes above priority 0,
+	 *  the loop handles one message from each non-empty lane below the one it is serving
+	 *  before returning to the top.
+	 */
+	template<typename msg_t>
+	class PriorityMessageLoop : public MessageLoopBase
+	{
+	private:
+		std::function<void(const msg_t&)> mHandler;
+		std::vector< std::unique_ptr< MpscQueue<msg_t> > > mLanes;
+
+		size_t mStarvationLimit;
+		size_t mStreak;
+
+		/**
+		 * @brief
+		 *  The highest lane with messages, or -1 if all are empty.
+		 */
+		int topLane() const
+		{
+			for (int lane = (int)mLanes.size() - 1; lane >= 0; --lane)
+			{
+				if (false == mLanes[lane]->isEmpty())
+					return lane;
+			}
+
+			return -1;
+		}
+
+		bool handleFrom(int lane, size_t& handled)
+		{
+			// Popped into a local so the message is released once it is handled.
+			std::optional<msg_t> message;
+
+			if (false == mLanes[lane]->tryPop(message))
+				return false;
+
+			++handled;
+			mHandler(*message);
+			return true;
+		}
+
+	protected:
+		virtual bool hasMessages() const override
+		{
+			return (topLane() >= 0);
+		}
+
+		virtual void handleMessages(size_t maxCount, size_t& handled) override
+		{
+			while (handled < maxCount)
+			{
+				int lane = topLane();
+
+				if (lane < 0 || false == handleFrom(lane, handled))
+					break;
+
+				if (0 == lane)
+				{
+					mStreak = 0;
+				}
+				else if (0 != mStarvationLimit && ++mStreak >= mStarvationLimit)
+				{
+					mStreak = 0;
+
+					for (int lower = lane - 1; lower >= 0 && handled < maxCount; --lower)
+						handleFrom(lower, handled);
+				}
+			}
+		}
+
+	public:
+		PriorityMessageLoop(std::function<void(const msg_t&)>&& msgHandler, int maxPriority,
+		                    size_t starvationLimit = 0, Execution execution = Execution::Task)
+			: mHandler(std::move(msgHandler)), mStarvationLimit(starvationLimit), mStreak(0)
+		{
+			size_t laneCount = (size_t)std::max(maxPriority, 0) + 1;
+
+			for (size_t i = 0; i < laneCount; ++i)
+				mLanes.emplace_back(std::make_unique< MpscQueue<msg_t> >());
+
+			startLoop(execution);
+		}
+
+		~PriorityMessageLoop()
+		{
+			stopLoop();
+		}
+
+		/**
+		 * @brief
+		 *  Pushes a message into the lane for priority, which is clamped to the valid range.
+		 */
+		void push(const msg_t& msg, int priority = 0)
+		{
+			mLanes[laneFor(priority)]->push(msg);
+			notifyPushed(1);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes a message into the lane for priority, which is clamped to the valid range.
+		 */
+		void push(msg_t&& msg, int priority = 0)
+		{
+			mLanes[laneFor(priority)]->push(std::move(msg));
+			notifyPushed(1);
+		}
+
+		/**
+		 * @brief
+		 *  The highest valid priority.
+		 */
+		int maxPriority() const
+		{
+			return (int)mLanes.size() - 1;
+		}
+
+	private:
+		size_t laneFor(int priority) const
+		{
+			return (size_t)std::clamp(priority, 0, maxPriority());
+		}
+	};
+}
+
+#endif // _CONCURRENT_PRIORITY_MESSAGE_LOOP_H_
\ No newline at end of file
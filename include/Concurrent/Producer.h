@@ -3,6 +3,13 @@
 
 #include "Internal/ProducerInternal.h"
 
+#include <cassert>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
 namespace Concurrent
 {
 	/**
@@ -13,25 +20,95 @@ namespace Concurrent
 	 *  an item is pushed it will either be passed to a single thread that
 	 *  is waiting on a consume() call or will store the object in an internal
 	 *  queue waiting for the next consume() call.
+	 *
+	 *  push() is a lock-free enqueue, and only wakes a consumer when one is
+	 *  actually parked.  A blocking consume() spins briefly before parking.
+	 *
+	 *  A Producer constructed with watermarks is bounded, and provides flow control
+	 *  between pipeline stages.  Once the number of queued items reaches the high
+	 *  watermark, push() blocks and tryPush() fails until consumers have drained the
+	 *  queue down to the low watermark.
+	 *
+	 *  queue_t is the queue used to hold items.  It defaults to the general purpose
+	 *  Queue, but can be an MpscQueue when only a single thread consumes, or an SpscQueue
+	 *  when a single thread pushes and a single thread consumes.  Producers with those
+	 *  queues can not be added to a Select or consumed with next(), since both pop or
+	 *  inspect the queue from other threads.
+	 *
+	 *  If withStats is true, the producer can record queue stats with enableStats().  The
+	 *  flag is a template parameter so that producers without it hold items exactly as
+	 *  pushed, with no per-item overhead.
 	 */
-	template<typename T>
+	template<typename T, typename queue_t = Queue<T>, bool withStats = false>
 	class Producer
 	{
+		friend class Select;
+
 	public:
-		Producer(const Producer<T>&) = delete;
+		Producer(const Producer&) = delete;
 
 		Producer(Producer&& other)
-			: mInternal(other.mInternal)
+			: mInternal(std::move(other.mInternal))
 		{
-			other.mInternal.makeNull();
 		}
 
+		/**
+		 * @brief
+		 *  Creates an unbounded producer.
+		 */
 		Producer()
 		{
-			mInternal = std::make_shared< ProducerInternal<T> >();
+			mInternal = std::make_shared< ProducerInternal<T, queue_t, withStats> >();
 			mInternal->endCalled.store(false);
 		}
 
+		/**
+		 * @brief
+		 *  Creates an unbounded producer whose queue allocates from resource.  queue_t
+		 *  must have a constructor taking a std::pmr::memory_resource*, as Queue,
+		 *  MpscQueue and SpscQueue do.  The resource must outlive the producer and
+		 *  every consumer.
+		 */
+		explicit Producer(std::pmr::memory_resource* resource)
+		{
+			mInternal = std::make_shared< ProducerInternal<T, queue_t, withStats> >(resource);
+			mInternal->endCalled.store(false);
+		}
+
+		/**
+		 * @brief
+		 *  Creates a bounded producer.
+		 *
+		 * @param highWatermark
+		 *  The maximum number of items that can be queued.  Pushing when this many items
+		 *  are queued blocks.
+		 *
+		 * @param lowWatermark
+		 *  Once pushes are blocked, they stay blocked until consumers bring the number of
+		 *  queued items down to this level.  Must be less than highWatermark.
+		 */
+		Producer(size_t highWatermark, size_t lowWatermark)
+			: Producer()
+		{
+			assert(highWatermark > 0 && lowWatermark < highWatermark);
+
+			mInternal->highWatermark = highWatermark;
+			mInternal->lowWatermark = lowWatermark;
+		}
+
+		/**
+		 * @brief
+		 *  Creates a bounded producer whose queue allocates from resource.
+		 */
+		Producer(size_t highWatermark, size_t lowWatermark, std::pmr::memory_resource* resource)
+			: Producer(resource)
+		{
+			assert(highWatermark > 0 && lowWatermark < highWatermark);
+
+			mInternal->highWatermark = highWatermark;
+			mInternal->lowWatermark = lowWatermark;
+		}
+
 		/**
 		 * @brief
 		 *  Destruction of the produder with an automatic end() call.  Any unconsumed items
@@ -39,33 +116,73 @@ namespace Concurrent
 		 */
 		virtual ~Producer()
 		{
-			mInternal->end();
+			if (mInternal)
+				mInternal->end();
 		}
 
 		/**
 		 * @brief
-		 *  Pushes a copy of the passed item into the message queue.
+		 *  Pushes a copy of the passed item into the message queue.  A bounded producer
+		 *  blocks while it is full.  Returns false if end() has been called.
 		 */
 		bool push(const T &item)
 		{
-			if (mInternal->endCalled)
-				return false;
-
-			mInternal->pushMessage(item);
-			return true;
+			return mInternal->pushMessage(item);
 		}
 
 		/**
 		 * @brief
-		 *  Pushes the passed item into the message queue using move semantics.
+		 *  Pushes the passed item into the message queue using move semantics.  A bounded
+		 *  producer blocks while it is full.  Returns false if end() has been called.
 		 */
 		bool push(T&& item)
 		{
-			if (mInternal->endCalled)
-				return false;
+			return mInternal->pushMessage(std::move(item));
+		}
+
+		/**
+		 * @brief
+		 *  Pushes a copy of the passed item if it can be done without blocking.  Returns
+		 *  false if a bounded producer is full or end() has been called.
+		 */
+		bool tryPush(const T &item)
+		{
+			return mInternal->pushMessage(item, nullptr, true);
+		}
+
+		/**
+		 * @brief
+		 *  Moves the passed item in if it can be done without blocking.  Returns false,
+		 *  leaving item unchanged, if a bounded producer is full or end() has been called.
+		 */
+		bool tryPush(T&& item)
+		{
+			return mInternal->pushMessage(std::move(item), nullptr, true);
+		}
 
-			mInternal->pushMessage(std::forward<T>(item));
-			return true;
+		/**
+		 * @brief
+		 *  Pushes a copy of the passed item, blocking for at most timeout while a bounded
+		 *  producer is full.  Returns false if the time expired or end() has been called.
+		 */
+		template<typename rep_t, typename period_t>
+		bool pushFor(const T &item, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+			return mInternal->pushMessage(item, &deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Moves the passed item in, blocking for at most timeout while a bounded producer
+		 *  is full.  Returns false, leaving item unchanged, if the time expired or end() has
+		 *  been called.
+		 */
+		template<typename rep_t, typename period_t>
+		bool pushFor(T&& item, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+			return mInternal->pushMessage(std::move(item), &deadline);
 		}
 
 		/**
@@ -79,7 +196,7 @@ namespace Concurrent
 		 */
 		bool consume(T& out)
 		{
-			std::shared_ptr< ProducerInternal<T> > localInternal(mInternal);
+			std::shared_ptr< ProducerInternal<T, queue_t, withStats> > localInternal(mInternal);
 			return localInternal->getMessage(out);
 		}
 
@@ -94,7 +211,7 @@ namespace Concurrent
 		 */
 		bool consume(std::optional<T>& out)
 		{
-			std::shared_ptr< ProducerInternal<T> > localInternal(mInternal);
+			std::shared_ptr< ProducerInternal<T, queue_t, withStats> > localInternal(mInternal);
 			return localInternal->getMessage(out);
 		}
 
@@ -118,6 +235,203 @@ namespace Concurrent
 			return mInternal->getMessage(out, true);
 		}
 
+		/**
+		 * @brief
+		 *  Takes an item out of the queue and places it in out, blocking for at most
+		 *  timeout until one becomes available.
+		 *
+		 * @return
+		 *  True if an item was pulled from the internal queue and placed into out.
+		 *  False if the time expired, or end() was called and there are no items in
+		 *  the queue.
+		 */
+		template<typename rep_t, typename period_t>
+		bool consumeFor(T& out, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+
+			std::shared_ptr< ProducerInternal<T, queue_t, withStats> > localInternal(mInternal);
+			return localInternal->getMessage(out, false, &deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Takes an item out of the queue and places it in out, blocking for at most
+		 *  timeout until one becomes available.
+		 *
+		 * @return
+		 *  True if an item was pulled from the internal queue and placed into out.
+		 *  False if the time expired, or end() was called and there are no items in
+		 *  the queue.
+		 */
+		template<typename rep_t, typename period_t>
+		bool consumeFor(std::optional<T>& out, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+
+			std::shared_ptr< ProducerInternal<T, queue_t, withStats> > localInternal(mInternal);
+			return localInternal->getMessage(out, false, &deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Takes an item out of the queue and places it in out, blocking until one becomes
+		 *  available or time is reached.  Clocks other than steady_clock are converted
+		 *  to a steady deadline on entry, so later adjustments to them are not followed.
+		 *
+		 * @return
+		 *  True if an item was pulled from the internal queue and placed into out.
+		 *  False if time was reached, or end() was called and there are no items in
+		 *  the queue.
+		 */
+		template<typename clock_t, typename duration_t>
+		bool consumeUntil(T& out, const std::chrono::time_point<clock_t, duration_t>& time)
+		{
+			return consumeFor(out, time - clock_t::now());
+		}
+
+		/**
+		 * @brief
+		 *  Takes an item out of the queue and places it in out, blocking until one becomes
+		 *  available or time is reached.  Clocks other than steady_clock are converted
+		 *  to a steady deadline on entry, so later adjustments to them are not followed.
+		 *
+		 * @return
+		 *  True if an item was pulled from the internal queue and placed into out.
+		 *  False if time was reached, or end() was called and there are no items in
+		 *  the queue.
+		 */
+		template<typename clock_t, typename duration_t>
+		bool consumeUntil(std::optional<T>& out, const std::chrono::time_point<clock_t, duration_t>& time)
+		{
+			return consumeFor(out, time - clock_t::now());
+		}
+
+		/**
+		 * @brief
+		 *  Blocks until at least one item is available, and then appends up to maxItems
+		 *  items to out in one pass.  Suited to consumers that process items in batches.
+		 *
+		 * @param out
+		 *  A container with push_back(), such as std::vector<T>.  Items are appended
+		 *  without clearing it first.
+		 *
+		 * @return
+		 *  The number of items appended.  Zero if end() was called and there are no
+		 *  items in the queue.
+		 */
+		template<typename container_t>
+		size_t consumeBatch(container_t& out, size_t maxItems)
+		{
+			return consumeBatch(out, maxItems, nullptr);
+		}
+
+		/**
+		 * @brief
+		 *  Blocks for at most timeout until at least one item is available, and then appends
+		 *  up to maxItems items to out in one pass.
+		 *
+		 * @return
+		 *  The number of items appended.  Zero if the time expired, or end() was called and
+		 *  there are no items in the queue.
+		 */
+		template<typename container_t, typename rep_t, typename period_t>
+		size_t consumeBatch(container_t& out, size_t maxItems, const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+			return consumeBatch(out, maxItems, &deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Starts recording queue depth and the time items wait between push() and
+		 *  consume.  Items pushed before this are not counted.  Only available when
+		 *  withStats is true.
+		 */
+		void enableStats()
+		{
+			static_assert(withStats, "enableStats() requires a Producer with withStats set.");
+
+			if (mInternal->stats.load(std::memory_order_acquire))
+				return;
+
+			QueueStats* stats = new QueueStats();
+			QueueStats* expected = nullptr;
+
+			if (false == mInternal->stats.compare_exchange_strong(expected, stats, std::memory_order_acq_rel))
+				delete stats;
+		}
+
+		/**
+		 * @brief
+		 *  A snapshot of the stats recorded since enableStats(), or all zeros if it was
+		 *  never called.  Producers have no handler, so handlerTime is always empty.
+		 */
+		QueueStats::Snapshot stats() const
+		{
+			static_assert(withStats, "stats() requires a Producer with withStats set.");
+
+			QueueStats* stats = mInternal->stats.load(std::memory_order_acquire);
+			return stats ? stats->snapshot() : QueueStats::Snapshot();
+		}
+
+#ifdef CONCURRENT_COROUTINES
+		/**
+		 * @brief
+		 *  Awaitable returned by next().
+		 */
+		class NextAwaiter
+		{
+		public:
+			NextAwaiter(std::shared_ptr< ProducerInternal<T, queue_t, withStats> > internal, Scheduler* scheduler)
+				: mInternal(std::move(internal))
+			{
+				mWaiter.scheduler = scheduler;
+			}
+
+			bool await_ready()
+			{
+				return mInternal->readyAsync(mWaiter);
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				mWaiter.handle = handle;
+				return mInternal->suspendAsync(&mWaiter);
+			}
+
+			std::optional<T> await_resume()
+			{
+				return std::move(mWaiter.result);
+			}
+
+		private:
+			std::shared_ptr< ProducerInternal<T, queue_t, withStats> > mInternal;
+			typename ProducerInternal<T, queue_t, withStats>::AsyncWaiter mWaiter;
+		};
+
+		/**
+		 * @brief
+		 *  Consumes an item from a coroutine.  `co_await producer.next()` evaluates to
+		 *  an optional holding the item, or empty once end() was called and there are no
+		 *  items in the queue.
+		 *
+		 *  If the queue is empty, the coroutine suspends without blocking its thread,
+		 *  and is resumed on scheduler, or the default scheduler if null, when an item is
+		 *  pushed for it.  Suspended consumers are served in the order they suspended.  The
+		 *  producer's shared state is kept alive while a consumer is suspended, and end()
+		 *  resumes every suspended consumer, so a suspended coroutine must not be destroyed
+		 *  before it is resumed.
+		 */
+		NextAwaiter next(Scheduler* scheduler = nullptr)
+		{
+			static_assert(false == IsSingleConsumer<queue_t>::value,
+				"Suspended consumers are handed items from the pushing thread, so next() requires a queue that allows any thread to consume.");
+
+			return NextAwaiter(mInternal, scheduler);
+		}
+#endif
+
 		/**
 		 * @brief
 		 *  Returns true if the queue is empty.
@@ -133,7 +447,8 @@ namespace Concurrent
 		 *
 		 *  consume() calls will succeed until all items currently
 		 *  in the queue have been consumed.  After that, consume() will
-		 *  return false.  Any subsequent push() calls will fail.
+		 *  return false.  Any subsequent push() calls will fail, and pushes
+		 *  blocked on a full bounded producer return false.
 		 */
 		void end()
 		{
@@ -141,7 +456,23 @@ namespace Concurrent
 		}
 
 	private:
-		std::shared_ptr< ProducerInternal<T> > mInternal;
+		std::shared_ptr< ProducerInternal<T, queue_t, withStats> > mInternal;
+
+		template<typename container_t>
+		size_t consumeBatch(container_t& out, size_t maxItems, const std::chrono::steady_clock::time_point* deadline)
+		{
+			if (0 == maxItems)
+				return 0;
+
+			std::shared_ptr< ProducerInternal<T, queue_t, withStats> > localInternal(mInternal);
+			std::optional<T> first;
+
+			if (false == localInternal->getMessage(first, false, deadline))
+				return 0;
+
+			out.push_back(std::move(*first));
+			return 1 + localInternal->popMessages(std::back_inserter(out), maxItems - 1);
+		}
 	};
 }
 
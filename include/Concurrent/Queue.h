@@ -5,6 +5,7 @@
 #include "Internal/QueuePlatform.h"
 
 #include <StdExt/Exceptions.h>
+#include <memory_resource>
 #include <optional>
 
 namespace Concurrent
@@ -23,9 +24,10 @@ namespace Concurrent
 
 		/**
 		 * @brief
-		 *  Creates an empty queue.
+		 *  Creates an empty queue that allocates its storage from resource.
 		 */
-		Queue()
+		Queue(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: mSysQueue(resource)
 		{
 		}
 
@@ -57,6 +59,32 @@ namespace Concurrent
 				static_assert(false, "Attempting to move an item that is not move-constructable into a queue.");
 		}
 
+		/**
+		 * @brief
+		 *  Constructs an item in the Queue from the passed arguments.
+		 */
+		template<typename ...args_t>
+		void emplace(args_t&& ...args)
+		{
+			mSysQueue.emplace(std::forward<args_t>(args)...);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes the items in the range [first, last) onto the Queue in order.  Use
+		 *  std::make_move_iterator() to move the items instead of copying them.
+		 *
+		 *  The platform queue has no batch operation, so items are still enqueued
+		 *  individually.  MpscQueue, SpscQueue and BoundedQueue link or claim
+		 *  a whole batch with a single atomic operation.
+		 */
+		template<typename iterator_t>
+		void pushBulk(iterator_t first, iterator_t last)
+		{
+			for (; first != last; ++first)
+				mSysQueue.push(*first);
+		}
+
 		/**
 		 * @brief
 		 *  Attempts to pop an item from the Queue, if there is something to
@@ -79,6 +107,27 @@ namespace Concurrent
 			return mSysQueue.try_pop(destination);
 		}
 
+		/**
+		 * @brief
+		 *  Pops up to maxCount items from the Queue, writing them to destination in order.
+		 *  Returns the number of items popped.
+		 */
+		template<typename output_iterator_t>
+		size_t tryPopBulk(output_iterator_t destination, size_t maxCount)
+		{
+			size_t count = 0;
+			std::optional<T> item;
+
+			while (count < maxCount && mSysQueue.try_pop(item))
+			{
+				*destination = std::move(*item);
+				++destination;
+				++count;
+			}
+
+			return count;
+		}
+
 		/**
 		 * @brief
 		 *  Inspector to determine if the queue is empty.
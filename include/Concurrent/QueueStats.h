@@ -0,0 +1,332 @@
+#ifndef _CONCURRENT_QUEUE_STATS_H_
+#define _CONCURRENT_QUEUE_STATS_H_
+
+#include "Config.h"
+#include "Concurrent.h"
+#include "ShardedCounter.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  A snapshot of a distribution of durations in nanoseconds.
+	 *
+	 *  Values are counted in log-linear buckets in the style of an HDR histogram: each
+	 *  power of two range is split into eight equal buckets, so any reported value is within
+	 *  12.5% of the value recorded, from a nanosecond up to the full 64-bit range.
+	 */
+	class CONCURRENT_EXPORT Histogram
+	{
+	public:
+		static constexpr size_t BucketCount = 496;
+
+		Histogram();
+
+		/**
+		 * @brief
+		 *  The number of values recorded.
+		 */
+		uint64_t count() const;
+
+		/**
+		 * @brief
+		 *  The value at or below which the fraction of recorded values falls, for a
+		 *  fraction between 0.0 and 1.0.  Returns the upper bound of the bucket it falls in.
+		 */
+		uint64_t percentile(double fraction) const;
+
+		/**
+		 * @brief
+		 *  The upper bound of the bucket holding the largest recorded value.
+		 */
+		uint64_t max() const;
+
+		/**
+		 * @brief
+		 *  The mean of the recorded values, using bucket midpoints.
+		 */
+		double mean() const;
+
+		/**
+		 * @brief
+		 *  The bucket a value is counted in.
+		 */
+		static size_t bucketFor(uint64_t value);
+
+		/**
+		 * @brief
+		 *  The smallest and largest values counted in bucket.
+		 */
+		static std::pair<uint64_t, uint64_t> bucketRange(size_t bucket);
+
+		std::array<uint64_t, BucketCount> counts;
+	};
+
+	/**
+	 * @brief
+	 *  Optional instrumentation of a queue: depth, enqueue to dequeue latency and
+	 *  handler execution time.
+	 *
+	 *  Instrumentation is compiled in with a template flag, as in MessageLoop<msg_t, true>,
+	 *  so classes without it keep their original queue and pay nothing.  Those with it
+	 *  hold a timestamp with each queued item and a null pointer to their QueueStats until
+	 *  stats are enabled.
+	 *
+	 *  Each thread records histograms into a recorder of its own, so recording neither
+	 *  locks nor shares a cache line with other threads, and snapshot() sums the
+	 *  recorders.  A thread finds its recorders in a single registry of its own, keyed by
+	 *  instance, rather than through a thread local slot per instance, so the number of
+	 *  instances is not limited by the system's thread local slots.  Each histogram of a
+	 *  recorder takes about 4 KiB, allocated when the thread first records into it, and is
+	 *  kept until the QueueStats is destroyed.  Depth and push counts are sharded by thread
+	 *  in the same way.
+	 */
+	class CONCURRENT_EXPORT QueueStats
+	{
+	public:
+		QueueStats(const QueueStats&) = delete;
+		QueueStats& operator=(const QueueStats&) = delete;
+
+		struct Snapshot
+		{
+			/**
+			 * @brief
+			 *  Items pushed and not yet popped.
+			 */
+			int64_t depth = 0;
+
+			/**
+			 * @brief
+			 *  The largest depth seen since stats were enabled.  Depth is sampled every
+			 *  few pushes on each thread and when taking a snapshot, so a brief peak
+			 *  between samples can be missed.
+			 */
+			int64_t maxDepth = 0;
+
+			/**
+			 * @brief
+			 *  Items pushed since stats were enabled.
+			 */
+			uint64_t pushed = 0;
+
+			/**
+			 * @brief
+			 *  Time items spent in the queue, in nanoseconds.
+			 */
+			Histogram latency;
+
+			/**
+			 * @brief
+			 *  Time spent in each handler call, in nanoseconds.  Only recorded by classes
+			 *  that call a handler, such as MessageLoop.
+			 */
+			Histogram handlerTime;
+		};
+
+		QueueStats();
+		virtual ~QueueStats();
+
+		/**
+		 * @brief
+		 *  The timestamp recorded with items, in nanoseconds on the steady clock.
+		 */
+		static int64_t now();
+
+		/**
+		 * @brief
+		 *  Records that count items were pushed.
+		 */
+		void onPush(size_t count);
+
+		/**
+		 * @brief
+		 *  Records that an item with the passed timestamp was popped.  A timestamp of zero
+		 *  means the item was pushed before stats were enabled and is ignored.
+		 */
+		void onPop(int64_t stamp, int64_t popTime);
+
+		/**
+		 * @brief
+		 *  Records the time a single handler call took.
+		 */
+		void onHandled(int64_t nanoseconds);
+
+		Snapshot snapshot() const;
+
+	private:
+		struct Recorder;
+
+		/**
+		 * @brief
+		 *  The calling thread's recorder, made and registered on first use.  Returns
+		 *  nullptr if the thread is exiting and its registry has already been destroyed.
+		 */
+		Recorder* recorder();
+
+		void raiseMaxDepth(int64_t depth);
+
+		/**
+		 * @brief
+		 *  Identifies the instance in the threads' registries.  Serials are never reused,
+		 *  so an entry left by a destroyed instance can not be taken for a live one.
+		 */
+		uint64_t mSerial;
+
+		/**
+		 * @brief
+		 *  Every recorder of the instance.  Each is pushed by the thread it belongs to, and
+		 *  they are only removed on destruction, so the list can be walked without a lock.
+		 */
+		std::atomic<Recorder*> mRecorders;
+
+		ShardedGauge mDepth;
+		ShardedCounter mPushed;
+		std::atomic<int64_t> mMaxDepth;
+	};
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  An item as held in an instrumented queue, with the time it was pushed.
+	 */
+	template<typename T>
+	struct Stamped
+	{
+		T item;
+		int64_t stamp;
+
+		template<typename item_t>
+		Stamped(item_t&& item, int64_t stamp)
+			: item(std::forward<item_t>(item)), stamp(stamp)
+		{
+		}
+	};
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  The type of queue_t, a queue template instantiated for one item type, when
+	 *  instantiated for item_t instead.  Only templates taking just the item type, such as
+	 *  Queue, MpscQueue and SpscQueue, can be rebound.
+	 */
+	template<typename queue_t, typename item_t>
+	struct RebindQueue;
+
+	template<template<typename> class queue_template_t, typename T, typename item_t>
+	struct RebindQueue<queue_template_t<T>, item_t>
+	{
+		typedef queue_template_t<item_t> type;
+	};
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  The queue an instrumented class holds its items in: queue_t itself without stats,
+	 *  and queue_t rebound to Stamped<T> with them.
+	 */
+	template<typename queue_t, typename T, bool withStats>
+	struct InstrumentedQueue
+	{
+		typedef queue_t type;
+	};
+
+	template<typename queue_t, typename T>
+	struct InstrumentedQueue<queue_t, T, true>
+	{
+		typedef typename RebindQueue< queue_t, Stamped<T> >::type type;
+	};
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Wraps an input iterator so that bulk pushes produce Stamped items.
+	 */
+	template<typename T, typename iterator_t>
+	class StampingIterator
+	{
+	public:
+		StampingIterator(iterator_t it, int64_t stamp)
+			: mIt(it), mStamp(stamp)
+		{
+		}
+
+		Stamped<T> operator*() const
+		{
+			return Stamped<T>(*mIt, mStamp);
+		}
+
+		StampingIterator& operator++()
+		{
+			++mIt;
+			return *this;
+		}
+
+		bool operator==(const StampingIterator& other) const
+		{
+			return (mIt == other.mIt);
+		}
+
+		bool operator!=(const StampingIterator& other) const
+		{
+			return (mIt != other.mIt);
+		}
+
+	private:
+		iterator_t mIt;
+		int64_t mStamp;
+	};
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Wraps an output iterator so that bulk pops of Stamped items record their latency
+	 *  and write just the item.
+	 */
+	template<typename T, typename output_iterator_t>
+	class UnstampingIterator
+	{
+	public:
+		UnstampingIterator(output_iterator_t it, QueueStats* stats)
+			: mIt(it), mStats(stats), mPopTime(stats ? QueueStats::now() : 0)
+		{
+		}
+
+		UnstampingIterator& operator*()
+		{
+			return *this;
+		}
+
+		UnstampingIterator& operator=(Stamped<T>&& stamped)
+		{
+			if (mStats)
+				mStats->onPop(stamped.stamp, mPopTime);
+
+			*mIt = std::move(stamped.item);
+			return *this;
+		}
+
+		UnstampingIterator& operator++()
+		{
+			++mIt;
+			return *this;
+		}
+
+	private:
+		output_iterator_t mIt;
+		QueueStats* mStats;
+		int64_t mPopTime;
+	};
+}
+
+#endif // _CONCURRENT_QUEUE_STATS_H_
\ No newline at end of file
@@ -0,0 +1,115 @@
+#ifndef _CONCURRENT_SELECT_H_
+#define _CONCURRENT_SELECT_H_
+
+#include "Config.h"
+#include "Producer.h"
+
+#include "Internal/EventCount.h"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  Waits on several Producer objects at once, which may hold different item types.
+	 *
+	 *  Producers are registered with add(), which returns the index that identifies
+	 *  them.  wait() parks the calling thread until at least one of them has an item and
+	 *  returns its index, so a single thread can service many channels without polling.
+	 *  When several are ready, the search for a ready producer starts just after the
+	 *  one returned last, so a busy producer cannot starve the others.
+	 *
+	 *  A ready producer only means an item was available when wait() returned.  If other
+	 *  threads consume from the same producer, tryConsume() can still fail, and the caller
+	 *  should simply wait again.
+	 *
+	 *  The Select is attached to its producers until it is destroyed.  Pushing to an attached
+	 *  producer also wakes the Select, which costs a shared lock on that producer.
+	 */
+	class CONCURRENT_EXPORT Select
+	{
+	public:
+		Select(const Select&) = delete;
+		Select& operator=(const Select&) = delete;
+
+		/**
+		 * @brief
+		 *  Returned by wait() functions when no producer is ready.
+		 */
+		static constexpr size_t npos = (size_t)-1;
+
+		Select();
+
+		/**
+		 * @brief
+		 *  Detaches from all producers.
+		 */
+		virtual ~Select();
+
+		/**
+		 * @brief
+		 *  Adds a producer to the set being waited on, returning its index.
+		 */
+		template<typename T, typename queue_t, bool withStats>
+		size_t add(Producer<T, queue_t, withStats>& producer)
+		{
+			static_assert(false == IsSingleConsumer<queue_t>::value,
+				"Select checks producers for items from the waiting thread, so their queue must allow any thread to consume.");
+
+			return addInternal(producer.mInternal);
+		}
+
+		/**
+		 * @brief
+		 *  The number of producers added.
+		 */
+		size_t size() const;
+
+		/**
+		 * @brief
+		 *  Returns the index of a producer that has an item, blocking until there is one.
+		 *  Returns npos if every producer has had end() called and has no items left.
+		 */
+		size_t wait();
+
+		/**
+		 * @brief
+		 *  Returns the index of a producer that has an item, blocking for at most timeout.
+		 *  Returns npos if the time expired, or every producer has had end() called and
+		 *  has no items left.
+		 */
+		template<typename rep_t, typename period_t>
+		size_t waitFor(const std::chrono::duration<rep_t, period_t>& timeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+			return waitUntil(&deadline);
+		}
+
+		/**
+		 * @brief
+		 *  Returns the index of a producer that has an item without blocking, or npos
+		 *  if none do.
+		 */
+		size_t tryWait();
+
+	private:
+		size_t addInternal(std::shared_ptr<ProducerInternalBase> producer);
+		size_t waitUntil(const std::chrono::steady_clock::time_point* deadline);
+
+		/**
+		 * @brief
+		 *  Finds a ready producer in round-robin order.  Sets allEnded if none are ready
+		 *  and every producer has ended.
+		 */
+		size_t findReady(bool& allEnded);
+
+		std::vector< std::shared_ptr<ProducerInternalBase> > mProducers;
+		EventCount mReady;
+		size_t mNext;
+	};
+}
+
+#endif // _CONCURRENT_SELECT_H_
\ No newline at end of file
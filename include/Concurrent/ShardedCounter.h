@@ -0,0 +1,250 @@
+#ifndef _CONCURRENT_SHARDED_COUNTER_H_
+#define _CONCURRENT_SHARDED_COUNTER_H_
+
+#include "Config.h"
+#include "Concurrent.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  How a sharded statistic chooses the slot the calling thread updates.
+	 */
+	enum class Sharding
+	{
+		/**
+		 * @brief
+		 *  Each thread is given a slot in the order threads first update any sharded
+		 *  statistic, so threads only share a slot once there are more threads than slots.
+		 */
+		Thread,
+
+		/**
+		 * @brief
+		 *  The slot of the CPU the thread is running on, so memory use is bounded by the
+		 *  number of CPUs however many threads there are.  On Linux the CPU is read from
+		 *  the thread's registered rseq area when available, falling back to
+		 *  sched_getcpu(), and on Windows from GetCurrentProcessorNumber().  Elsewhere this
+		 *  behaves like Thread.
+		 */
+		Cpu
+	};
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  A number assigned to the calling thread on first use, counting up from zero.
+	 */
+	CONCURRENT_EXPORT size_t threadShardIndex();
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  The CPU the calling thread is running on, or threadShardIndex() where that
+	 *  cannot be determined.
+	 */
+	CONCURRENT_EXPORT size_t cpuShardIndex();
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Common implementation of the sharded statistics: one cache line sized slot per
+	 *  shard, updated with relaxed atomics and summed on read.
+	 */
+	template<typename value_t>
+	class ShardedStatistic
+	{
+	public:
+		ShardedStatistic(const ShardedStatistic&) = delete;
+		ShardedStatistic& operator=(const ShardedStatistic&) = delete;
+
+		/**
+		 * @brief
+		 *  The sum of all slots.  Updates made concurrently with the read may or may not
+		 *  be included.
+		 */
+		value_t value() const
+		{
+			value_t total = 0;
+
+			for (size_t i = 0; i <= mMask; ++i)
+				total += mSlots[i].value.load(std::memory_order_relaxed);
+
+			return total;
+		}
+
+	protected:
+		/**
+		 * @brief
+		 *  The most slots a statistic is given, bounding its memory to 16 KiB.
+		 */
+		static constexpr size_t MaxSlots = 256;
+
+		struct alignas(CacheLineSize) Slot
+		{
+			std::atomic<value_t> value = 0;
+		};
+
+		ShardedStatistic(Sharding sharding)
+			: mSharding(sharding)
+		{
+			size_t wanted = std::max(1u, hardwareConcurrency());
+
+			// Threads are usually more numerous than CPUs, so give them more room before
+			// they start sharing slots.
+			if (Sharding::Thread == sharding)
+				wanted *= 2;
+
+			size_t count = 1;
+
+			while (count < wanted && count < MaxSlots)
+				count *= 2;
+
+			mMask = count - 1;
+			mSlots = std::make_unique<Slot[]>(count);
+		}
+
+		virtual ~ShardedStatistic()
+		{
+		}
+
+		void addLocal(value_t amount)
+		{
+			size_t index = (Sharding::Cpu == mSharding) ? cpuShardIndex() : threadShardIndex();
+			mSlots[index & mMask].value.fetch_add(amount, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief
+		 *  Sets the sum to amount.  Not atomic with respect to concurrent updates, which
+		 *  may be lost.
+		 */
+		void store(value_t amount)
+		{
+			for (size_t i = 1; i <= mMask; ++i)
+				mSlots[i].value.store(0, std::memory_order_relaxed);
+
+			mSlots[0].value.store(amount, std::memory_order_relaxed);
+		}
+
+	private:
+		Sharding mSharding;
+		size_t mMask;
+		std::unique_ptr<Slot[]> mSlots;
+	};
+
+	/**
+	 * @brief
+	 *  A counter that many threads can increment without contending on a shared cache line.
+	 *
+	 *  Each increment goes to a slot of its own chosen by the Sharding policy, and value()
+	 *  sums the slots.  This makes increments about as cheap as to an uncontended atomic,
+	 *  at the cost of a cache line per slot and reads that visit every slot, so it suits
+	 *  statistics that are updated often and read rarely.
+	 */
+	class ShardedCounter : public ShardedStatistic<uint64_t>
+	{
+	public:
+		ShardedCounter(Sharding sharding = Sharding::Thread)
+			: ShardedStatistic<uint64_t>(sharding)
+		{
+		}
+
+		void add(uint64_t amount = 1)
+		{
+			addLocal(amount);
+		}
+
+		ShardedCounter& operator++()
+		{
+			addLocal(1);
+			return *this;
+		}
+
+		ShardedCounter& operator+=(uint64_t amount)
+		{
+			addLocal(amount);
+			return *this;
+		}
+
+		/**
+		 * @brief
+		 *  Sets the count back to zero.  Increments made concurrently may be lost.
+		 */
+		void reset()
+		{
+			store(0);
+		}
+	};
+
+	/**
+	 * @brief
+	 *  A value that many threads can raise and lower without contending on a shared cache
+	 *  line, such as the number of requests in flight.
+	 *
+	 *  Works like ShardedCounter, but individual slots can go negative when one thread
+	 *  raises the gauge and another lowers it, so only the sum is meaningful.
+	 */
+	class ShardedGauge : public ShardedStatistic<int64_t>
+	{
+	public:
+		ShardedGauge(Sharding sharding = Sharding::Thread)
+			: ShardedStatistic<int64_t>(sharding)
+		{
+		}
+
+		void add(int64_t amount)
+		{
+			addLocal(amount);
+		}
+
+		void sub(int64_t amount)
+		{
+			addLocal(-amount);
+		}
+
+		ShardedGauge& operator++()
+		{
+			addLocal(1);
+			return *this;
+		}
+
+		ShardedGauge& operator--()
+		{
+			addLocal(-1);
+			return *this;
+		}
+
+		ShardedGauge& operator+=(int64_t amount)
+		{
+			addLocal(amount);
+			return *this;
+		}
+
+		ShardedGauge& operator-=(int64_t amount)
+		{
+			addLocal(-amount);
+			return *this;
+		}
+
+		/**
+		 * @brief
+		 *  Sets the gauge to amount.  Changes made concurrently may be lost.
+		 */
+		void set(int64_t amount)
+		{
+			store(amount);
+		}
+	};
+}
+
+#endif // _CONCURRENT_SHARDED_COUNTER_H_
@@ -0,0 +1,120 @@
+#ifndef _CONCURRENT_SLAB_RESOURCE_H_
+#define _CONCURRENT_SLAB_RESOURCE_H_
+
+#include "Config.h"
+#include "Mutex.h"
+#include "Concurrent.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  A thread-safe memory resource that hands out fixed-size blocks, such as the nodes of
+	 *  linked containers.
+	 *
+	 *  Blocks are carved out of slabs of at least a page, each owned by one per-thread heap.
+	 *  A thread allocates from its own heap's free list and slabs, and a block freed by the
+	 *  thread that owns it goes straight back on that free list, so neither touches memory
+	 *  shared with other threads.  A block freed by any other thread is pushed onto its
+	 *  owning heap's remote free list with a single compare and swap, and the owner takes
+	 *  the whole remote list back when its own free list runs out.  This suits producer and
+	 *  consumer patterns, where one thread allocates nodes and another frees them.
+	 *
+	 *  When a thread exits, its heaps are kept with their free blocks and adopted by the
+	 *  next thread that needs one.  Slabs are only returned to the upstream resource when
+	 *  the SlabResource is destroyed.
+	 *
+	 *  Requests larger or more strictly aligned than the block size are passed to the
+	 *  upstream resource.  Use std::pmr::polymorphic_allocator to allocate typed objects
+	 *  from a SlabResource.
+	 */
+	class CONCURRENT_EXPORT SlabResource : public std::pmr::memory_resource
+	{
+	public:
+		SlabResource(const SlabResource&) = delete;
+		SlabResource& operator=(const SlabResource&) = delete;
+
+		/**
+		 * @brief
+		 *  Creates a resource for blocks of up to blockSize bytes aligned to blockAlign,
+		 *  which must be a power of two.  Slabs are allocated from upstream.
+		 */
+		SlabResource(size_t blockSize, size_t blockAlign = alignof(std::max_align_t),
+		             std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+		/**
+		 * @brief
+		 *  Returns all slabs to the upstream resource.  Every block must have been
+		 *  deallocated, and no thread may be using the resource.
+		 */
+		virtual ~SlabResource();
+
+		/**
+		 * @brief
+		 *  The largest request served from slabs.
+		 */
+		size_t blockSize() const;
+
+		/**
+		 * @brief
+		 *  The size of each slab requested from upstream.
+		 */
+		size_t slabSize() const;
+
+		std::pmr::memory_resource* upstream() const;
+
+	protected:
+		virtual void* do_allocate(size_t bytes, size_t alignment) override;
+		virtual void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+		virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+	private:
+		struct FreeBlock;
+		struct Slab;
+		struct Heap;
+
+		friend struct ThreadHeaps;
+
+		bool fits(size_t bytes, size_t alignment) const;
+
+		Heap* localHeap();
+		Heap* findLocalHeap() const;
+
+		/**
+		 * @brief
+		 *  Takes a heap abandoned by an exited thread, or makes a new one.
+		 */
+		Heap* adoptHeap();
+
+		void* allocateBlock(Heap* heap);
+		void refill(Heap* heap);
+
+		/**
+		 * @brief
+		 *  Called when the thread owning heap exits.
+		 */
+		void abandon(Heap* heap);
+
+		uint64_t mId;
+
+		size_t mBlockSize;
+		size_t mBlockAlign;
+		size_t mSlabSize;
+		size_t mFirstBlockOffset;
+
+		std::pmr::memory_resource* mUpstream;
+
+		Mutex mLock;
+		std::vector<Heap*> mHeaps;
+		std::vector<Heap*> mAbandonedHeaps;
+		std::vector<Slab*> mSlabs;
+	};
+}
+
+#endif // _CONCURRENT_SLAB_RESOURCE_H_
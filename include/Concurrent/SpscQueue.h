@@ -0,0 +1,340 @@
+#ifndef _CONCURRENT_SPSC_QUEUE_H_
+#define _CONCURRENT_SPSC_QUEUE_H_
+
+#include "Config.h"
+#include "Concurrent.h"
+
+#include <atomic>
+#include <memory_resource>
+#include <optional>
+
+namespace Concurrent
+{
+	/**
+	 * @brief
+	 *  An unbounded queue for exactly one producing thread and one consuming thread.
+	 *
+	 *  Items are kept in a linked list of nodes.  Nodes that the consumer is finished with
+	 *  are recycled by the producer, which keeps a cached copy of the consumer's head so it
+	 *  only reads the shared position when its cache runs out.  Neither push() nor tryPop()
+	 *  perform any read-modify-write atomic operations.
+	 *
+	 *  Only one thread may call push() and only one thread may call tryPop() at a time.
+	 */
+	template<typename T>
+	class SpscQueue
+	{
+	public:
+		SpscQueue(const SpscQueue&) = delete;
+		SpscQueue& operator=(const SpscQueue&) = delete;
+
+		/**
+		 * @brief
+		 *  Creates an empty queue that allocates nodes from resource.
+		 */
+		SpscQueue(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: mResource(resource)
+		{
+			Node* stub = newNode();
+
+			mHead.store(stub, std::memory_order_relaxed);
+			mTail = stub;
+			mFirst = stub;
+			mHeadCopy = stub;
+		}
+
+		virtual ~SpscQueue()
+		{
+			deleteChain(mFirst);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes an item onto the Queue.  Must only be called from the producing thread.
+		 */
+		void push(const T& item)
+		{
+			emplace(item);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes an item onto the Queue.  Must only be called from the producing thread.
+		 */
+		void push(T&& item)
+		{
+			emplace(std::move(item));
+		}
+
+		/**
+		 * @brief
+		 *  Constructs an item in the Queue from the passed arguments.  Must only be
+		 *  called from the producing thread.
+		 */
+		template<typename ...args_t>
+		void emplace(args_t&& ...args)
+		{
+			Node* node = allocNode();
+
+			try
+			{
+				node->item.emplace(std::forward<args_t>(args)...);
+			}
+			catch (...)
+			{
+				recycleNode(node);
+				throw;
+			}
+
+			link(node, node);
+		}
+
+		/**
+		 * @brief
+		 *  Pushes the items in the range [first, last) onto the Queue in order.  Use
+		 *  std::make_move_iterator() to move the items instead of copying them.  The
+		 *  whole batch is published to the consumer with a single store.  Must only be
+		 *  called from the producing thread.
+		 */
+		template<typename iterator_t>
+		void pushBulk(iterator_t first, iterator_t last)
+		{
+			if (first == last)
+				return;
+
+			Node* batchFirst = allocNode();
+			Node* batchLast = batchFirst;
+
+			try
+			{
+				batchFirst->item.emplace(*first);
+
+				for (++first; first != last; ++first)
+				{
+					Node* node = allocNode();
+
+					batchLast->next.store(node, std::memory_order_relaxed);
+					batchLast = node;
+
+					node->item.emplace(*first);
+				}
+			}
+			catch (...)
+			{
+				// Nothing has been published yet, so the partial batch is still private.
+				deleteChain(batchFirst);
+				throw;
+			}
+
+			link(batchFirst, batchLast);
+		}
+
+		/**
+		 * @brief
+		 *  Attempts to pop an item from the Queue, if there is something to
+		 *  de-queue, it is placed in destination and true is returned.
+		 *  Otherwise, destination remains unchanged and false is returned.
+		 *  Must only be called from the consuming thread.
+		 */
+		bool tryPop(T& destination)
+		{
+			Node* next = mHead.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire);
+
+			if (nullptr == next)
+				return false;
+
+			destination = std::move(*next->item);
+			release(next);
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  Attempts to pop an item from the Queue, if there is something to
+		 *  de-queue, it is placed in destination and true is returned.
+		 *  Otherwise, destination remains unchanged and false is returned.
+		 *  Must only be called from the consuming thread.
+		 */
+		bool tryPop(std::optional<T>& destination)
+		{
+			Node* next = mHead.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire);
+
+			if (nullptr == next)
+				return false;
+
+			destination = std::move(next->item);
+			release(next);
+
+			return true;
+		}
+
+		/**
+		 * @brief
+		 *  Pops up to maxCount items from the Queue, writing them to destination in order.
+		 *  The consumed nodes are handed back to the producer with a single store.  Returns
+		 *  the number of items popped.  Must only be called from the consuming thread.
+		 */
+		template<typename output_iterator_t>
+		size_t tryPopBulk(output_iterator_t destination, size_t maxCount)
+		{
+			size_t count = 0;
+			Node* head = mHead.load(std::memory_order_relaxed);
+
+			try
+			{
+				while (count < maxCount)
+				{
+					Node* next = head->next.load(std::memory_order_acquire);
+
+					if (nullptr == next)
+						break;
+
+					*destination = std::move(*next->item);
+					++destination;
+					++count;
+
+					next->item.reset();
+					head = next;
+				}
+			}
+			catch (...)
+			{
+				// The nodes already emptied must not stay ahead of the consumer's position.
+				if (count > 0)
+					mHead.store(head, std::memory_order_release);
+
+				throw;
+			}
+
+			if (count > 0)
+				mHead.store(head, std::memory_order_release);
+
+			return count;
+		}
+
+		/**
+		 * @brief
+		 *  Inspector to determine if the queue is empty.  Must only be called from the
+		 *  producing or consuming thread.
+		 */
+		bool isEmpty() const
+		{
+			return (nullptr == mHead.load(std::memory_order_acquire)->next.load(std::memory_order_acquire));
+		}
+
+		/**
+		 * @brief
+		 *  The size of the blocks the queue allocates, for creating a SlabResource to
+		 *  serve them.
+		 */
+		static constexpr size_t nodeSize()
+		{
+			return sizeof(Node);
+		}
+
+		/**
+		 * @brief
+		 *  The alignment of the blocks the queue allocates.
+		 */
+		static constexpr size_t nodeAlign()
+		{
+			return alignof(Node);
+		}
+
+	private:
+		struct Node
+		{
+			std::atomic<Node*> next;
+			std::optional<T> item;
+
+			Node()
+				: next(nullptr)
+			{
+			}
+		};
+
+		Node* allocNode()
+		{
+			if (mFirst == mHeadCopy)
+				mHeadCopy = mHead.load(std::memory_order_acquire);
+
+			if (mFirst != mHeadCopy)
+			{
+				Node* node = mFirst;
+				mFirst = node->next.load(std::memory_order_relaxed);
+
+				node->next.store(nullptr, std::memory_order_relaxed);
+				return node;
+			}
+
+			return newNode();
+		}
+
+		/**
+		 * @brief
+		 *  Hands a node that was never linked back to the front of the free nodes.
+		 */
+		void recycleNode(Node* node)
+		{
+			node->next.store(mFirst, std::memory_order_relaxed);
+			mFirst = node;
+		}
+
+		Node* newNode()
+		{
+			return new (mResource->allocate(sizeof(Node), alignof(Node))) Node();
+		}
+
+		void deleteNode(Node* node)
+		{
+			node->~Node();
+			mResource->deallocate(node, sizeof(Node), alignof(Node));
+		}
+
+		void deleteChain(Node* node)
+		{
+			while (node)
+			{
+				Node* next = node->next.load(std::memory_order_relaxed);
+				deleteNode(node);
+				node = next;
+			}
+		}
+
+		void link(Node* first, Node* last)
+		{
+			mTail->next.store(first, std::memory_order_release);
+			mTail = last;
+		}
+
+		void release(Node* newHead)
+		{
+			newHead->item.reset();
+			mHead.store(newHead, std::memory_order_release);
+		}
+
+		/**
+		 * @brief
+		 *  The consumer's position.  The node it points to has already been consumed
+		 *  and the next node holds the oldest item.
+		 */
+		alignas(CacheLineSize) std::atomic<Node*> mHead;
+
+		/**
+		 * @brief
+		 *  Producer owned state.  mFirst is the oldest node in the list, and every node
+		 *  before mHeadCopy is free for reuse.
+		 */
+		alignas(CacheLineSize) Node* mTail;
+		Node* mFirst;
+		Node* mHeadCopy;
+
+		std::pmr::memory_resource* mResource;
+	};
+
+	template<typename T>
+	struct IsSingleConsumer< SpscQueue<T> > : std::true_type {};
+}
+
+#endif // _CONCURRENT_SPSC_QUEUE_H_
\ No newline at end of file
@@ -3,8 +3,55 @@
 
 #include "Config.h"
 
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
 namespace Concurrent
 {
+#if !defined(_WIN32)
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  The calling thread's ThreadLocalPtr values, indexed by the index each instance
+	 *  acquires.  It is constant initialized and trivially destructible, so accessing it
+	 *  needs no initialization check.
+	 */
+	struct ThreadSlotTable
+	{
+		void** slots;
+		size_t capacity;
+	};
+
+	inline thread_local ThreadSlotTable threadSlotTable = { nullptr, 0 };
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Returns an unused index into the thread slot tables, reusing released ones first.
+	 */
+	CONCURRENT_EXPORT size_t acquireThreadSlot();
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Clears index in every thread's table and makes it available for reuse.
+	 */
+	CONCURRENT_EXPORT void releaseThreadSlot(size_t index);
+
+	/**
+	 * @internal
+	 *
+	 * @brief
+	 *  Grows the calling thread's table to hold index, registering the table so it is
+	 *  cleared by releaseThreadSlot() and freed when the thread exits.
+	 */
+	CONCURRENT_EXPORT void growThreadSlots(size_t index);
+#endif
+
 	/**
 	 * @brief
 	 *  A pointer that can be set independently for each thread.
@@ -15,6 +62,11 @@ namespace Concurrent
 	 *  since the number of thread local pointers that can be registered per process is limited
 	 *  on some systems.
 	 *
+	 *  Outside of Windows, each instance is given an index into a per-thread table of
+	 *  pointers held in a compiler thread_local, so get() and set() are a few loads and a
+	 *  store rather than a call into the threading library.  Indices are recycled when
+	 *  instances are destroyed.
+	 *
 	 * @todo
 	 *  Determine what happens if a task is swapped out within a thread, like when waiting on a
 	 *  cooperative synchronization primitive.
@@ -23,6 +75,8 @@ namespace Concurrent
 	class ThreadLocalPtr
 	{
 	public:
+		ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+		ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
 
 		/**
 		 * @brief
@@ -75,46 +129,105 @@ namespace Concurrent
 	private:
 #		if defined(_WIN32)
 		DWORD key;
-#		elif defined(__GNUC__)
-		pthread_key_t key;
+#		else
+		size_t index;
 #		endif
 	};
 
+	/**
+	 * @brief
+	 *  A value that each thread has its own copy of, initialized from a default value the
+	 *  first time the thread accesses it.
+	 *
+	 *  Every thread's copy is tracked, so forEach() and combine() can visit all of them,
+	 *  for example to sum per-thread partial results or counters without any contention
+	 *  while they are being updated.  As with TBB's enumerable_thread_specific, the copy of a
+	 *  thread that exits is kept and still visited, so its contribution is not lost.  All
+	 *  copies are destroyed with the ThreadLocal.
+	 *
+	 *  Because exited threads' copies are kept, memory grows with the number of distinct
+	 *  threads that have ever accessed the ThreadLocal, not the number alive.  Prefer
+	 *  long-lived ThreadLocals used from a thread pool over ones touched by a stream of
+	 *  short-lived threads.
+	 */
 	template<typename T>
 	class ThreadLocal
 	{
 	private:
-		ThreadLocalPtr<T> mPtr;
+		struct Entry
+		{
+			T value;
+			Entry* next;
+
+			Entry(const T& defaultValue)
+				: value(defaultValue), next(nullptr)
+			{
+			}
+		};
+
+		mutable ThreadLocalPtr<Entry> mPtr;
+
+		/**
+		 * @brief
+		 *  Every thread's entry.  Entries are only ever pushed until destruction, so the
+		 *  list can be walked without a lock while threads are adding to it.
+		 */
+		mutable std::atomic<Entry*> mEntries;
+
 		T mDefaultValue;
 
-		T* fetchPtr()
+		T* fetchPtr() const
 		{
-			T* ret = mPtr.get();
+			Entry* entry = mPtr.get();
 
-			if (nullptr == ret)
+			if (nullptr == entry)
 			{
-				mPtr.set(new T(mDefaultValue));
-				return mPtr.get();
+				entry = new Entry(mDefaultValue);
+				entry->next = mEntries.load(std::memory_order_relaxed);
+
+				while (false == mEntries.compare_exchange_weak(entry->next, entry, std::memory_order_release, std::memory_order_relaxed));
+
+				mPtr.set(entry);
 			}
 
-			return ret;
+			return &entry->value;
 		}
 
 	public:
+		ThreadLocal(const ThreadLocal&) = delete;
+		ThreadLocal& operator=(const ThreadLocal&) = delete;
+
 		ThreadLocal()
+			: mEntries(nullptr)
 		{
 		}
 
 		ThreadLocal(const T& defaultValue)
-			: mDefaultValue(defaultValue)
+			: mEntries(nullptr), mDefaultValue(defaultValue)
 		{
 		}
 
 		ThreadLocal(T&& defaultValue)
-			: mDefaultValue(std::move(defaultValue))
+			: mEntries(nullptr), mDefaultValue(std::move(defaultValue))
 		{
 		}
 
+		/**
+		 * @brief
+		 *  Destroys every thread's copy.  No thread may be using the ThreadLocal.
+		 */
+		~ThreadLocal()
+		{
+			Entry* entry = mEntries.load(std::memory_order_acquire);
+
+			while (entry)
+			{
+				Entry* next = entry->next;
+				delete entry;
+				entry = next;
+			}
+		}
+
 		T* get()
 		{
 			return fetchPtr();
@@ -122,7 +235,7 @@ namespace Concurrent
 
 		const T* get() const
 		{
-			return const_cast<const T*>(fetchPtr());
+			return fetchPtr();
 		}
 
 		T* operator->()
@@ -144,6 +257,66 @@ namespace Concurrent
 		{
 			return *get();
 		}
+
+		/**
+		 * @brief
+		 *  Calls func with every thread's copy, including those of threads that have
+		 *  exited.  The copies of other threads may be changing while func runs, so they
+		 *  should be of a type that is safe to read concurrently, such as atomics, unless
+		 *  those threads are known to be idle.
+		 */
+		template<typename func_t>
+		void forEach(func_t&& func)
+		{
+			for (Entry* entry = mEntries.load(std::memory_order_acquire); entry; entry = entry->next)
+				func(entry->value);
+		}
+
+		/**
+		 * @brief
+		 *  Calls func with every thread's copy, including those of threads that have exited.
+		 */
+		template<typename func_t>
+		void forEach(func_t&& func) const
+		{
+			for (const Entry* entry = mEntries.load(std::memory_order_acquire); entry; entry = entry->next)
+				func(entry->value);
+		}
+
+		/**
+		 * @brief
+		 *  Folds every thread's copy together with op, which takes two values and returns
+		 *  their combination.  Returns the default value if no thread has a copy.
+		 */
+		template<typename op_t>
+		T combine(op_t&& op) const
+		{
+			const Entry* entry = mEntries.load(std::memory_order_acquire);
+
+			if (nullptr == entry)
+				return mDefaultValue;
+
+			T result(entry->value);
+
+			for (entry = entry->next; entry; entry = entry->next)
+				result = op(result, entry->value);
+
+			return result;
+		}
+
+		/**
+		 * @brief
+		 *  The number of threads that have a copy.
+		 */
+		size_t size() const
+		{
+			size_t count = 0;
+
+			for (const Entry* entry = mEntries.load(std::memory_order_acquire); entry; entry = entry->next)
+				++count;
+
+			return count;
+		}
 	};
 
 #if defined(_WIN32)
@@ -195,40 +368,62 @@ namespace Concurrent
 	{
 		TlsSetValue(key, val);
 	}
-#elif defined(__GNUC__)
+#else
 	template<typename T>
 	ThreadLocalPtr<T>::ThreadLocalPtr()
 	{
-		pthread_key_create(&key, nullptr);
-		pthread_setspecific(key, nullptr);
+		index = acquireThreadSlot();
 	}
 
 	template<typename T>
 	ThreadLocalPtr<T>::~ThreadLocalPtr()
 	{
-		pthread_key_delete(key);
+		releaseThreadSlot(index);
+	}
+
+	template<typename T>
+	ThreadLocalPtr<T>::operator T*()
+	{
+		return get();
 	}
 
 	template<typename T>
-	T& ThreadLocalPtr<T>::operator *()
+	T* ThreadLocalPtr<T>::operator->()
 	{
-		return static_cast<T*>(pthread_getspecific(key));
+		return get();
 	}
 
 	template<typename T>
-	T* ThreadLocalPtr<T>::operator ->()
+	const T* ThreadLocalPtr<T>::operator->() const
 	{
-		return static_cast<T*>(pthread_getspecific(key));
+		return get();
 	}
 
 	template<typename T>
-	ThreadLocalPtr<T>& ThreadLocalPtr<T>::operator=(T* val)
+	const T* ThreadLocalPtr<T>::get() const
 	{
-		pthread_setspecific(key, val);
-		return *this;
+		return (index < threadSlotTable.capacity) ? static_cast<const T*>(threadSlotTable.slots[index]) : nullptr;
+	}
+
+	template<typename T>
+	T* ThreadLocalPtr<T>::get()
+	{
+		return (index < threadSlotTable.capacity) ? static_cast<T*>(threadSlotTable.slots[index]) : nullptr;
+	}
+
+	template<typename T>
+	void ThreadLocalPtr<T>::set(T* val)
+	{
+		if (index >= threadSlotTable.capacity)
+		{
+			if (nullptr == val)
+				return;
+
+			growThreadSlots(index);
+		}
+
+		threadSlotTable.slots[index] = val;
 	}
-#else
-#	error Need to implement ThreadLocalPtr on current platform.
 #endif
 }
 
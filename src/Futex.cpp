@@ -0,0 +1,96 @@
+#include <Concurrent/Internal/Futex.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+	"Futex assumes std::atomic<uint32_t> has the same layout as uint32_t.");
+
+#if defined(_WIN32)
+
+#include <Windows.h>
+
+#include <algorithm>
+
+#pragma comment(lib, "Synchronization.lib")
+
+namespace Concurrent
+{
+	void Futex::wait(std::atomic<uint32_t>* address, uint32_t expected)
+	{
+		WaitOnAddress(address, &expected, sizeof(uint32_t), INFINITE);
+	}
+
+	bool Futex::waitFor(std::atomic<uint32_t>* address, uint32_t expected, std::chrono::milliseconds timeout)
+	{
+		if (timeout.count() <= 0)
+			return false;
+
+		// Stay below INFINITE, which would turn this into an untimed wait.
+		DWORD waitMs = (DWORD)std::min<long long>(timeout.count(), INFINITE - 1);
+
+		if (WaitOnAddress(address, &expected, sizeof(uint32_t), waitMs))
+			return true;
+
+		return (ERROR_TIMEOUT != GetLastError());
+	}
+
+	void Futex::wakeOne(std::atomic<uint32_t>* address)
+	{
+		WakeByAddressSingle(address);
+	}
+
+	void Futex::wakeAll(std::atomic<uint32_t>* address)
+	{
+		WakeByAddressAll(address);
+	}
+}
+
+#elif defined(__linux__)
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <ctime>
+
+namespace Concurrent
+{
+	static long sysFutex(std::atomic<uint32_t>* address, int op, uint32_t val, const timespec* timeout)
+	{
+		return syscall(SYS_futex, reinterpret_cast<uint32_t*>(address), op, val, timeout, nullptr, 0);
+	}
+
+	void Futex::wait(std::atomic<uint32_t>* address, uint32_t expected)
+	{
+		sysFutex(address, FUTEX_WAIT_PRIVATE, expected, nullptr);
+	}
+
+	bool Futex::waitFor(std::atomic<uint32_t>* address, uint32_t expected, std::chrono::milliseconds timeout)
+	{
+		if (timeout.count() <= 0)
+			return false;
+
+		timespec ts;
+		ts.tv_sec = (time_t)(timeout.count() / 1000);
+		ts.tv_nsec = (long)(timeout.count() % 1000) * 1000000;
+
+		if (0 == sysFutex(address, FUTEX_WAIT_PRIVATE, expected, &ts))
+			return true;
+
+		return (ETIMEDOUT != errno);
+	}
+
+	void Futex::wakeOne(std::atomic<uint32_t>* address)
+	{
+		sysFutex(address, FUTEX_WAKE_PRIVATE, 1, nullptr);
+	}
+
+	void Futex::wakeAll(std::atomic<uint32_t>* address)
+	{
+		sysFutex(address, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+	}
+}
+
+#else
+#	error Need to implement Futex on current platform.
+#endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include <Concurrent/Internal/MessageLoopBase.h>
+
+#include <Concurrent/Concurrent.h>
+#include <Concurrent/Scheduler.h>
+
+#include <limits>
+
+namespace Concurrent
+{
+	MessageLoopBase::MessageLoopBase()
+		: mExecution(Execution::Task), mContinue(true), mPending(0)
+	{
+	}
+
+	MessageLoopBase::~MessageLoopBase()
+	{
+	}
+
+	void MessageLoopBase::startLoop(Execution execution)
+	{
+		mExecution = execution;
+
+		switch (execution)
+		{
+		case Execution::Task:
+			mLoopTask.setFunction(std::bind(&MessageLoopBase::loop, this));
+			Scheduler::runAsync(&mLoopTask);
+			break;
+		case Execution::Thread:
+			mLoopTask.setFunction(std::bind(&MessageLoopBase::loop, this));
+			Scheduler::runAsThread(&mLoopTask);
+			break;
+		case Execution::OnDemand:
+			mDrainTracker = std::make_shared<DrainTracker>();
+			break;
+		}
+	}
+
+	void MessageLoopBase::stopLoop()
+	{
+		if (Execution::OnDemand == mExecution)
+		{
+			EventCount& idle = mDrainTracker->idle;
+
+			while (0 != mPending.load(std::memory_order_acquire))
+			{
+				uint32_t key = idle.prepareWait();
+
+				if (0 == mPending.load(std::memory_order_acquire))
+				{
+					idle.cancelWait();
+					break;
+				}
+
+				idle.commitWait(key);
+			}
+		}
+		else
+		{
+			mContinue.store(false, std::memory_order_release);
+			mMessageReady.notifyAll();
+
+			mLoopTask.wait();
+		}
+	}
+
+	void MessageLoopBase::notifyPushed(size_t count)
+	{
+		if (0 == count)
+			return;
+
+		if (Execution::OnDemand == mExecution)
+		{
+			if (0 == mPending.fetch_add(count, std::memory_order_acq_rel))
+				scheduleDrain();
+			else
+				mMessageReady.notifyOne();
+		}
+		else
+		{
+			mMessageReady.notifyOne();
+		}
+	}
+
+	void MessageLoopBase::scheduleDrain()
+	{
+		std::shared_ptr<DrainTracker> tracker = mDrainTracker;
+
+		Scheduler::runAsync([this, tracker]()
+		{
+			// The loop may be gone once drain() returns or throws, so only the tracker
+			// is touched afterwards.
+			try
+			{
+				drain();
+			}
+			catch (...)
+			{
+				tracker->idle.notifyAll();
+				throw;
+			}
+
+			tracker->idle.notifyAll();
+		});
+	}
+
+	void MessageLoopBase::loop()
+	{
+		while (true)
+		{
+			size_t handled;
+
+			do
+			{
+				handled = 0;
+				handleMessages(std::numeric_limits<size_t>::max(), handled);
+			}
+			while (handled > 0);
+
+			if (false == mContinue.load(std::memory_order_acquire))
+			{
+				if (hasMessages())
+					continue;
+
+				return;
+			}
+
+			uint32_t key = mMessageReady.prepareWait();
+
+			// Check again after registering, so a push that found no waiter is
+			// guaranteed to be seen here.
+			if (hasMessages() || false == mContinue.load(std::memory_order_acquire))
+			{
+				mMessageReady.cancelWait();
+				continue;
+			}
+
+			mMessageReady.commitWait(key);
+		}
+	}
+
+	void MessageLoopBase::drain()
+	{
+		size_t remaining = mPending.load(std::memory_order_acquire);
+
+		while (true)
+		{
+			size_t handled = 0;
+
+			try
+			{
+				// Every counted message has been pushed, but in a queue with several
+				// producers an earlier push can still be linking in, which makes the
+				// later ones unreachable until it does.  That push notifies once it has
+				// linked, so after a short spin, park until then.
+				for (uint32_t spins = 0; handled < remaining; ++spins)
+				{
+					size_t before = handled;
+					handleMessages(remaining, handled);
+
+					if (before != handled)
+					{
+						spins = 0;
+					}
+					else if (spins < 64)
+					{
+						spinPause();
+					}
+					else
+					{
+						uint32_t key = mMessageReady.prepareWait();
+
+						if (hasMessages())
+							mMessageReady.cancelWait();
+						else
+							mMessageReady.commitWait(key);
+					}
+				}
+			}
+			catch (...)
+			{
+				// The messages popped are done with, including the one whose handler
+				// threw.  If others are pending, a new drain takes them over, otherwise
+				// the loop may be destroyed as soon as the count reaches zero.
+				if (mPending.fetch_sub(handled, std::memory_order_acq_rel) != handled)
+					scheduleDrain();
+
+				throw;
+			}
+
+			// Once this brings the count to zero the loop may be destroyed, so
+			// nothing after it can touch this object.
+			size_t previous = mPending.fetch_sub(handled, std::memory_order_acq_rel);
+
+			if (previous == handled)
+				return;
+
+			remaining = previous - handled;
+		}
+	}
+}
@@ -0,0 +1,406 @@
+#include <Concurrent/QueueStats.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Concurrent
+{
+	static constexpr size_t SubBucketBits = 3;
+	static constexpr size_t SubBucketCount = 1 << SubBucketBits;
+
+	/**
+	 * @brief
+	 *  Values below this are counted exactly, one bucket each.
+	 */
+	static constexpr uint64_t LinearLimit = 2 * SubBucketCount;
+
+	static size_t highestBit(uint64_t value)
+	{
+		size_t bit = 0;
+
+		while (value >>= 1)
+			++bit;
+
+		return bit;
+	}
+
+	////////////////////////////////////////////
+
+	Histogram::Histogram()
+	{
+		counts.fill(0);
+	}
+
+	size_t Histogram::bucketFor(uint64_t value)
+	{
+		if (value < LinearLimit)
+			return (size_t)value;
+
+		size_t bit = highestBit(value);
+		size_t sub = (size_t)(value >> (bit - SubBucketBits)) & (SubBucketCount - 1);
+
+		return LinearLimit + (bit - SubBucketBits - 1) * SubBucketCount + sub;
+	}
+
+	std::pair<uint64_t, uint64_t> Histogram::bucketRange(size_t bucket)
+	{
+		if (bucket < LinearLimit)
+			return std::make_pair((uint64_t)bucket, (uint64_t)bucket);
+
+		size_t bit = (bucket - LinearLimit) / SubBucketCount + SubBucketBits + 1;
+		size_t sub = (bucket - LinearLimit) % SubBucketCount;
+
+		uint64_t width = (uint64_t)1 << (bit - SubBucketBits);
+		uint64_t low = (SubBucketCount + sub) * width;
+
+		return std::make_pair(low, low + (width - 1));
+	}
+
+	uint64_t Histogram::count() const
+	{
+		uint64_t total = 0;
+
+		for (uint64_t bucketCount : counts)
+			total += bucketCount;
+
+		return total;
+	}
+
+	uint64_t Histogram::percentile(double fraction) const
+	{
+		uint64_t total = count();
+
+		if (0 == total)
+			return 0;
+
+		fraction = std::clamp(fraction, 0.0, 1.0);
+		uint64_t target = std::max<uint64_t>(1, (uint64_t)(fraction * (double)total + 0.5));
+		uint64_t seen = 0;
+
+		for (size_t i = 0; i < BucketCount; ++i)
+		{
+			seen += counts[i];
+
+			if (seen >= target)
+				return bucketRange(i).second;
+		}
+
+		return max();
+	}
+
+	uint64_t Histogram::max() const
+	{
+		for (size_t i = BucketCount; i > 0; --i)
+		{
+			if (0 != counts[i - 1])
+				return bucketRange(i - 1).second;
+		}
+
+		return 0;
+	}
+
+	double Histogram::mean() const
+	{
+		uint64_t total = 0;
+		double sum = 0.0;
+
+		for (size_t i = 0; i < BucketCount; ++i)
+		{
+			if (0 == counts[i])
+				continue;
+
+			auto range = bucketRange(i);
+
+			total += counts[i];
+			sum += (double)counts[i] * ((double)range.first + (double)range.second) / 2.0;
+		}
+
+		return (0 == total) ? 0.0 : sum / (double)total;
+	}
+
+	////////////////////////////////////////////
+
+	/**
+	 * @brief
+	 *  Each thread samples the depth after this many of its pushes to an instance.
+	 */
+	static constexpr uint64_t DepthSampleInterval = 16;
+
+	/**
+	 * @brief
+	 *  The counts of one histogram, written only by the thread that owns them.
+	 */
+	struct alignas(CacheLineSize) RecordedBuckets
+	{
+		std::atomic<uint64_t> counts[Histogram::BucketCount];
+
+		RecordedBuckets()
+		{
+			for (size_t i = 0; i < Histogram::BucketCount; ++i)
+				counts[i].store(0, std::memory_order_relaxed);
+		}
+	};
+
+	/**
+	 * @brief
+	 *  What one thread has recorded into one instance.  Only that thread writes to it, so
+	 *  a count is bumped with a plain load and store rather than a read-modify-write, and
+	 *  the atomics only keep concurrent snapshots well defined.  A thread that only pops
+	 *  never allocates handler times, and one that only pushes allocates neither.
+	 */
+	struct alignas(CacheLineSize) QueueStats::Recorder
+	{
+		Recorder* next = nullptr;
+		uint64_t pushes = 0;
+
+		std::atomic<RecordedBuckets*> latency = nullptr;
+		std::atomic<RecordedBuckets*> handlerTime = nullptr;
+
+		~Recorder()
+		{
+			delete latency.load(std::memory_order_relaxed);
+			delete handlerTime.load(std::memory_order_relaxed);
+		}
+
+		static void bump(std::atomic<RecordedBuckets*>& buckets, uint64_t value)
+		{
+			RecordedBuckets* counts = buckets.load(std::memory_order_relaxed);
+
+			if (nullptr == counts)
+			{
+				counts = new RecordedBuckets();
+				buckets.store(counts, std::memory_order_release);
+			}
+
+			std::atomic<uint64_t>& count = counts->counts[Histogram::bucketFor(value)];
+			count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		static void addTo(Histogram& histogram, const std::atomic<RecordedBuckets*>& buckets)
+		{
+			const RecordedBuckets* counts = buckets.load(std::memory_order_acquire);
+
+			if (nullptr == counts)
+				return;
+
+			for (size_t i = 0; i < Histogram::BucketCount; ++i)
+				histogram.counts[i] += counts->counts[i].load(std::memory_order_relaxed);
+		}
+	};
+
+	/**
+	 * @brief
+	 *  The serials of the instances alive, so threads can drop the registry entries of
+	 *  destroyed ones.  It is never destroyed, since threads may exit, and static
+	 *  QueueStats be destroyed, after other static destruction has run.
+	 */
+	struct LiveStats
+	{
+		std::mutex lock;
+		std::unordered_set<uint64_t> serials;
+		uint64_t nextSerial = 1;
+		std::atomic<uint64_t> destroyed = 0;
+	};
+
+	static LiveStats& liveStats()
+	{
+		static LiveStats* instance = new LiveStats();
+		return *instance;
+	}
+
+	/**
+	 * @brief
+	 *  The calling thread's recorders, keyed by the serial of the instance each belongs
+	 *  to.  The recorders are owned by their instances, so they outlive the thread and
+	 *  its contribution is not lost when it exits.
+	 */
+	struct RecorderRegistry
+	{
+		std::unordered_map<uint64_t, void*> recorders;
+
+		/**
+		 * @brief
+		 *  The count of destroyed instances when entries were last dropped.
+		 */
+		uint64_t destroyedSeen = 0;
+
+		~RecorderRegistry();
+	};
+
+	/**
+	 * @brief
+	 *  The recorder the calling thread used last, checked before the registry.  It is
+	 *  constant initialized and trivially destructible, so it can be read at any point of
+	 *  thread exit, and records there whether the registry is gone.
+	 */
+	struct RecorderCache
+	{
+		uint64_t serial;
+		void* recorder;
+		bool registryDestroyed;
+	};
+
+	static thread_local RecorderRegistry recorderRegistry;
+	static thread_local RecorderCache recorderCache = { 0, nullptr, false };
+
+	RecorderRegistry::~RecorderRegistry()
+	{
+		recorderCache.serial = 0;
+		recorderCache.recorder = nullptr;
+		recorderCache.registryDestroyed = true;
+	}
+
+	QueueStats::QueueStats()
+		: mRecorders(nullptr), mMaxDepth(0)
+	{
+		LiveStats& live = liveStats();
+		std::lock_guard<std::mutex> lock(live.lock);
+
+		mSerial = live.nextSerial++;
+		live.serials.insert(mSerial);
+	}
+
+	QueueStats::~QueueStats()
+	{
+		{
+			LiveStats& live = liveStats();
+			std::lock_guard<std::mutex> lock(live.lock);
+
+			live.serials.erase(mSerial);
+			live.destroyed.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		Recorder* recorder = mRecorders.load(std::memory_order_acquire);
+
+		while (recorder)
+		{
+			Recorder* next = recorder->next;
+			delete recorder;
+			recorder = next;
+		}
+	}
+
+	QueueStats::Recorder* QueueStats::recorder()
+	{
+		if (mSerial == recorderCache.serial)
+			return static_cast<Recorder*>(recorderCache.recorder);
+
+		if (recorderCache.registryDestroyed)
+			return nullptr;
+
+		RecorderRegistry& registry = recorderRegistry;
+		auto found = registry.recorders.find(mSerial);
+		Recorder* result;
+
+		if (found != registry.recorders.end())
+		{
+			result = static_cast<Recorder*>(found->second);
+		}
+		else
+		{
+			LiveStats& live = liveStats();
+
+			// Registering is once per thread and instance, so this is the place to drop
+			// the entries of instances destroyed since the last time.
+			if (live.destroyed.load(std::memory_order_relaxed) != registry.destroyedSeen)
+			{
+				std::lock_guard<std::mutex> lock(live.lock);
+
+				for (auto it = registry.recorders.begin(); it != registry.recorders.end();)
+				{
+					if (0 == live.serials.count(it->first))
+						it = registry.recorders.erase(it);
+					else
+						++it;
+				}
+
+				registry.destroyedSeen = live.destroyed.load(std::memory_order_relaxed);
+			}
+
+			result = new Recorder();
+			result->next = mRecorders.load(std::memory_order_relaxed);
+
+			while (false == mRecorders.compare_exchange_weak(result->next, result, std::memory_order_release, std::memory_order_relaxed));
+
+			registry.recorders.emplace(mSerial, result);
+		}
+
+		recorderCache.serial = mSerial;
+		recorderCache.recorder = result;
+
+		return result;
+	}
+
+	void QueueStats::raiseMaxDepth(int64_t depth)
+	{
+		int64_t maxDepth = mMaxDepth.load(std::memory_order_relaxed);
+
+		while (depth > maxDepth && false == mMaxDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed));
+	}
+
+	int64_t QueueStats::now()
+	{
+		using namespace std::chrono;
+		return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	void QueueStats::onPush(size_t count)
+	{
+		mPushed.add(count);
+		mDepth.add((int64_t)count);
+
+		Recorder* local = recorder();
+
+		if (nullptr == local)
+			return;
+
+		// Summing the depth visits every shard, so it is only sampled now and then.
+		uint64_t before = local->pushes;
+		local->pushes += count;
+
+		if (before / DepthSampleInterval != local->pushes / DepthSampleInterval)
+			raiseMaxDepth(mDepth.value());
+	}
+
+	void QueueStats::onPop(int64_t stamp, int64_t popTime)
+	{
+		// Items pushed before stats were enabled were never counted.
+		if (0 == stamp)
+			return;
+
+		--mDepth;
+
+		Recorder* local = recorder();
+
+		if (local)
+			Recorder::bump(local->latency, (uint64_t)std::max<int64_t>(popTime - stamp, 0));
+	}
+
+	void QueueStats::onHandled(int64_t nanoseconds)
+	{
+		Recorder* local = recorder();
+
+		if (local)
+			Recorder::bump(local->handlerTime, (uint64_t)std::max<int64_t>(nanoseconds, 0));
+	}
+
+	QueueStats::Snapshot QueueStats::snapshot() const
+	{
+		Snapshot result;
+
+		result.depth = std::max<int64_t>(mDepth.value(), 0);
+		result.maxDepth = std::max(mMaxDepth.load(std::memory_order_relaxed), result.depth);
+		result.pushed = mPushed.value();
+
+		for (const Recorder* recorder = mRecorders.load(std::memory_order_acquire); recorder; recorder = recorder->next)
+		{
+			Recorder::addTo(result.latency, recorder->latency);
+			Recorder::addTo(result.handlerTime, recorder->handlerTime);
+		}
+
+		return result;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include <Concurrent/Select.h>
+
+namespace Concurrent
+{
+	Select::Select()
+		: mNext(0)
+	{
+	}
+
+	Select::~Select()
+	{
+		for (auto& producer : mProducers)
+			producer->removeListener(&mReady);
+	}
+
+	size_t Select::size() const
+	{
+		return mProducers.size();
+	}
+
+	size_t Select::wait()
+	{
+		return waitUntil(nullptr);
+	}
+
+	size_t Select::tryWait()
+	{
+		bool allEnded;
+		return findReady(allEnded);
+	}
+
+	size_t Select::addInternal(std::shared_ptr<ProducerInternalBase> producer)
+	{
+		producer->addListener(&mReady);
+		mProducers.push_back(std::move(producer));
+
+		return mProducers.size() - 1;
+	}
+
+	size_t Select::waitUntil(const std::chrono::steady_clock::time_point* deadline)
+	{
+		while (true)
+		{
+			bool allEnded;
+			size_t ready = findReady(allEnded);
+
+			if (npos != ready || allEnded)
+				return ready;
+
+			uint32_t key = mReady.prepareWait();
+
+			ready = findReady(allEnded);
+
+			if (npos != ready || allEnded)
+			{
+				mReady.cancelWait();
+				return ready;
+			}
+
+			if (nullptr == deadline)
+			{
+				mReady.commitWait(key);
+			}
+			else if (false == mReady.commitWaitUntil(key, *deadline))
+			{
+				return findReady(allEnded);
+			}
+		}
+	}
+
+	size_t Select::findReady(bool& allEnded)
+	{
+		size_t count = mProducers.size();
+		allEnded = true;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t index = (mNext + i) % count;
+			ProducerInternalBase* producer = mProducers[index].get();
+
+			// Check the end flag first, so a producer that ends right after
+			// the emptiness check is not mistaken as finished with items left.
+			bool ended = producer->endCalled.load(std::memory_order_acquire);
+
+			if (producer->hasMessages())
+			{
+				mNext = (index + 1) % count;
+				return index;
+			}
+
+			allEnded = allEnded && ended;
+		}
+
+		return npos;
+	}
+}
\ No newline at end of file
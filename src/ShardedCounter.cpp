@@ -0,0 +1,57 @@
+#include <Concurrent/ShardedCounter.h>
+
+#include <atomic>
+
+#if defined(_WIN32)
+#	include <Windows.h>
+#elif defined(__linux__)
+#	include <sched.h>
+#	if defined(__has_include)
+#		if __has_include(<sys/rseq.h>)
+#			include <sys/rseq.h>
+#			define CONCURRENT_HAVE_RSEQ
+#		endif
+#	endif
+#endif
+
+namespace Concurrent
+{
+	static std::atomic<size_t> nextThreadShard(0);
+
+	size_t threadShardIndex()
+	{
+		thread_local size_t index = nextThreadShard.fetch_add(1, std::memory_order_relaxed);
+		return index;
+	}
+
+	size_t cpuShardIndex()
+	{
+#if defined(_WIN32)
+		return GetCurrentProcessorNumber();
+#else
+#	if defined(CONCURRENT_HAVE_RSEQ)
+		// glibc registers an rseq area for every thread, which the kernel keeps updated
+		// with the current CPU, so reading it avoids even the vDSO call.
+		if (0 != __rseq_size)
+		{
+			const struct rseq* area = reinterpret_cast<const struct rseq*>(
+				static_cast<const char*>(__builtin_thread_pointer()) + __rseq_offset);
+
+			int32_t cpu = (int32_t)__atomic_load_n(&area->cpu_id, __ATOMIC_RELAXED);
+
+			if (cpu >= 0)
+				return (size_t)cpu;
+		}
+#	endif
+
+#	if defined(__linux__)
+		int cpu = sched_getcpu();
+
+		if (cpu >= 0)
+			return (size_t)cpu;
+#	endif
+
+		return threadShardIndex();
+#endif
+	}
+}
@@ -0,0 +1,378 @@
+#include <Concurrent/SlabResource.h>
+
+#include <Concurrent/MutexLocker.h>
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+#include <unordered_map>
+#include <utility>
+
+namespace Concurrent
+{
+	static constexpr size_t PageSize = 4096;
+
+	/**
+	 * @brief
+	 *  The fewest blocks a slab is made to hold, growing it beyond a page if needed.
+	 */
+	static constexpr size_t MinBlocksPerSlab = 8;
+
+	static size_t roundUp(size_t value, size_t multiple)
+	{
+		return (value + multiple - 1) / multiple * multiple;
+	}
+
+	/**
+	 * @brief
+	 *  The live resources by id.  Ids are never reused, so a thread can tell whether a
+	 *  resource it has a heap for still exists when it exits.  The registry is never
+	 *  destroyed, since threads may exit after static destruction.
+	 */
+	struct Registry
+	{
+		Mutex lock;
+		std::unordered_map<uint64_t, SlabResource*> resources;
+		uint64_t nextId = 1;
+	};
+
+	static Registry& registry()
+	{
+		static Registry* instance = new Registry();
+		return *instance;
+	}
+
+	////////////////////////////////////////////
+
+	struct SlabResource::FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	/**
+	 * @brief
+	 *  The header at the start of each slab.  Slabs are aligned to their size, so the
+	 *  slab of a block is found by masking its address.
+	 */
+	struct SlabResource::Slab
+	{
+		Heap* owner;
+	};
+
+	struct alignas(CacheLineSize) SlabResource::Heap
+	{
+		/**
+		 * @brief
+		 *  Only used by the owning thread.
+		 */
+		FreeBlock* localFree = nullptr;
+		char* bump = nullptr;
+		char* bumpEnd = nullptr;
+
+		/**
+		 * @brief
+		 *  Blocks freed by other threads.  Other threads only push, and the owner takes
+		 *  the whole list at once, so there is no ABA problem.
+		 */
+		alignas(CacheLineSize) std::atomic<FreeBlock*> remoteFree = nullptr;
+	};
+
+	/**
+	 * @brief
+	 *  Set once the current thread's ThreadHeaps has been destroyed.  Being trivially
+	 *  destructible, it can still be read by the destructors of thread locals that run
+	 *  after that one, which may free or allocate blocks as the thread exits.
+	 */
+	static thread_local bool threadHeapsDestroyed = false;
+
+	/**
+	 * @brief
+	 *  The heaps the current thread owns, by resource id.
+	 */
+	struct ThreadHeaps
+	{
+		uint64_t lastId = 0;
+		SlabResource::Heap* lastHeap = nullptr;
+
+		std::vector< std::pair<uint64_t, SlabResource::Heap*> > heaps;
+
+		~ThreadHeaps()
+		{
+			threadHeapsDestroyed = true;
+
+			Registry& reg = registry();
+			MutexLocker lock(&reg.lock);
+
+			for (auto& entry : heaps)
+			{
+				auto found = reg.resources.find(entry.first);
+
+				if (found != reg.resources.end())
+					found->second->abandon(entry.second);
+			}
+		}
+
+		SlabResource::Heap* find(uint64_t id)
+		{
+			if (id == lastId)
+				return lastHeap;
+
+			for (auto& entry : heaps)
+			{
+				if (entry.first == id)
+				{
+					lastId = id;
+					lastHeap = entry.second;
+
+					return lastHeap;
+				}
+			}
+
+			return nullptr;
+		}
+
+		/**
+		 * @brief
+		 *  Drops the entries of resources that have since been destroyed, so a thread
+		 *  that outlives many short-lived resources does not keep an entry for each.
+		 */
+		void prune()
+		{
+			Registry& reg = registry();
+			MutexLocker lock(&reg.lock);
+
+			auto removed = std::remove_if(heaps.begin(), heaps.end(),
+				[&](const std::pair<uint64_t, SlabResource::Heap*>& entry)
+				{
+					return (reg.resources.end() == reg.resources.find(entry.first));
+				});
+
+			heaps.erase(removed, heaps.end());
+
+			lastId = 0;
+			lastHeap = nullptr;
+		}
+	};
+
+	static thread_local ThreadHeaps threadHeaps;
+
+	////////////////////////////////////////////
+
+	SlabResource::SlabResource(size_t blockSize, size_t blockAlign, std::pmr::memory_resource* upstream)
+		: mUpstream(upstream)
+	{
+		assert(0 != blockAlign && 0 == (blockAlign & (blockAlign - 1)));
+
+		mBlockAlign = std::max(blockAlign, alignof(FreeBlock));
+		mBlockSize = roundUp(std::max(blockSize, sizeof(FreeBlock)), mBlockAlign);
+		mFirstBlockOffset = roundUp(sizeof(Slab), mBlockAlign);
+
+		mSlabSize = PageSize;
+
+		while (mSlabSize < mFirstBlockOffset + MinBlocksPerSlab * mBlockSize)
+			mSlabSize *= 2;
+
+		Registry& reg = registry();
+		MutexLocker lock(&reg.lock);
+
+		mId = reg.nextId++;
+		reg.resources[mId] = this;
+	}
+
+	SlabResource::~SlabResource()
+	{
+		{
+			Registry& reg = registry();
+			MutexLocker lock(&reg.lock);
+
+			reg.resources.erase(mId);
+		}
+
+		for (Slab* slab : mSlabs)
+			mUpstream->deallocate(slab, mSlabSize, mSlabSize);
+
+		for (Heap* heap : mHeaps)
+			delete heap;
+	}
+
+	size_t SlabResource::blockSize() const
+	{
+		return mBlockSize;
+	}
+
+	size_t SlabResource::slabSize() const
+	{
+		return mSlabSize;
+	}
+
+	std::pmr::memory_resource* SlabResource::upstream() const
+	{
+		return mUpstream;
+	}
+
+	bool SlabResource::fits(size_t bytes, size_t alignment) const
+	{
+		return (bytes <= mBlockSize && alignment <= mBlockAlign);
+	}
+
+	SlabResource::Heap* SlabResource::findLocalHeap() const
+	{
+		// A thread whose heaps are gone owns none, so it frees through the remote path.
+		if (threadHeapsDestroyed)
+			return nullptr;
+
+		return threadHeaps.find(mId);
+	}
+
+	SlabResource::Heap* SlabResource::adoptHeap()
+	{
+		MutexLocker lock(&mLock);
+
+		if (false == mAbandonedHeaps.empty())
+		{
+			Heap* heap = mAbandonedHeaps.back();
+			mAbandonedHeaps.pop_back();
+
+			return heap;
+		}
+
+		Heap* heap = new Heap();
+		mHeaps.push_back(heap);
+
+		return heap;
+	}
+
+	SlabResource::Heap* SlabResource::localHeap()
+	{
+		Heap* heap = threadHeaps.find(mId);
+
+		if (heap)
+			return heap;
+
+		heap = adoptHeap();
+
+		// Only done when a thread first uses a resource, so the lookup stays lock free.
+		threadHeaps.prune();
+		threadHeaps.heaps.emplace_back(mId, heap);
+		threadHeaps.lastId = mId;
+		threadHeaps.lastHeap = heap;
+
+		return heap;
+	}
+
+	void SlabResource::abandon(Heap* heap)
+	{
+		MutexLocker lock(&mLock);
+		mAbandonedHeaps.push_back(heap);
+	}
+
+	void SlabResource::refill(Heap* heap)
+	{
+		// Blocks freed by other threads are reused before carving new ones.
+		FreeBlock* remote = heap->remoteFree.exchange(nullptr, std::memory_order_acquire);
+
+		if (remote)
+		{
+			heap->localFree = remote;
+			return;
+		}
+
+		Slab* slab = static_cast<Slab*>(mUpstream->allocate(mSlabSize, mSlabSize));
+		slab->owner = heap;
+
+		{
+			MutexLocker lock(&mLock);
+			mSlabs.push_back(slab);
+		}
+
+		heap->bump = reinterpret_cast<char*>(slab) + mFirstBlockOffset;
+		heap->bumpEnd = reinterpret_cast<char*>(slab) + mSlabSize;
+	}
+
+	void* SlabResource::allocateBlock(Heap* heap)
+	{
+		while (true)
+		{
+			if (heap->localFree)
+			{
+				FreeBlock* block = heap->localFree;
+				heap->localFree = block->next;
+
+				return block;
+			}
+
+			if (heap->bumpEnd - heap->bump >= (ptrdiff_t)mBlockSize)
+			{
+				void* block = heap->bump;
+				heap->bump += mBlockSize;
+
+				return block;
+			}
+
+			refill(heap);
+		}
+	}
+
+	void* SlabResource::do_allocate(size_t bytes, size_t alignment)
+	{
+		if (false == fits(bytes, alignment))
+			return mUpstream->allocate(bytes, alignment);
+
+		if (threadHeapsDestroyed)
+		{
+			// The thread is exiting and has handed back its heaps, so it borrows one for
+			// this block and hands it straight back.
+			Heap* heap = adoptHeap();
+			void* block;
+
+			try
+			{
+				block = allocateBlock(heap);
+			}
+			catch (...)
+			{
+				abandon(heap);
+				throw;
+			}
+
+			abandon(heap);
+			return block;
+		}
+
+		return allocateBlock(localHeap());
+	}
+
+	void SlabResource::do_deallocate(void* p, size_t bytes, size_t alignment)
+	{
+		if (false == fits(bytes, alignment))
+		{
+			mUpstream->deallocate(p, bytes, alignment);
+			return;
+		}
+
+		Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(mSlabSize - 1));
+		Heap* owner = slab->owner;
+		FreeBlock* block = static_cast<FreeBlock*>(p);
+
+		if (owner == findLocalHeap())
+		{
+			block->next = owner->localFree;
+			owner->localFree = block;
+
+			return;
+		}
+
+		FreeBlock* head = owner->remoteFree.load(std::memory_order_relaxed);
+
+		do
+		{
+			block->next = head;
+		}
+		while (false == owner->remoteFree.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	bool SlabResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+	{
+		return (this == &other);
+	}
+}
@@ -0,0 +1,120 @@
+#include <Concurrent/ThreadLocal.h>
+
+#if !defined(_WIN32)
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace Concurrent
+{
+	static constexpr size_t MinSlotCapacity = 16;
+
+	/**
+	 * @brief
+	 *  Index allocation and the tables of all live threads.  It is never destroyed, since
+	 *  threads may exit, and static ThreadLocalPtr objects be destroyed, after other
+	 *  static destruction has run.
+	 */
+	struct SlotRegistry
+	{
+		std::mutex lock;
+		std::vector<size_t> freeIndices;
+		size_t nextIndex = 0;
+		std::vector<ThreadSlotTable*> tables;
+	};
+
+	static SlotRegistry& slotRegistry()
+	{
+		static SlotRegistry* instance = new SlotRegistry();
+		return *instance;
+	}
+
+	/**
+	 * @brief
+	 *  Unregisters and frees the calling thread's table when the thread exits.
+	 */
+	struct ThreadSlotCleanup
+	{
+		bool registered = false;
+
+		~ThreadSlotCleanup()
+		{
+			if (false == registered)
+				return;
+
+			SlotRegistry& registry = slotRegistry();
+
+			{
+				std::lock_guard<std::mutex> lock(registry.lock);
+				registry.tables.erase(std::find(registry.tables.begin(), registry.tables.end(), &threadSlotTable));
+			}
+
+			delete[] threadSlotTable.slots;
+
+			threadSlotTable.slots = nullptr;
+			threadSlotTable.capacity = 0;
+		}
+	};
+
+	static thread_local ThreadSlotCleanup threadSlotCleanup;
+
+	size_t acquireThreadSlot()
+	{
+		SlotRegistry& registry = slotRegistry();
+		std::lock_guard<std::mutex> lock(registry.lock);
+
+		if (false == registry.freeIndices.empty())
+		{
+			size_t index = registry.freeIndices.back();
+			registry.freeIndices.pop_back();
+
+			return index;
+		}
+
+		return registry.nextIndex++;
+	}
+
+	void releaseThreadSlot(size_t index)
+	{
+		SlotRegistry& registry = slotRegistry();
+		std::lock_guard<std::mutex> lock(registry.lock);
+
+		// A later instance given this index must start out null on every thread.
+		for (ThreadSlotTable* table : registry.tables)
+		{
+			if (index < table->capacity)
+				table->slots[index] = nullptr;
+		}
+
+		registry.freeIndices.push_back(index);
+	}
+
+	void growThreadSlots(size_t index)
+	{
+		size_t capacity = std::max(MinSlotCapacity, threadSlotTable.capacity);
+
+		while (capacity <= index)
+			capacity *= 2;
+
+		void** slots = new void*[capacity]();
+
+		SlotRegistry& registry = slotRegistry();
+		std::lock_guard<std::mutex> lock(registry.lock);
+
+		// Under the lock, since releaseThreadSlot() may be writing to the old table.
+		std::copy(threadSlotTable.slots, threadSlotTable.slots + threadSlotTable.capacity, slots);
+		delete[] threadSlotTable.slots;
+
+		threadSlotTable.slots = slots;
+		threadSlotTable.capacity = capacity;
+
+		if (false == threadSlotCleanup.registered)
+		{
+			registry.tables.push_back(&threadSlotTable);
+			threadSlotCleanup.registered = true;
+		}
+	}
+}
+
+#endif // !_WIN32
@@ -0,0 +1,167 @@
+/**
+ * Stress test for ActorPool, with several threads pushing to many keys while another
+ * keeps moving keys between shards.
+ *
+ * Each key is pushed to by one producer, with sequence numbers.  The test checks that
+ * every message is handled once, that a key's messages are handled in the order pushed
+ * and never two at a time, however often the key moves, and that destroying the pool
+ * handles every message already pushed, for each Execution.  With a shard held up, it
+ * checks that a move holds back new messages for the key until the old shard has handled
+ * what it had, that a second move is refused meanwhile, and that queue depths and
+ * shardOf() report what is expected.
+ *
+ * ActorPool uses Concurrent::RWLock and runs on the Scheduler, so this builds where the
+ * rest of the library does.  From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\ActorPoolStress.cpp src\*.cpp
+ *
+ * Usage: ActorPoolStress [messages per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/ActorPool.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace Concurrent;
+
+typedef MessageLoopBase::Execution Execution;
+
+static void moving(Execution execution, const char* name, uint64_t perProducer)
+{
+	const int Producers = 3;
+	const int Keys = 64;
+	const size_t Shards = 3;
+
+	std::vector<int64_t> last(Keys, -1);
+	std::vector< std::atomic<int> > busy(Keys);
+	std::atomic<uint64_t> handled(0);
+	std::atomic<int> pushing(Producers);
+	Watchdog watchdog(handled);
+
+	{
+		ActorPool<int, int64_t> pool([&](const int& key, const int64_t& sequence)
+		{
+			CHECK(key >= 0 && key < Keys);
+			CHECK(0 == busy[key].fetch_add(1));
+
+			CHECK(sequence == last[key] + 1);
+			last[key] = sequence;
+
+			busy[key].fetch_sub(1);
+			handled.fetch_add(1);
+		}, Shards, execution);
+
+		CHECK(Shards == pool.shardCount());
+
+		runThreads(Producers + 1, [&](int index)
+		{
+			if (index == Producers)
+			{
+				// Keep moving keys around, including back to their home shards.
+				for (uint64_t i = 0; pushing.load() > 0; ++i)
+				{
+					pool.moveKey((int)(i * 7 % Keys), (size_t)(i / 3 % Shards));
+
+					if (i % 16 == 0)
+						std::this_thread::yield();
+				}
+
+				return;
+			}
+
+			std::vector<int64_t> sequences(Keys, 0);
+
+			for (uint64_t i = 0; i < perProducer; ++i)
+			{
+				// Each key belongs to one producer, so its sequence is in push order.
+				int key = (int)(i % (Keys / Producers)) * Producers + index;
+
+				pool.push(key, sequences[key]++);
+			}
+
+			pushing.fetch_sub(1);
+		});
+	}
+
+	// The destructor handles everything pushed before it.
+	CHECK(handled.load() == Producers * perProducer);
+	std::printf("%s ok\n", name);
+}
+
+static void heldBack()
+{
+	std::vector<int> seen;
+	std::atomic<uint64_t> handled(0);
+	std::atomic<bool> entered(false);
+	std::atomic<bool> release(false);
+
+	{
+		ActorPool<int, int> pool([&](const int&, const int& value)
+		{
+			entered.store(true);
+
+			while (false == release.load())
+				std::this_thread::yield();
+
+			seen.push_back(value);
+			handled.fetch_add(1);
+		}, 2, Execution::Thread);
+
+		size_t home = pool.shardOf(0);
+		size_t other = 1 - home;
+
+		CHECK(home < 2);
+		CHECK(false == pool.moveKey(0, 2));
+		CHECK(pool.moveKey(0, home));
+
+		pool.push(0, 0);
+
+		while (false == entered.load())
+			std::this_thread::yield();
+
+		pool.push(0, 1);
+		CHECK(2 == pool.shardDepth(home));
+
+		// The move waits for the home shard to get through 0 and 1, so 2 and 3 are
+		// held back rather than queued on the other shard.
+		CHECK(pool.moveKey(0, other));
+		CHECK(other == pool.shardOf(0));
+		CHECK(false == pool.moveKey(0, home));
+
+		pool.push(0, 2);
+		pool.push(0, 3);
+
+		CHECK(0 == pool.shardDepth(other));
+		CHECK(std::vector<size_t>({ 2, 0 }) == pool.shardDepths() ||
+		      std::vector<size_t>({ 0, 2 }) == pool.shardDepths());
+
+		release.store(true);
+
+		while (handled.load() < 4)
+			std::this_thread::yield();
+
+		// Every held message has been handled, so the move is complete.
+		CHECK(pool.moveKey(0, home));
+		CHECK(home == pool.shardOf(0));
+
+		pool.push(0, 4);
+	}
+
+	CHECK(std::vector<int>({ 0, 1, 2, 3, 4 }) == seen);
+	std::printf("held back ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	moving(Execution::Task, "task", count);
+	moving(Execution::Thread, "thread", count);
+	moving(Execution::OnDemand, "on demand", count);
+	heldBack();
+
+	return 0;
+}
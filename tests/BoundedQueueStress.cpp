@@ -0,0 +1,294 @@
+/**
+ * Stress test for BoundedQueue with several producers and consumers on a small ring, so
+ * pushes regularly find it full and pops find it empty.
+ *
+ * Each item carries its producer and sequence number.  The test checks that every item is
+ * popped exactly once and that each consumer sees every producer's items in the order they
+ * were pushed, through the blocking, trying and bulk paths.  Copies that throw, on the way
+ * in or out, must leave the ring usable rather than stalled at the slot they would have used.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude tests/BoundedQueueStress.cpp src/Futex.cpp src/Concurrent.cpp
+ *
+ * Adding -fsanitize=thread is recommended.
+ *
+ * Usage: BoundedQueueStress [items per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/BoundedQueue.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+using namespace Concurrent;
+
+static constexpr int Producers = 3;
+static constexpr int Consumers = 3;
+static constexpr size_t Capacity = 64;
+
+typedef BoundedQueue<uint64_t, Capacity> queue_t;
+
+static uint64_t makeItem(uint64_t producer, uint64_t sequence)
+{
+	return (producer << 32) | sequence;
+}
+
+/**
+ * Tracks what one consumer has seen, and checks each producer's items arrive in order.
+ */
+struct Seen
+{
+	std::vector<int64_t> last = std::vector<int64_t>(Producers, -1);
+
+	void add(uint64_t item, std::vector< std::atomic<uint8_t> >& popped, uint64_t perProducer)
+	{
+		uint64_t producer = item >> 32;
+		int64_t sequence = (int64_t)(item & 0xFFFFFFFF);
+
+		CHECK(producer < Producers);
+		CHECK(sequence > last[producer]);
+		last[producer] = sequence;
+
+		CHECK(0 == popped[producer * perProducer + sequence].fetch_add(1));
+	}
+};
+
+template<typename push_t, typename pop_t>
+static void run(uint64_t perProducer, push_t&& push, pop_t&& pop)
+{
+	queue_t queue;
+	uint64_t total = perProducer * Producers;
+
+	std::vector< std::atomic<uint8_t> > popped(total);
+	std::atomic<uint64_t> consumed(0);
+
+	runThreads(Producers + Consumers, [&](int index)
+	{
+		if (index < Producers)
+		{
+			push(queue, (uint64_t)index, perProducer);
+		}
+		else
+		{
+			Seen seen;
+
+			while (consumed.load() < total)
+			{
+				size_t count = pop(queue, seen, popped, perProducer);
+				consumed.fetch_add(count);
+			}
+		}
+	});
+
+	CHECK(queue.isEmpty());
+
+	for (uint64_t i = 0; i < total; ++i)
+		CHECK(1 == popped[i].load());
+}
+
+/**
+ * Throws from its copy constructor while armed.  Moves never throw.
+ */
+struct Fragile
+{
+	static bool armed;
+
+	int value;
+
+	Fragile(int v)
+		: value(v)
+	{
+	}
+
+	Fragile(const Fragile& other)
+		: value(other.value)
+	{
+		if (armed)
+			throw std::runtime_error("copy failed");
+	}
+
+	Fragile(Fragile&&) noexcept = default;
+	Fragile& operator=(Fragile&&) noexcept = default;
+};
+
+bool Fragile::armed = false;
+
+/**
+ * An output iterator that throws on the write numbered by throwAt.
+ */
+struct FailingOutput
+{
+	std::vector<int>* out;
+	int throwAt;
+
+	FailingOutput& operator*() { return *this; }
+	FailingOutput& operator++() { return *this; }
+
+	FailingOutput& operator=(Fragile&& item)
+	{
+		if (0 == throwAt--)
+			throw std::runtime_error("write failed");
+
+		out->push_back(item.value);
+		return *this;
+	}
+};
+
+static void throwing()
+{
+	BoundedQueue<Fragile, 4> queue;
+	std::vector<Fragile> items = { 0, 1, 2, 3 };
+
+	// Run several laps, so a stranded slot would be reached again.
+	for (int lap = 0; lap < 3; ++lap)
+	{
+		Fragile::armed = true;
+
+		bool threw = false;
+
+		try
+		{
+			queue.tryPush(items[0]);
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+
+		CHECK(threw);
+		threw = false;
+
+		try
+		{
+			queue.tryPushBulk(items.begin(), items.end());
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+
+		CHECK(threw);
+		CHECK(queue.isEmpty());
+
+		Fragile::armed = false;
+		CHECK(4 == queue.tryPushBulk(items.begin(), items.end()));
+
+		// The write of the third item fails, so it and the fourth are dropped.
+		std::vector<int> out;
+		threw = false;
+
+		try
+		{
+			queue.tryPopBulk(FailingOutput{ &out, 2 }, 4);
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+
+		CHECK(threw);
+		CHECK(out == std::vector<int>({ 0, 1 }));
+		CHECK(queue.isEmpty());
+	}
+
+	std::printf("throwing ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t perProducer = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	// Blocking push against pops that time out, so consumers notice the end.
+	run(perProducer,
+		[](queue_t& queue, uint64_t producer, uint64_t count)
+		{
+			for (uint64_t i = 0; i < count; ++i)
+				queue.push(makeItem(producer, i));
+		},
+		[](queue_t& queue, Seen& seen, std::vector< std::atomic<uint8_t> >& popped, uint64_t perProducer) -> size_t
+		{
+			uint64_t item;
+
+			if (false == queue.popFor(item, std::chrono::milliseconds(1)))
+				return 0;
+
+			seen.add(item, popped, perProducer);
+			return 1;
+		});
+
+	std::printf("blocking ok\n");
+
+	// Non-blocking push and pop, spinning when full or empty.
+	run(perProducer,
+		[](queue_t& queue, uint64_t producer, uint64_t count)
+		{
+			for (uint64_t i = 0; i < count; ++i)
+			{
+				while (false == queue.tryPush(makeItem(producer, i)))
+					std::this_thread::yield();
+			}
+		},
+		[](queue_t& queue, Seen& seen, std::vector< std::atomic<uint8_t> >& popped, uint64_t perProducer) -> size_t
+		{
+			std::optional<uint64_t> item;
+
+			if (false == queue.tryPop(item))
+			{
+				std::this_thread::yield();
+				return 0;
+			}
+
+			seen.add(*item, popped, perProducer);
+			return 1;
+		});
+
+	std::printf("trying ok\n");
+
+	// Bulk push and pop in uneven batch sizes, so batches straddle the end of the ring.
+	run(perProducer,
+		[](queue_t& queue, uint64_t producer, uint64_t count)
+		{
+			std::vector<uint64_t> batch;
+			uint64_t next = 0;
+
+			while (next < count)
+			{
+				batch.clear();
+
+				for (uint64_t i = next; i < count && batch.size() < 1 + (next % 13); ++i)
+					batch.push_back(makeItem(producer, i));
+
+				size_t pushed = queue.tryPushBulk(batch.begin(), batch.end());
+				next += pushed;
+
+				if (0 == pushed)
+					std::this_thread::yield();
+			}
+		},
+		[](queue_t& queue, Seen& seen, std::vector< std::atomic<uint8_t> >& popped, uint64_t perProducer) -> size_t
+		{
+			std::vector<uint64_t> items;
+			size_t count = queue.tryPopBulk(std::back_inserter(items), 17);
+
+			for (uint64_t item : items)
+				seen.add(item, popped, perProducer);
+
+			if (0 == count)
+				std::this_thread::yield();
+
+			return count;
+		});
+
+	std::printf("bulk ok\n");
+
+	throwing();
+
+	return 0;
+}
@@ -0,0 +1,265 @@
+/**
+ * Stress test for Broadcast with several publishers and subscribers.
+ *
+ * Under the Block policy every subscriber must see every item exactly once, with each
+ * publisher's items in the order they were published.  Under the Drop policy a subscriber
+ * that stops reading must be dropped while one that keeps up is not.  A subscriber must
+ * also not be dropped when the only items it is missing are claimed by a publisher that
+ * has not finished writing them.
+ *
+ * Broadcast uses Concurrent::RWLock, so this builds where the rest of the library does.
+ * From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\BroadcastStress.cpp src\*.cpp
+ *
+ * Usage: BroadcastStress [items per publisher]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/Broadcast.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace Concurrent;
+
+static uint64_t makeItem(uint64_t publisher, uint64_t sequence)
+{
+	return (publisher << 32) | sequence;
+}
+
+static void blocking(uint64_t perPublisher)
+{
+	const int Publishers = 3;
+	const int Subscribers = 3;
+
+	Broadcast<uint64_t> channel(64);
+	std::vector< std::unique_ptr<Broadcast<uint64_t>::Subscription> > subscriptions;
+
+	for (int i = 0; i < Subscribers; ++i)
+		subscriptions.emplace_back(new Broadcast<uint64_t>::Subscription(channel));
+
+	std::atomic<uint64_t> read(0);
+	std::atomic<int> publishing(Publishers);
+	Watchdog watchdog(read);
+
+	runThreads(Publishers + Subscribers, [&](int index)
+	{
+		if (index < Publishers)
+		{
+			for (uint64_t i = 0; i < perPublisher; ++i)
+			{
+				uint64_t item = makeItem(index, i);
+
+				if (i % 2 == 0)
+				{
+					CHECK(channel.publish(item));
+				}
+				else
+				{
+					while (false == channel.tryPublish(item))
+						std::this_thread::yield();
+				}
+			}
+
+			if (1 == publishing.fetch_sub(1))
+				channel.end();
+
+			return;
+		}
+
+		Broadcast<uint64_t>::Subscription& subscription = *subscriptions[index - Publishers];
+		std::vector<int64_t> last(Publishers, -1);
+		uint64_t count = 0;
+
+		auto check = [&](const uint64_t& item)
+		{
+			uint64_t publisher = item >> 32;
+			int64_t sequence = (int64_t)(item & 0xFFFFFFFF);
+
+			CHECK(publisher < Publishers);
+			CHECK(sequence == last[publisher] + 1);
+
+			last[publisher] = sequence;
+			++count;
+			read.fetch_add(1);
+		};
+
+		while (subscription.read(check))
+			;
+
+		CHECK(false == subscription.isDropped());
+		CHECK(count == Publishers * perPublisher);
+	});
+
+	std::printf("block ok\n");
+}
+
+static void dropping(uint64_t count)
+{
+	Broadcast<uint64_t> channel(16, Broadcast<uint64_t>::Policy::Drop);
+	Broadcast<uint64_t>::Subscription fast(channel);
+	Broadcast<uint64_t>::Subscription stalled(channel);
+
+	std::atomic<uint64_t> read(0);
+	Watchdog watchdog(read);
+
+	runThreads(2, [&](int index)
+	{
+		if (0 == index)
+		{
+			// Wait for the reader between items so that it is never a ring behind.
+			for (uint64_t i = 0; i < count; ++i)
+			{
+				CHECK(channel.publish(i));
+
+				while (read.load() + 8 < i + 1)
+					std::this_thread::yield();
+			}
+
+			channel.end();
+			return;
+		}
+
+		uint64_t expected = 0;
+
+		while (fast.read([&](const uint64_t& item) { CHECK(item == expected++); }))
+			read.fetch_add(1);
+
+		CHECK(expected == count);
+	});
+
+	CHECK(false == fast.isDropped());
+	CHECK(stalled.isDropped());
+	CHECK(false == stalled.tryRead([](const uint64_t&) {}));
+
+	std::printf("drop ok\n");
+}
+
+/**
+ * An item whose assignment can be held up, to keep a publisher between claiming its
+ * slot and publishing into it.
+ */
+struct Held
+{
+	static std::atomic<bool> hold;
+	static std::atomic<bool> holding;
+
+	int value = 0;
+
+	Held() = default;
+
+	Held(int v)
+		: value(v)
+	{
+	}
+
+	Held(const Held&) = default;
+
+	Held& operator=(const Held& other)
+	{
+		if (other.value < 0)
+		{
+			holding.store(true);
+
+			while (hold.load())
+				std::this_thread::yield();
+		}
+
+		value = other.value;
+		return *this;
+	}
+};
+
+std::atomic<bool> Held::hold(false);
+std::atomic<bool> Held::holding(false);
+
+/**
+ * Starts a publisher that claims the next sequence of channel and then stalls before
+ * publishing it, until Held::hold is cleared.
+ */
+static std::thread publishStalled(Broadcast<Held>& channel)
+{
+	Held::hold.store(true);
+	Held::holding.store(false);
+
+	std::thread stalled([&channel]()
+	{
+		CHECK(channel.publish(Held(-1)));
+	});
+
+	while (false == Held::holding.load())
+		std::this_thread::yield();
+
+	return stalled;
+}
+
+static void claimedAhead()
+{
+	{
+		Broadcast<Held> channel(2, Broadcast<Held>::Policy::Drop);
+		Broadcast<Held>::Subscription subscription(channel);
+		std::thread stalled = publishStalled(channel);
+
+		CHECK(channel.tryPublish(Held(1)));
+
+		// Sequence 2 reuses the slot of sequence 0, which the subscriber can not have
+		// read since it was never published.  That must not count as the subscriber
+		// being slow, so the publish fails rather than dropping it.
+		CHECK(false == channel.tryPublish(Held(2)));
+		CHECK(false == subscription.isDropped());
+
+		Held::hold.store(false);
+		stalled.join();
+
+		std::vector<int> values;
+		auto append = [&](const Held& item) { values.push_back(item.value); };
+
+		CHECK(subscription.tryRead(append));
+		CHECK(subscription.tryRead(append));
+		CHECK(channel.tryPublish(Held(2)));
+		CHECK(subscription.tryRead(append));
+
+		CHECK(3 == values.size());
+		CHECK(-1 == values[0] && 1 == values[1] && 2 == values[2]);
+		CHECK(false == subscription.isDropped());
+	}
+
+	{
+		Broadcast<Held> channel(2, Broadcast<Held>::Policy::Drop);
+		Broadcast<Held>::Subscription subscription(channel);
+		std::thread stalled = publishStalled(channel);
+
+		CHECK(channel.tryPublish(Held(1)));
+
+		// A blocking publish has to wait for the stalled publisher rather than drop.
+		std::thread waiting([&]()
+		{
+			CHECK(channel.publish(Held(2)));
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		CHECK(false == subscription.isDropped());
+
+		// Once both items are published the subscriber really is a ring behind, so
+		// whether it is dropped now depends on which thread gets there first.
+		Held::hold.store(false);
+		stalled.join();
+		waiting.join();
+	}
+
+	std::printf("claimed ahead ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	blocking(count);
+	dropping(count);
+	claimedAhead();
+
+	return 0;
+}
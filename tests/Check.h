@@ -0,0 +1,100 @@
+#ifndef _CONCURRENT_TESTS_CHECK_H_
+#define _CONCURRENT_TESTS_CHECK_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+/**
+ * Fails the test with the location and condition if cond is false.  Unlike assert() it
+ * is kept in release builds, where the races these tests look for are most likely.
+ */
+#define CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			std::abort(); \
+		} \
+	} while (false)
+
+/**
+ * Runs func(index) on count threads, released together once all have started, and
+ * waits for them to finish.
+ */
+template<typename func_t>
+static void runThreads(int count, func_t&& func)
+{
+	std::atomic<int> ready(0);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < count; ++i)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready.fetch_add(1);
+
+			while (ready.load() < count)
+				std::this_thread::yield();
+
+			func(i);
+		});
+	}
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+/**
+ * Aborts the test if progress stops advancing for too long, so that a lost wakeup is
+ * reported as a failure rather than hanging the test.
+ */
+class Watchdog
+{
+public:
+	Watchdog(std::atomic<uint64_t>& progress)
+		: mProgress(progress), mDone(false)
+	{
+		mThread = std::thread([this]()
+		{
+			uint64_t last = mProgress.load();
+			std::chrono::steady_clock::time_point lastChange = std::chrono::steady_clock::now();
+
+			while (false == mDone.load())
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+				uint64_t current = mProgress.load();
+
+				if (current != last)
+				{
+					last = current;
+					lastChange = std::chrono::steady_clock::now();
+				}
+				else if (std::chrono::steady_clock::now() - lastChange > std::chrono::seconds(30))
+				{
+					std::fprintf(stderr, "no progress after %llu steps, a wakeup was lost\n", (unsigned long long)current);
+					std::abort();
+				}
+			}
+		});
+	}
+
+	~Watchdog()
+	{
+		mDone.store(true);
+		mThread.join();
+	}
+
+private:
+	std::atomic<uint64_t>& mProgress;
+	std::atomic<bool> mDone;
+	std::thread mThread;
+};
+
+#endif // _CONCURRENT_TESTS_CHECK_H_
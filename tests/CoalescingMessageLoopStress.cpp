@@ -0,0 +1,192 @@
+/**
+ * Stress test for CoalescingMessageLoop, with several threads pushing updates to a small
+ * set of keys.
+ *
+ * Each update carries its producer and sequence number.  The test checks that updates
+ * for a key from one producer are never handled out of order, that the last update handled
+ * for each key is one producer's last for it once the loop is destroyed, and that fewer
+ * messages than updates reach the handler, for each Execution.  It checks that a merge
+ * function sees every update, that keys are handled in the order their first pending
+ * update was pushed, and that a message is released as soon as it has been handled.
+ *
+ * CoalescingMessageLoop uses Concurrent::Mutex and runs on the Scheduler, so this builds
+ * where the rest of the library does.  From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\CoalescingMessageLoopStress.cpp src\*.cpp
+ *
+ * Usage: CoalescingMessageLoopStress [updates per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/CoalescingMessageLoop.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Concurrent;
+
+typedef MessageLoopBase::Execution Execution;
+
+static const int Producers = 3;
+static const int Keys = 10;
+
+static uint64_t makeUpdate(uint64_t producer, uint64_t sequence)
+{
+	return (producer << 32) | sequence;
+}
+
+static void coalescing(Execution execution, const char* name, uint64_t perProducer)
+{
+	std::vector<int64_t> last(Keys * Producers, -1);
+	std::vector<int64_t> lastHandled(Keys, -1);
+	std::atomic<uint64_t> handled(0);
+	Watchdog watchdog(handled);
+
+	{
+		CoalescingMessageLoop<int, uint64_t> loop([&](const int& key, const uint64_t& update)
+		{
+			uint64_t producer = update >> 32;
+			int64_t sequence = (int64_t)(update & 0xFFFFFFFF);
+
+			CHECK(key >= 0 && key < Keys);
+			CHECK(producer < Producers);
+
+			// Replaced updates are skipped, but never handled out of order.
+			int64_t& previous = last[key * Producers + producer];
+
+			CHECK(sequence > previous);
+			previous = sequence;
+			lastHandled[key] = sequence;
+
+			handled.fetch_add(1);
+		}, execution);
+
+		runThreads(Producers, [&](int index)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+			{
+				loop.push((int)(i % Keys), makeUpdate(index, i));
+
+				// Pause now and then so the loop drains the keys and parks.
+				if (i % 1024 == 0)
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		});
+	}
+
+	// Whichever producer pushed to a key last, nothing replaced its update, so it was
+	// handled after any other for that key.  Producers push the same sequences per key.
+	for (int key = 0; key < Keys; ++key)
+		CHECK(lastHandled[key] == (int64_t)(perProducer - 1 - (perProducer - 1 - key) % Keys));
+
+	CHECK(handled.load() <= Producers * perProducer);
+	std::printf("%s ok, %llu of %llu updates handled\n", name,
+	            (unsigned long long)handled.load(), (unsigned long long)(Producers * perProducer));
+}
+
+static void merging(uint64_t perProducer)
+{
+	std::atomic<uint64_t> total(0);
+	Watchdog watchdog(total);
+
+	{
+		CoalescingMessageLoop<int, uint64_t> loop(
+			[&](const int&, const uint64_t& count) { total.fetch_add(count); },
+			[](uint64_t& pending, uint64_t&& incoming) { pending += incoming; });
+
+		runThreads(Producers, [&](int index)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+				loop.push((int)((i + index) % Keys), 1);
+		});
+	}
+
+	CHECK(total.load() == Producers * perProducer);
+	std::printf("merge ok\n");
+}
+
+static void order()
+{
+	std::string handled;
+	std::atomic<bool> entered(false);
+	std::atomic<bool> release(false);
+
+	{
+		CoalescingMessageLoop<char, int> loop([&](const char& key, const int& value)
+		{
+			entered.store(true);
+
+			while (false == release.load())
+				std::this_thread::yield();
+
+			handled += key;
+			handled += (char)('0' + value);
+		}, Execution::Thread);
+
+		loop.push('x', 0);
+
+		while (false == entered.load())
+			std::this_thread::yield();
+
+		// x is with the handler, so pushing it again queues it behind the others.
+		loop.push('a', 1);
+		loop.push('b', 1);
+		loop.push('x', 1);
+		loop.push('a', 2);
+		loop.push('c', 1);
+		loop.push('b', 2);
+		loop.push('x', 2);
+
+		release.store(true);
+	}
+
+	CHECK(handled == "x0" "a2" "b2" "x2" "c1");
+	std::printf("order ok\n");
+}
+
+static void released()
+{
+	std::atomic<uint64_t> handled(0);
+	std::weak_ptr<int> last;
+
+	CoalescingMessageLoop< int, std::shared_ptr<int> > loop([&](const int&, const std::shared_ptr<int>&) { handled.fetch_add(1); }, Execution::Thread);
+
+	for (int i = 0; i < 100; ++i)
+	{
+		std::shared_ptr<int> message = std::make_shared<int>(i);
+		last = message;
+
+		loop.push(i % 3, std::move(message));
+
+		while (handled.load() < (uint64_t)i + 1)
+			std::this_thread::yield();
+
+		// The handler has returned, and nothing else is pushed, so nothing may still
+		// own the message once the loop finishes with it.
+		for (int spins = 0; false == last.expired() && spins < 1000; ++spins)
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+		CHECK(last.expired());
+	}
+
+	std::printf("released ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	CHECK(count >= Keys);
+
+	coalescing(Execution::Task, "task", count);
+	coalescing(Execution::Thread, "thread", count);
+	coalescing(Execution::OnDemand, "on demand", count);
+	merging(count);
+	order();
+	released();
+
+	return 0;
+}
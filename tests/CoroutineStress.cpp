@@ -0,0 +1,143 @@
+/**
+ * Stress test for coroutine consumers of a Producer, mixed with threads that consume the
+ * same producer with blocking calls.
+ *
+ * Many more coroutines than threads loop on co_await next(), so most of them are suspended
+ * at any time and most pushes hand their item straight to one.  The test checks that every
+ * item is consumed exactly once, that each consumer, coroutine or thread, sees every
+ * producer's items in order, and that end() resumes every suspended coroutine.  A lost
+ * resumption stalls the test, which a watchdog reports as a failure rather than letting
+ * it hang.
+ *
+ * Requires C++20 coroutines, and Producer uses Concurrent::Queue and Scheduler, so this
+ * builds where the rest of the library does.  From the repository root, for example:
+ *
+ *  cl /std:c++20 /EHsc /O2 /Iinclude tests\CoroutineStress.cpp src\*.cpp
+ *
+ * Usage: CoroutineStress [items per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/Coroutine.h>
+#include <Concurrent/Producer.h>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#ifndef CONCURRENT_COROUTINES
+#	error "CoroutineStress needs a compiler with C++20 coroutines."
+#endif
+
+using namespace Concurrent;
+
+static const int Producers = 3;
+
+static std::atomic<uint64_t> consumed(0);
+static std::atomic<uint64_t> finished(0);
+
+static uint64_t makeItem(uint64_t producer, uint64_t sequence)
+{
+	return (producer << 32) | sequence;
+}
+
+/**
+ * Checks that the items seen by one consumer are in order for each producer.
+ */
+static void checkOrder(std::vector<int64_t>& last, uint64_t item)
+{
+	uint64_t producer = item >> 32;
+	int64_t sequence = (int64_t)(item & 0xFFFFFFFF);
+
+	CHECK(producer < last.size());
+	CHECK(sequence > last[producer]);
+
+	last[producer] = sequence;
+	consumed.fetch_add(1);
+}
+
+static Coroutine consumeAll(Producer<uint64_t>& producer)
+{
+	std::vector<int64_t> last(Producers, -1);
+
+	while (std::optional<uint64_t> item = co_await producer.next())
+		checkOrder(last, *item);
+
+	finished.fetch_add(1);
+}
+
+static void mixed(uint64_t perProducer)
+{
+	const int Coroutines = 500;
+	const int Threads = 2;
+
+	consumed.store(0);
+	finished.store(0);
+
+	Producer<uint64_t> producer;
+	std::atomic<int> pushing(Producers);
+	Watchdog watchdog(consumed);
+
+	for (int i = 0; i < Coroutines; ++i)
+		consumeAll(producer);
+
+	runThreads(Producers + Threads, [&](int index)
+	{
+		if (index < Producers)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+				CHECK(producer.push(makeItem(index, i)));
+
+			if (1 == pushing.fetch_sub(1))
+				producer.end();
+
+			return;
+		}
+
+		std::vector<int64_t> last(Producers, -1);
+		uint64_t item;
+
+		while (producer.consume(item))
+			checkOrder(last, item);
+	});
+
+	// Coroutines resumed by end() may still be running on the scheduler.
+	while (finished.load() < Coroutines)
+		std::this_thread::yield();
+
+	CHECK(consumed.load() == Producers * perProducer);
+	std::printf("mixed ok\n");
+}
+
+static void endResumesAll()
+{
+	const int Coroutines = 100;
+
+	finished.store(0);
+
+	Producer<uint64_t> producer;
+	Watchdog watchdog(finished);
+
+	// With nothing pushed, every coroutine suspends on its first next().
+	for (int i = 0; i < Coroutines; ++i)
+		consumeAll(producer);
+
+	CHECK(0 == finished.load());
+	producer.end();
+
+	while (finished.load() < Coroutines)
+		std::this_thread::yield();
+
+	std::printf("end ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	mixed(count);
+	endResumesAll();
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * Stress test for futex parking through EventCount, the primitive the blocking queues and
+ * message loops park on.
+ *
+ * Threads pass a token around a ring, each parking until the token reaches it, so every
+ * hand-off needs a wakeup that races with the waiter deciding to park.  Consumers also
+ * take permits posted one at a time with notifyOne().  A lost wakeup stalls the test,
+ * which a watchdog reports as a failure rather than letting it hang.  Timed waits are
+ * checked both to time out with nothing to wake them and to return early when notified.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude tests/EventCountStress.cpp src/Futex.cpp
+ *
+ * Adding -fsanitize=thread is recommended.
+ *
+ * Usage: EventCountStress [hand-offs per thread]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/Internal/EventCount.h>
+
+#include <chrono>
+#include <cstdint>
+
+using namespace Concurrent;
+
+typedef std::chrono::steady_clock clock_type;
+
+static void ring(uint64_t handOffs)
+{
+	const int Threads = 4;
+
+	std::atomic<uint64_t> token(0);
+	EventCount changed;
+	Watchdog watchdog(token);
+
+	runThreads(Threads, [&](int index)
+	{
+		for (uint64_t turn = index; turn < handOffs * Threads; turn += Threads)
+		{
+			while (token.load(std::memory_order_acquire) != turn)
+			{
+				uint32_t key = changed.prepareWait();
+
+				if (token.load(std::memory_order_acquire) == turn)
+				{
+					changed.cancelWait();
+					break;
+				}
+
+				changed.commitWait(key);
+			}
+
+			// Only one particular waiter can proceed, so all of them must be woken.
+			token.store(turn + 1, std::memory_order_release);
+			changed.notifyAll();
+		}
+	});
+
+	CHECK(handOffs * Threads == token.load());
+	std::printf("ring ok\n");
+}
+
+/**
+ * Consumers park until a permit is available and producers wake one consumer per permit,
+ * the pattern the queues use, where any waiter can take the item.
+ */
+static void permits(uint64_t handOffs)
+{
+	const int Producers = 2;
+	const int Consumers = 3;
+	const uint64_t Total = handOffs * Producers;
+
+	std::atomic<int64_t> available(0);
+	std::atomic<uint64_t> taken(0);
+	EventCount posted;
+	Watchdog watchdog(taken);
+
+	auto tryTake = [&]()
+	{
+		int64_t count = available.load(std::memory_order_acquire);
+
+		while (count > 0)
+		{
+			if (available.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel))
+				return true;
+		}
+
+		return false;
+	};
+
+	runThreads(Producers + Consumers, [&](int index)
+	{
+		if (index < Producers)
+		{
+			for (uint64_t i = 0; i < handOffs; ++i)
+			{
+				available.fetch_add(1, std::memory_order_release);
+				posted.notifyOne();
+			}
+
+			return;
+		}
+
+		while (taken.load() < Total)
+		{
+			if (tryTake())
+			{
+				// The last permit also releases the other consumers.
+				if (Total == taken.fetch_add(1) + 1)
+					posted.notifyAll();
+
+				continue;
+			}
+
+			uint32_t key = posted.prepareWait();
+
+			if (available.load(std::memory_order_acquire) > 0 || taken.load() >= Total)
+			{
+				posted.cancelWait();
+				continue;
+			}
+
+			posted.commitWait(key);
+		}
+	});
+
+	CHECK(Total == taken.load());
+	CHECK(0 == available.load());
+	std::printf("permits ok\n");
+}
+
+static void timedWaits()
+{
+	EventCount event;
+
+	// Nothing notifies, so the wait must time out, and not early.
+	clock_type::time_point start = clock_type::now();
+	uint32_t key = event.prepareWait();
+
+	CHECK(false == event.commitWaitUntil(key, start + std::chrono::milliseconds(20)));
+	CHECK(clock_type::now() - start >= std::chrono::milliseconds(20));
+	CHECK(false == event.hasWaiters());
+
+	// A notification must end the wait well before its deadline.
+	std::atomic<bool> parked(false);
+
+	std::thread waiter([&]()
+	{
+		uint32_t waitKey = event.prepareWait();
+		parked.store(true);
+
+		CHECK(event.commitWaitUntil(waitKey, clock_type::now() + std::chrono::seconds(30)));
+	});
+
+	while (false == parked.load())
+		std::this_thread::yield();
+
+	event.notifyAll();
+	waiter.join();
+
+	CHECK(false == event.hasWaiters());
+	std::printf("timed waits ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t handOffs = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 20000;
+
+	ring(handOffs);
+	permits(handOffs);
+	timedWaits();
+
+	return 0;
+}
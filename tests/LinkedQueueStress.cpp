@@ -0,0 +1,469 @@
+/**
+ * Stress test for the linked queues, MpscQueue and SpscQueue.
+ *
+ * Items carry their producer and sequence number, and the test checks that nothing is
+ * lost or duplicated, that each producer's items are popped in the order pushed, and that
+ * a batch from pushBulk() is never interleaved with other producers' items.  Nodes come
+ * from a counting memory resource so that any node leaked by a queue, including by a
+ * push or pushBulk() that throws part way through, is caught when the queue is destroyed.
+ * A tryPopBulk() whose destination throws must leave the queue consistent.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude tests/LinkedQueueStress.cpp
+ *
+ * Adding -fsanitize=thread is recommended.
+ *
+ * Usage: LinkedQueueStress [items per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/MpscQueue.h>
+#include <Concurrent/SpscQueue.h>
+
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+using namespace Concurrent;
+
+/**
+ * Passes allocations through to the default resource, counting those outstanding.
+ */
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+	std::atomic<int64_t> live = 0;
+
+private:
+	virtual void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		live.fetch_add(1);
+		return std::pmr::get_default_resource()->allocate(bytes, alignment);
+	}
+
+	virtual void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+	{
+		live.fetch_sub(1);
+		std::pmr::get_default_resource()->deallocate(ptr, bytes, alignment);
+	}
+
+	virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return (this == &other);
+	}
+};
+
+/**
+ * An item the high bits of which are the producer, and the next bit marks the items of a
+ * batch after its first.
+ */
+static constexpr uint64_t InBatch = uint64_t(1) << 31;
+
+static uint64_t makeItem(uint64_t producer, uint64_t sequence, bool inBatch = false)
+{
+	return (producer << 32) | (inBatch ? InBatch : 0) | sequence;
+}
+
+static void mpsc(uint64_t perProducer)
+{
+	const int Producers = 4;
+
+	CountingResource resource;
+
+	{
+		MpscQueue<uint64_t> queue(&resource);
+
+		runThreads(Producers + 1, [&](int index)
+		{
+			if (index < Producers)
+			{
+				std::vector<uint64_t> batch;
+				uint64_t next = 0;
+
+				while (next < perProducer)
+				{
+					// Alternate single pushes with batches of varying size.
+					size_t size = (next % 3 == 0) ? 1 + next % 7 : 1;
+					batch.clear();
+
+					for (uint64_t i = next; i < perProducer && batch.size() < size; ++i)
+						batch.push_back(makeItem(index, i, i != next));
+
+					if (1 == batch.size())
+						queue.push(batch[0]);
+					else
+						queue.pushBulk(batch.begin(), batch.end());
+
+					next += batch.size();
+				}
+
+				return;
+			}
+
+			std::vector<int64_t> last(Producers, -1);
+			std::vector<uint64_t> items;
+			uint64_t previous = 0;
+			uint64_t total = perProducer * Producers;
+			uint64_t popped = 0;
+
+			while (popped < total)
+			{
+				items.clear();
+
+				if (popped % 2 == 0)
+				{
+					uint64_t item;
+
+					if (queue.tryPop(item))
+						items.push_back(item);
+				}
+				else
+				{
+					queue.tryPopBulk(std::back_inserter(items), 5);
+				}
+
+				if (items.empty())
+					std::this_thread::yield();
+
+				for (uint64_t item : items)
+				{
+					uint64_t producer = item >> 32;
+					int64_t sequence = (int64_t)(item & (InBatch - 1));
+
+					CHECK(producer < Producers);
+					CHECK(sequence == last[producer] + 1);
+
+					if (item & InBatch)
+						CHECK((previous >> 32) == producer);
+
+					last[producer] = sequence;
+					previous = item;
+					++popped;
+				}
+			}
+
+			CHECK(queue.isEmpty());
+		});
+	}
+
+	CHECK(0 == resource.live.load());
+	std::printf("mpsc ok\n");
+}
+
+static void spsc(uint64_t count)
+{
+	CountingResource resource;
+
+	{
+		SpscQueue<uint64_t> queue(&resource);
+
+		runThreads(2, [&](int index)
+		{
+			if (0 == index)
+			{
+				std::vector<uint64_t> batch;
+				uint64_t next = 0;
+
+				while (next < count)
+				{
+					size_t size = 1 + next % 11;
+					batch.clear();
+
+					for (uint64_t i = next; i < count && batch.size() < size; ++i)
+						batch.push_back(i);
+
+					if (1 == batch.size())
+						queue.emplace(batch[0]);
+					else
+						queue.pushBulk(batch.begin(), batch.end());
+
+					next += batch.size();
+				}
+
+				return;
+			}
+
+			std::vector<uint64_t> items;
+			uint64_t expected = 0;
+
+			while (expected < count)
+			{
+				items.clear();
+
+				if (expected % 2 == 0)
+				{
+					std::optional<uint64_t> item;
+
+					if (queue.tryPop(item))
+						items.push_back(*item);
+				}
+				else
+				{
+					queue.tryPopBulk(std::back_inserter(items), 9);
+				}
+
+				if (items.empty())
+					std::this_thread::yield();
+
+				for (uint64_t item : items)
+					CHECK(item == expected++);
+			}
+
+			CHECK(queue.isEmpty());
+		});
+	}
+
+	CHECK(0 == resource.live.load());
+	std::printf("spsc ok\n");
+}
+
+/**
+ * Throws from its copy constructor on the copy numbered by throwAt.
+ */
+struct Fragile
+{
+	static int copies;
+	static int throwAt;
+
+	uint64_t value;
+
+	Fragile(uint64_t v)
+		: value(v)
+	{
+	}
+
+	Fragile(const Fragile& other)
+		: value(other.value)
+	{
+		if (++copies == throwAt)
+			throw std::runtime_error("copy failed");
+	}
+
+	Fragile(Fragile&&) = default;
+	Fragile& operator=(Fragile&&) = default;
+};
+
+int Fragile::copies = 0;
+int Fragile::throwAt = 0;
+
+template<typename queue_t>
+static void throwingPush(const char* name)
+{
+	CountingResource resource;
+
+	{
+		queue_t queue(&resource);
+		Fragile item(1);
+
+		queue.push(Fragile(0));
+
+		// Fail enough pushes to run through any nodes the queue has ready for reuse.
+		for (int attempt = 0; attempt < 4; ++attempt)
+		{
+			bool threw = false;
+
+			Fragile::copies = 0;
+			Fragile::throwAt = 1;
+
+			try
+			{
+				if (attempt % 2 == 0)
+					queue.push(item);
+				else
+					queue.emplace(item);
+			}
+			catch (const std::runtime_error&)
+			{
+				threw = true;
+			}
+
+			CHECK(threw);
+		}
+
+		// None of the failed pushes may have reached the queue.
+		Fragile::throwAt = 0;
+		queue.push(item);
+
+		std::optional<Fragile> popped;
+
+		for (uint64_t expected = 0; expected <= 1; ++expected)
+		{
+			CHECK(queue.tryPop(popped));
+			CHECK(popped->value == expected);
+		}
+
+		CHECK(queue.isEmpty());
+
+		// Nodes recycled after a failed push must still be usable.
+		for (uint64_t value = 0; value < 8; ++value)
+		{
+			queue.push(Fragile(value));
+			CHECK(queue.tryPop(popped));
+			CHECK(popped->value == value);
+		}
+	}
+
+	CHECK(0 == resource.live.load());
+	std::printf("%s throwing push ok\n", name);
+}
+
+template<typename queue_t>
+static void throwingBulk(const char* name)
+{
+	CountingResource resource;
+
+	{
+		queue_t queue(&resource);
+		std::vector<Fragile> items = { 1, 2, 3, 4, 5 };
+
+		queue.push(Fragile(0));
+
+		for (int throwAt = 1; throwAt <= (int)items.size(); ++throwAt)
+		{
+			bool threw = false;
+
+			Fragile::copies = 0;
+			Fragile::throwAt = throwAt;
+
+			try
+			{
+				queue.pushBulk(items.begin(), items.end());
+			}
+			catch (const std::runtime_error&)
+			{
+				threw = true;
+			}
+
+			CHECK(threw);
+		}
+
+		// None of the failed batches may have reached the queue.
+		Fragile::throwAt = 0;
+		queue.pushBulk(items.begin(), items.end());
+
+		std::optional<Fragile> item;
+
+		for (uint64_t expected = 0; expected <= items.size(); ++expected)
+		{
+			CHECK(queue.tryPop(item));
+			CHECK(item->value == expected);
+		}
+
+		CHECK(queue.isEmpty());
+	}
+
+	CHECK(0 == resource.live.load());
+	std::printf("%s throwing pushBulk ok\n", name);
+}
+
+/**
+ * An output iterator that throws when the item numbered by throwAt is written to it,
+ * before moving from that item.
+ */
+class FailingOutput
+{
+public:
+	FailingOutput(std::vector<uint64_t>* items, size_t throwAt)
+		: mItems(items), mThrowAt(throwAt)
+	{
+	}
+
+	FailingOutput& operator*() { return *this; }
+	FailingOutput& operator++() { return *this; }
+
+	FailingOutput& operator=(Fragile&& item)
+	{
+		if (mItems->size() + 1 == mThrowAt)
+			throw std::runtime_error("write failed");
+
+		mItems->push_back(item.value);
+		return *this;
+	}
+
+private:
+	std::vector<uint64_t>* mItems;
+	size_t mThrowAt;
+};
+
+template<typename queue_t>
+static void throwingPopBulk(const char* name)
+{
+	CountingResource resource;
+
+	{
+		queue_t queue(&resource);
+		std::vector<uint64_t> popped;
+		uint64_t pushed = 0;
+
+		for (size_t throwAt = 1; throwAt <= 4; ++throwAt)
+		{
+			for (int i = 0; i < 4; ++i)
+				queue.push(Fragile(pushed++));
+
+			std::vector<uint64_t> written;
+			bool threw = false;
+
+			try
+			{
+				queue.tryPopBulk(FailingOutput(&written, throwAt), 4);
+			}
+			catch (const std::runtime_error&)
+			{
+				threw = true;
+			}
+
+			CHECK(threw);
+			CHECK(written.size() == throwAt - 1);
+
+			popped.insert(popped.end(), written.begin(), written.end());
+
+			// The item that failed and those after it are still queued, in order.
+			std::optional<Fragile> item;
+
+			while (queue.tryPop(item))
+				popped.push_back(item->value);
+		}
+
+		CHECK(popped.size() == pushed);
+
+		for (uint64_t i = 0; i < pushed; ++i)
+			CHECK(popped[i] == i);
+
+		// Nodes handed back after the failed pops must still be usable.
+		for (uint64_t value = 0; value < 8; ++value)
+		{
+			std::optional<Fragile> item;
+
+			queue.push(Fragile(value));
+			CHECK(queue.tryPop(item));
+			CHECK(item->value == value);
+		}
+	}
+
+	CHECK(0 == resource.live.load());
+	std::printf("%s throwing tryPopBulk ok\n", name);
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	mpsc(count);
+	spsc(count);
+
+	throwingPush< MpscQueue<Fragile> >("mpsc");
+	throwingPush< SpscQueue<Fragile> >("spsc");
+
+	throwingBulk< MpscQueue<Fragile> >("mpsc");
+	throwingBulk< SpscQueue<Fragile> >("spsc");
+
+	throwingPopBulk< MpscQueue<Fragile> >("mpsc");
+	throwingPopBulk< SpscQueue<Fragile> >("spsc");
+
+	return 0;
+}
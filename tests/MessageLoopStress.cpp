@@ -0,0 +1,188 @@
+/**
+ * Stress test for MessageLoop, with several threads pushing single messages and lists.
+ *
+ * Messages carry their producer and sequence number.  The test checks that the handler
+ * sees every message once, with each producer's messages in the order pushed, that batch
+ * handlers never get more than their batch size, and that destroying the loop handles
+ * every message already pushed.  This runs for each Execution; with OnDemand, the pauses
+ * between pushes let each drain finish, so that pushes keep scheduling new ones.  It also
+ * checks that a message is released as soon as it has been handled, rather than held by
+ * the loop until the next one arrives.
+ *
+ * MessageLoop runs on the Scheduler, so this builds where the rest of the library does.
+ * From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\MessageLoopStress.cpp src\*.cpp
+ *
+ * Usage: MessageLoopStress [messages per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/MessageLoop.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace Concurrent;
+
+typedef MessageLoopBase::Execution Execution;
+
+static const int Producers = 3;
+
+static uint64_t makeMessage(uint64_t producer, uint64_t sequence)
+{
+	return (producer << 32) | sequence;
+}
+
+/**
+ * Checks the order of the messages a loop handles and counts them.
+ */
+class OrderCheck
+{
+public:
+	OrderCheck()
+		: mLast(Producers, -1)
+	{
+	}
+
+	void add(uint64_t message)
+	{
+		uint64_t producer = message >> 32;
+		int64_t sequence = (int64_t)(message & 0xFFFFFFFF);
+
+		CHECK(producer < Producers);
+		CHECK(sequence == mLast[producer] + 1);
+
+		mLast[producer] = sequence;
+		handled.fetch_add(1);
+	}
+
+	std::atomic<uint64_t> handled = 0;
+
+private:
+	std::vector<int64_t> mLast;
+};
+
+/**
+ * Pushes perProducer messages from each producer thread, alternating single messages
+ * with vectors and initializer lists.
+ */
+template<typename loop_t>
+static void pushAll(loop_t& loop, uint64_t perProducer)
+{
+	runThreads(Producers, [&](int index)
+	{
+		std::vector<uint64_t> list;
+		uint64_t i = 0;
+
+		while (i < perProducer)
+		{
+			if (i % 5 == 0 && i + 3 <= perProducer)
+			{
+				list.clear();
+
+				for (int j = 0; j < 3; ++j)
+					list.push_back(makeMessage(index, i++));
+
+				loop.push(std::move(list));
+			}
+			else if (i % 7 == 0 && i + 2 <= perProducer)
+			{
+				loop.push({ makeMessage(index, i), makeMessage(index, i + 1) });
+				i += 2;
+			}
+			else
+			{
+				loop.push(makeMessage(index, i++));
+			}
+
+			// Pause now and then so the loop drains the queue and parks.
+			if (i % 256 == 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	});
+}
+
+static void single(Execution execution, const char* name, uint64_t perProducer)
+{
+	OrderCheck check;
+	Watchdog watchdog(check.handled);
+
+	{
+		MessageLoop<uint64_t> loop([&](const uint64_t& message) { check.add(message); }, execution);
+		pushAll(loop, perProducer);
+	}
+
+	// The destructor handles everything pushed before it.
+	CHECK(check.handled.load() == Producers * perProducer);
+	std::printf("%s ok\n", name);
+}
+
+static void batched(Execution execution, const char* name, uint64_t perProducer)
+{
+	const size_t BatchSize = 16;
+
+	OrderCheck check;
+	Watchdog watchdog(check.handled);
+
+	{
+		MessageLoop<uint64_t> loop([&](std::vector<uint64_t>& batch)
+		{
+			CHECK(false == batch.empty());
+			CHECK(batch.size() <= BatchSize);
+
+			for (uint64_t message : batch)
+				check.add(message);
+		}, BatchSize, execution);
+
+		pushAll(loop, perProducer);
+	}
+
+	CHECK(check.handled.load() == Producers * perProducer);
+	std::printf("%s batched ok\n", name);
+}
+
+static void released()
+{
+	std::atomic<uint64_t> handled(0);
+	std::weak_ptr<int> last;
+
+	MessageLoop< std::shared_ptr<int> > loop([&](const std::shared_ptr<int>&) { handled.fetch_add(1); }, Execution::Thread);
+
+	for (int i = 0; i < 100; ++i)
+	{
+		std::shared_ptr<int> message = std::make_shared<int>(i);
+		last = message;
+
+		loop.push(std::move(message));
+
+		while (handled.load() < (uint64_t)i + 1)
+			std::this_thread::yield();
+
+		// The handler has returned, and nothing else is pushed, so nothing may still
+		// own the message once the loop finishes with it.
+		for (int spins = 0; false == last.expired() && spins < 1000; ++spins)
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+		CHECK(last.expired());
+	}
+
+	std::printf("released ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	single(Execution::Task, "task", count);
+	single(Execution::Thread, "thread", count);
+	single(Execution::OnDemand, "on demand", count);
+	batched(Execution::Task, "task", count);
+	batched(Execution::Thread, "thread", count);
+	batched(Execution::OnDemand, "on demand", count);
+	released();
+
+	return 0;
+}
@@ -0,0 +1,408 @@
+/**
+ * Stress test for ObjectPool, with several threads taking and returning objects.
+ *
+ * Objects track whether they are in use.  The test checks that no object is ever held by
+ * two PoolObjects at once, that no more objects are constructed than the maximum size,
+ * that a returned object is reinitialized before it is handed out again, and that getters
+ * blocked at the maximum size are woken as objects are returned.  A lost wakeup stalls
+ * the test, which a watchdog reports as a failure rather than letting it hang.
+ *
+ * Objects must stay at the same address across checkouts, be reset by reset_t on return,
+ * and need not be movable.  A constructor that throws must not shrink the pool, and a
+ * PoolObject that outlives its ObjectPool must keep its object valid until it is gone.
+ *
+ * prewarm(), serial or on a Scheduler, must construct up to the maximum size and no
+ * further.  trim() and the idle timeout must destroy idle objects only, including while
+ * other threads take and return objects, and the stats must add up.
+ *
+ * ObjectPool uses Concurrent::Mutex and Timer, so this builds where the rest of the
+ * library does.  From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\ObjectPoolStress.cpp src\*.cpp
+ *
+ * Usage: ObjectPoolStress [gets per thread]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/ObjectPool.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace Concurrent;
+
+static std::atomic<int64_t> constructed(0);
+static std::atomic<int64_t> destroyed(0);
+
+/**
+ * A pooled object that notices being used by two holders at once.
+ */
+struct Tracked
+{
+	std::atomic<bool> inUse;
+	uint64_t uses;
+
+	Tracked()
+		: inUse(false), uses(0)
+	{
+		constructed.fetch_add(1);
+	}
+
+	Tracked(Tracked&& other)
+		: inUse(false), uses(other.uses)
+	{
+		constructed.fetch_add(1);
+	}
+
+	~Tracked()
+	{
+		destroyed.fetch_add(1);
+	}
+};
+
+static void contention(size_t maxSize, uint64_t perThread)
+{
+	const int Threads = 6;
+
+	constructed.store(0);
+	destroyed.store(0);
+
+	std::atomic<uint64_t> gets(0);
+	Watchdog watchdog(gets);
+
+	{
+		ObjectPool<Tracked> pool;
+		pool.init([](Tracked& object) { object.uses = 0; }, maxSize);
+
+		runThreads(Threads, [&](int index)
+		{
+			for (uint64_t i = 0; i < perThread; ++i)
+			{
+				PoolObject<Tracked> object(&pool);
+
+				CHECK(false == object->inUse.exchange(true));
+				CHECK(0 == object->uses);
+
+				object->uses++;
+
+				// One thread holds a second object now and then.  Only one, since several
+				// holding one object and waiting for another could exhaust the pool.
+				if (0 == index && i % 5 == 0 && maxSize > 1)
+				{
+					PoolObject<Tracked> second(&pool);
+
+					CHECK(second.get() != object.get());
+					CHECK(false == second->inUse.exchange(true));
+
+					std::this_thread::yield();
+					second->inUse.store(false);
+				}
+
+				object->inUse.store(false);
+
+				// Return early through free() as well as through the destructor.
+				if (i % 7 == 0)
+				{
+					object.free();
+					CHECK(nullptr == object.get());
+				}
+
+				gets.fetch_add(1);
+			}
+		});
+
+		// Temporaries moved from during construction are gone, so this counts the
+		// objects the pool holds.
+		CHECK(constructed.load() - destroyed.load() <= (int64_t)maxSize);
+	}
+
+	CHECK(constructed.load() == destroyed.load());
+	std::printf("max size %zu ok\n", maxSize);
+}
+
+static void blocking()
+{
+	ObjectPool<int> pool;
+	pool.init(1);
+
+	std::atomic<bool> got(false);
+	std::thread waiter;
+
+	{
+		PoolObject<int> held(&pool);
+
+		// The pool is at its maximum size, so the getter must wait for held.
+		waiter = std::thread([&]()
+		{
+			PoolObject<int> object(&pool);
+			got.store(true);
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		CHECK(false == got.load());
+	}
+
+	waiter.join();
+	CHECK(got.load());
+	CHECK(0 != pool.stats().blockedWaits);
+
+	std::printf("blocking ok\n");
+}
+
+/**
+ * Neither copyable nor movable, so it can only be pooled in place.
+ */
+struct Pinned
+{
+	std::mutex lock;
+	int value = 0;
+	std::vector<int> data;
+};
+
+struct ResetPinned
+{
+	void operator()(Pinned& object) const
+	{
+		object.value = 0;
+		object.data.clear();
+	}
+};
+
+static void slots()
+{
+	typedef PoolObject<Pinned, ResetPinned> Handle;
+
+	ObjectPool<Pinned, ResetPinned> pool;
+	pool.init(2);
+
+	Pinned* first;
+
+	{
+		Handle object(&pool);
+
+		object->value = 5;
+		object->data.push_back(1);
+		first = object.get();
+	}
+
+	{
+		// The only idle object comes back in place, reset.
+		Handle object(&pool);
+
+		CHECK(object.get() == first);
+		CHECK(0 == object->value && object->data.empty());
+
+		Handle moved(std::move(object));
+
+		CHECK(moved.get() == first);
+		CHECK(nullptr == object.get());
+	}
+
+	std::printf("slots ok\n");
+}
+
+static void throwingConstructor()
+{
+	std::atomic<int> calls(0);
+	int thrown = 0;
+
+	ObjectPool<int> pool;
+
+	pool.init([&]()
+	{
+		if (calls.fetch_add(1) % 2 == 0)
+			throw std::runtime_error("construction failed");
+
+		return 7;
+	}, 2);
+
+	for (int i = 0; i < 20; ++i)
+	{
+		try
+		{
+			PoolObject<int> first(&pool);
+			PoolObject<int> second(&pool);
+
+			CHECK(7 == *first && 7 == *second);
+		}
+		catch (const std::runtime_error&)
+		{
+			++thrown;
+		}
+	}
+
+	// Failed constructions gave back their place, so both objects were made in the end
+	// and nothing blocked.
+	CHECK(thrown > 0);
+	CHECK(2 == pool.stats().resident);
+
+	std::printf("throwing constructor ok\n");
+}
+
+static void outlivesPool()
+{
+	constructed.store(0);
+	destroyed.store(0);
+
+	std::unique_ptr< PoolObject<Tracked> > survivor;
+
+	{
+		ObjectPool<Tracked> pool;
+		pool.init(4);
+
+		PoolObject<Tracked> other(&pool);
+		survivor.reset(new PoolObject<Tracked>(&pool));
+
+		(*survivor)->uses = 42;
+	}
+
+	// The pool is gone, but the object and the data it returns to are not.
+	CHECK(42 == (*survivor)->uses);
+	CHECK(constructed.load() - destroyed.load() == 2);
+
+	survivor.reset();
+	CHECK(constructed.load() == destroyed.load());
+
+	std::printf("outlives pool ok\n");
+}
+
+static void prewarming()
+{
+	constructed.store(0);
+	destroyed.store(0);
+
+	{
+		ObjectPool<Tracked> pool;
+		pool.init(100);
+
+		CHECK(40 == pool.prewarm(40));
+		CHECK(40 == constructed.load());
+
+		// Prewarmed objects are handed out as hits.
+		{
+			PoolObject<Tracked> object(&pool);
+		}
+
+		ObjectPool<Tracked>::Stats stats = pool.stats();
+
+		CHECK(1 == stats.hits && 0 == stats.misses);
+		CHECK(40 == stats.resident);
+
+		// Only the room left under the maximum size is filled.
+		CHECK(60 == pool.prewarm(1000, Scheduler::getDefault()));
+		CHECK(100 == pool.stats().resident);
+		CHECK(0 == pool.prewarm(1));
+	}
+
+	CHECK(100 == constructed.load() && 100 == destroyed.load());
+	std::printf("prewarm ok\n");
+}
+
+static void trimming(uint64_t perThread)
+{
+	const int Threads = 4;
+
+	constructed.store(0);
+	destroyed.store(0);
+
+	ObjectPool<Tracked> pool;
+	pool.init(16);
+	pool.prewarm(10);
+
+	{
+		PoolObject<Tracked> first(&pool);
+		PoolObject<Tracked> second(&pool);
+
+		// Objects in use are left alone.
+		CHECK(8 == pool.trim());
+		CHECK(2 == pool.stats().resident);
+		CHECK(8 == destroyed.load());
+	}
+
+	CHECK(2 == pool.trim());
+	CHECK(0 == pool.stats().resident);
+
+	// Trimming while other threads take and return objects must not destroy one in use.
+	std::atomic<uint64_t> gets(0);
+	Watchdog watchdog(gets);
+
+	runThreads(Threads + 1, [&](int index)
+	{
+		if (Threads == index)
+		{
+			while (gets.load() < Threads * perThread)
+				pool.trim();
+
+			return;
+		}
+
+		for (uint64_t i = 0; i < perThread; ++i)
+		{
+			PoolObject<Tracked> object(&pool);
+
+			CHECK(false == object->inUse.exchange(true));
+			object->inUse.store(false);
+
+			gets.fetch_add(1);
+		}
+	});
+
+	ObjectPool<Tracked>::Stats stats = pool.stats();
+
+	CHECK(stats.hits + stats.misses == Threads * perThread + 2);
+	CHECK((int64_t)stats.resident == constructed.load() - destroyed.load());
+	CHECK(stats.reclaimed == (uint64_t)destroyed.load());
+
+	std::printf("trim ok, %llu reclaimed\n", (unsigned long long)stats.reclaimed);
+}
+
+static void idleTimeout()
+{
+	ObjectPool<int> pool;
+	pool.init(8);
+	pool.prewarm(8);
+
+	PoolObject<int> held(&pool);
+	pool.setIdleTimeout(std::chrono::milliseconds(40));
+
+	// Idle objects go within about a timeout and a quarter, but allow for a slow machine.
+	auto start = std::chrono::steady_clock::now();
+
+	while (pool.stats().resident > 1 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+	CHECK(1 == pool.stats().resident);
+	CHECK(7 == pool.stats().reclaimed);
+	CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(40));
+
+	// A timeout of zero turns reclaiming off again.
+	pool.setIdleTimeout(std::chrono::milliseconds(0));
+	pool.prewarm(7);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	CHECK(8 == pool.stats().resident);
+
+	std::printf("idle timeout ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	contention(1, count / 10);
+	contention(3, count);
+	contention(64, count);
+	blocking();
+	slots();
+	throwingConstructor();
+	outlivesPool();
+	prewarming();
+	trimming(count / 10);
+	idleTimeout();
+
+	return 0;
+}
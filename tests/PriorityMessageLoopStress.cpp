@@ -0,0 +1,179 @@
+/**
+ * Stress test for PriorityMessageLoop, with several threads pushing at mixed priorities.
+ *
+ * Messages carry their producer, priority and sequence number within that priority.  The
+ * test checks that every message is handled once, with each producer's messages in the
+ * order pushed within each lane, and that destroying the loop handles every message
+ * already pushed, for each Execution.  With the handler held up while a backlog builds,
+ * it checks that lanes are served strictly by priority, and that a starvation limit lets
+ * the lower lanes through at the expected points.  It also checks that a message is
+ * released as soon as it has been handled, rather than held by the loop until the next
+ * one arrives.
+ *
+ * PriorityMessageLoop runs on the Scheduler, so this builds where the rest of the library
+ * does.  From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\PriorityMessageLoopStress.cpp src\*.cpp
+ *
+ * Usage: PriorityMessageLoopStress [messages per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/PriorityMessageLoop.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Concurrent;
+
+typedef MessageLoopBase::Execution Execution;
+
+static const int Producers = 3;
+static const int MaxPriority = 3;
+
+static uint64_t makeMessage(uint64_t producer, uint64_t priority, uint64_t sequence)
+{
+	return (producer << 40) | (priority << 32) | sequence;
+}
+
+static void lanes(Execution execution, const char* name, uint64_t perProducer)
+{
+	std::vector<int64_t> last(Producers * (MaxPriority + 1), -1);
+	std::atomic<uint64_t> handled(0);
+	Watchdog watchdog(handled);
+
+	{
+		PriorityMessageLoop<uint64_t> loop([&](const uint64_t& message)
+		{
+			uint64_t producer = message >> 40;
+			uint64_t priority = (message >> 32) & 0xFF;
+			int64_t sequence = (int64_t)(message & 0xFFFFFFFF);
+
+			CHECK(producer < Producers);
+			CHECK(priority <= MaxPriority);
+
+			int64_t& previous = last[producer * (MaxPriority + 1) + priority];
+
+			CHECK(sequence == previous + 1);
+			previous = sequence;
+
+			handled.fetch_add(1);
+		}, MaxPriority, 4, execution);
+
+		runThreads(Producers, [&](int index)
+		{
+			std::vector<uint64_t> sequences(MaxPriority + 1, 0);
+
+			for (uint64_t i = 0; i < perProducer; ++i)
+			{
+				// Favour the low lanes, as a data backlog would.
+				int priority = (i % 7 == 0) ? (int)(i / 7 % MaxPriority) + 1 : 0;
+
+				loop.push(makeMessage(index, priority, sequences[priority]++), priority);
+
+				// Pause now and then so the loop drains the lanes and parks.
+				if (i % 256 == 0)
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		});
+	}
+
+	// The destructor handles everything pushed before it.
+	CHECK(handled.load() == Producers * perProducer);
+	std::printf("%s ok\n", name);
+}
+
+/**
+ * Holds up the handler on its first message while a backlog builds up, then returns
+ * the order in which the loop handled everything, as a string of priorities.
+ */
+static std::string orderAfterBacklog(size_t starvationLimit, const std::vector<int>& backlog)
+{
+	std::string order;
+	std::atomic<bool> entered(false);
+	std::atomic<bool> release(false);
+
+	{
+		PriorityMessageLoop<int> loop([&](const int& priority)
+		{
+			entered.store(true);
+
+			while (false == release.load())
+				std::this_thread::yield();
+
+			order += (char)('0' + priority);
+		}, 2, starvationLimit, Execution::Thread);
+
+		loop.push(0, 0);
+
+		while (false == entered.load())
+			std::this_thread::yield();
+
+		for (int priority : backlog)
+			loop.push(priority, priority);
+
+		release.store(true);
+	}
+
+	return order;
+}
+
+static void priorities()
+{
+	std::vector<int> backlog;
+
+	backlog.insert(backlog.end(), 6, 0);
+	backlog.insert(backlog.end(), 8, 2);
+	backlog.push_back(1);
+
+	CHECK(orderAfterBacklog(0, backlog) == "0" "22222222" "1" "000000");
+
+	// Every third message from above lane 0 lets one through from each lower lane.
+	CHECK(orderAfterBacklog(3, backlog) == "0" "222" "10" "222" "0" "22" "0000");
+
+	std::printf("priorities ok\n");
+}
+
+static void released()
+{
+	std::atomic<uint64_t> handled(0);
+	std::weak_ptr<int> last;
+
+	PriorityMessageLoop< std::shared_ptr<int> > loop([&](const std::shared_ptr<int>&) { handled.fetch_add(1); }, 1, 0, Execution::Thread);
+
+	for (int i = 0; i < 100; ++i)
+	{
+		std::shared_ptr<int> message = std::make_shared<int>(i);
+		last = message;
+
+		loop.push(std::move(message), i % 2);
+
+		while (handled.load() < (uint64_t)i + 1)
+			std::this_thread::yield();
+
+		// The handler has returned, and nothing else is pushed, so nothing may still
+		// own the message once the loop finishes with it.
+		for (int spins = 0; false == last.expired() && spins < 1000; ++spins)
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+		CHECK(last.expired());
+	}
+
+	std::printf("released ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	lanes(Execution::Task, "task", count);
+	lanes(Execution::Thread, "thread", count);
+	lanes(Execution::OnDemand, "on demand", count);
+	priorities();
+	released();
+
+	return 0;
+}
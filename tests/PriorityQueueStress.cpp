@@ -0,0 +1,168 @@
+/**
+ * Stress test for ConcurrentPriorityQueue in both orderings, with several threads each
+ * pushing and popping.
+ *
+ * Every value pushed must be popped exactly once.  In Strict mode a single thread popping
+ * a full queue must see the values in sorted order.  A comparison that throws while a
+ * heap is locked must leave the lock released, so the queue keeps working afterwards
+ * rather than spinning forever on the next push.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude tests/PriorityQueueStress.cpp src/Concurrent.cpp
+ *
+ * Adding -fsanitize=thread is recommended.
+ *
+ * Usage: PriorityQueueStress [items per thread]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/ConcurrentPriorityQueue.h>
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+using namespace Concurrent;
+
+typedef ConcurrentPriorityQueue<uint64_t> PriorityQueue;
+
+static void mixed(PriorityQueue::Ordering ordering, const char* name, uint64_t perThread)
+{
+	const int Threads = 4;
+
+	PriorityQueue queue(ordering);
+	std::vector<std::atomic<int>> seen(Threads * perThread);
+
+	runThreads(Threads, [&](int index)
+	{
+		std::optional<uint64_t> item;
+
+		for (uint64_t i = 0; i < perThread; ++i)
+		{
+			// Push in descending order so that heaps are reordered on every push.
+			queue.push(index * perThread + (perThread - 1 - i));
+
+			if (i % 2 == 1 && queue.tryPopMin(item))
+				seen[*item].fetch_add(1);
+		}
+	});
+
+	uint64_t value;
+
+	while (queue.tryPopMin(value))
+		seen[value].fetch_add(1);
+
+	CHECK(queue.isEmpty());
+
+	for (std::atomic<int>& count : seen)
+		CHECK(1 == count.load());
+
+	std::printf("%s mixed ok\n", name);
+}
+
+static void sorted(uint64_t count)
+{
+	PriorityQueue queue;
+
+	for (uint64_t i = 0; i < count; ++i)
+		queue.push((i * 7919) % count);
+
+	CHECK(queue.size() == count);
+
+	uint64_t value;
+
+	for (uint64_t expected = 0; expected < count; ++expected)
+	{
+		CHECK(queue.tryPopMin(value));
+		CHECK(value == expected);
+	}
+
+	CHECK(false == queue.tryPopMin(value));
+	std::printf("strict sorted ok\n");
+}
+
+/**
+ * Orders values with std::less, throwing instead whenever armed.
+ */
+struct FragileLess
+{
+	static std::atomic<bool> armed;
+
+	bool operator()(uint64_t left, uint64_t right) const
+	{
+		if (armed.load())
+			throw std::runtime_error("compare failed");
+
+		return left < right;
+	}
+};
+
+std::atomic<bool> FragileLess::armed(false);
+
+static void throwing(ConcurrentPriorityQueue<uint64_t, FragileLess>::Ordering ordering, const char* name)
+{
+	ConcurrentPriorityQueue<uint64_t, FragileLess> queue(ordering);
+
+	for (uint64_t i = 0; i < 64; ++i)
+		queue.push(i);
+
+	FragileLess::armed.store(true);
+
+	for (int attempt = 0; attempt < 64; ++attempt)
+	{
+		uint64_t value;
+
+		try
+		{
+			queue.push(100 + attempt);
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+
+		try
+		{
+			queue.tryPopMin(value);
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+	}
+
+	FragileLess::armed.store(false);
+
+	// Every heap must be unlocked again, so the queue can be pushed and drained.
+	runThreads(2, [&](int index)
+	{
+		for (uint64_t i = 0; i < 100; ++i)
+			queue.push(1000 + index * 100 + i);
+	});
+
+	uint64_t value;
+	size_t popped = 0;
+
+	while (queue.tryPopMin(value))
+		++popped;
+
+	CHECK(popped >= 200);
+	CHECK(queue.isEmpty());
+
+	std::printf("%s throwing compare ok\n", name);
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	mixed(PriorityQueue::Ordering::Strict, "strict", count);
+	mixed(PriorityQueue::Ordering::Relaxed, "relaxed", count);
+	sorted(count);
+
+	throwing(ConcurrentPriorityQueue<uint64_t, FragileLess>::Ordering::Strict, "strict");
+	throwing(ConcurrentPriorityQueue<uint64_t, FragileLess>::Ordering::Relaxed, "relaxed");
+
+	return 0;
+}
@@ -0,0 +1,478 @@
+/**
+ * Stress test for Producer with several pushing and consuming threads.
+ *
+ * Items carry their producer and sequence number.  The test checks that every item is
+ * consumed exactly once, that each consumer sees every producer's items in the order they
+ * were pushed, and that end() wakes every parked consumer once the queue has drained.
+ * Consumers are kept starved so that most consumes park and most pushes have to wake
+ * one.  A lost wakeup stalls the test, which a watchdog reports as a failure rather than
+ * letting it hang.
+ *
+ * Bounded producers are checked to throttle at the high watermark and resume at the low
+ * one, including when every producer only uses tryPush(), so that nobody is parked to
+ * notice a consumer draining the queue before the throttle was raised.
+ *
+ * Batch consumers must keep the same ordering, never exceed their batch size, and release
+ * throttled producers just as single consumes do.
+ *
+ * Timed consumes must time out no earlier than asked when nothing is pushed, return
+ * early when something is, and lose no items when their deadlines race with pushes.
+ *
+ * Producer uses Concurrent::Queue, so this builds where the rest of the library does.
+ * From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\ProducerStress.cpp src\*.cpp
+ *
+ * Usage: ProducerStress [items per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/MpscQueue.h>
+#include <Concurrent/Producer.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+using namespace Concurrent;
+
+static uint64_t makeItem(uint64_t producer, uint64_t sequence)
+{
+	return (producer << 32) | sequence;
+}
+
+/**
+ * Checks the order of one consumer's items and counts them.
+ */
+class OrderCheck
+{
+public:
+	OrderCheck(int producers)
+		: mLast(producers, -1), mCount(0)
+	{
+	}
+
+	void add(uint64_t item)
+	{
+		uint64_t producer = item >> 32;
+		int64_t sequence = (int64_t)(item & 0xFFFFFFFF);
+
+		CHECK(producer < mLast.size());
+		CHECK(sequence > mLast[producer]);
+
+		mLast[producer] = sequence;
+		++mCount;
+	}
+
+	uint64_t count() const
+	{
+		return mCount;
+	}
+
+private:
+	std::vector<int64_t> mLast;
+	uint64_t mCount;
+};
+
+static void mpmc(uint64_t perProducer)
+{
+	const int Producers = 3;
+	const int Consumers = 3;
+
+	Producer<uint64_t> producer;
+	std::atomic<uint64_t> consumed(0);
+	std::atomic<int> pushing(Producers);
+	Watchdog watchdog(consumed);
+
+	runThreads(Producers + Consumers, [&](int index)
+	{
+		if (index < Producers)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+			{
+				CHECK(producer.push(makeItem(index, i)));
+
+				// Give consumers time to drain and park now and then.
+				if (i % 64 == 0)
+					std::this_thread::yield();
+			}
+
+			if (1 == pushing.fetch_sub(1))
+				producer.end();
+
+			return;
+		}
+
+		OrderCheck check(Producers);
+		uint64_t item;
+		std::optional<uint64_t> optional;
+
+		while (true)
+		{
+			if (index % 2 == 0)
+			{
+				if (false == producer.consume(item))
+					break;
+
+				check.add(item);
+			}
+			else
+			{
+				if (false == producer.consume(optional))
+					break;
+
+				check.add(*optional);
+			}
+
+			consumed.fetch_add(1);
+		}
+	});
+
+	CHECK(consumed.load() == Producers * perProducer);
+	CHECK(false == producer.push(0));
+
+	std::printf("mpmc ok\n");
+}
+
+static void mpsc(uint64_t perProducer)
+{
+	const int Producers = 3;
+
+	Producer< uint64_t, MpscQueue<uint64_t> > producer;
+	std::atomic<uint64_t> consumed(0);
+	std::atomic<int> pushing(Producers);
+	Watchdog watchdog(consumed);
+
+	runThreads(Producers + 1, [&](int index)
+	{
+		if (index < Producers)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+				producer.push(makeItem(index, i));
+
+			if (1 == pushing.fetch_sub(1))
+				producer.end();
+
+			return;
+		}
+
+		OrderCheck check(Producers);
+		uint64_t item;
+
+		// Alternate the trying and blocking paths.
+		while (true)
+		{
+			if (check.count() % 2 == 1 || false == producer.tryConsume(item))
+			{
+				if (false == producer.consume(item))
+					break;
+			}
+
+			check.add(item);
+			consumed.fetch_add(1);
+		}
+
+		CHECK(check.count() == Producers * perProducer);
+	});
+
+	std::printf("mpsc ok\n");
+}
+
+static void endWakesAll()
+{
+	const int Consumers = 4;
+
+	std::atomic<uint64_t> rounds(0);
+	Watchdog watchdog(rounds);
+
+	for (int round = 0; round < 100; ++round, rounds.fetch_add(1))
+	{
+		Producer<int> producer;
+
+		runThreads(Consumers + 1, [&](int index)
+		{
+			if (index < Consumers)
+			{
+				int item;
+				CHECK(false == producer.consume(item));
+				return;
+			}
+
+			std::this_thread::sleep_for(std::chrono::microseconds(round * 10));
+			producer.end();
+		});
+	}
+
+	std::printf("end ok\n");
+}
+
+static void watermarks()
+{
+	Producer<int> producer(8, 4);
+	int item;
+
+	for (int i = 0; i < 8; ++i)
+		CHECK(producer.tryPush(i));
+
+	CHECK(false == producer.tryPush(8));
+	CHECK(false == producer.pushFor(8, std::chrono::milliseconds(10)));
+
+	// Still above the low watermark, so the producer stays throttled.
+	for (int i = 0; i < 3; ++i)
+		CHECK(producer.tryConsume(item) && item == i);
+
+	CHECK(false == producer.tryPush(8));
+
+	// Reaching the low watermark lets pushes in again, up to the high watermark.
+	CHECK(producer.tryConsume(item) && item == 3);
+
+	for (int i = 8; i < 12; ++i)
+		CHECK(producer.tryPush(i));
+
+	CHECK(false == producer.tryPush(12));
+
+	for (int i = 4; i < 12; ++i)
+		CHECK(producer.tryConsume(item) && item == i);
+
+	CHECK(false == producer.tryConsume(item));
+	std::printf("watermarks ok\n");
+}
+
+static void bounded(uint64_t perProducer, bool tryOnly)
+{
+	const int Producers = 3;
+
+	Producer<uint64_t> producer(2, 1);
+	std::atomic<uint64_t> consumed(0);
+	std::atomic<int> pushing(Producers);
+	Watchdog watchdog(consumed);
+
+	runThreads(Producers + 1, [&](int index)
+	{
+		if (index < Producers)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+			{
+				uint64_t item = makeItem(index, i);
+
+				if (tryOnly)
+				{
+					// Nobody parks here, so a consumer that drained the queue before
+					// the throttle was raised must not leave it raised for good.
+					while (false == producer.tryPush(item))
+						std::this_thread::yield();
+				}
+				else if (i % 2 == 0)
+				{
+					CHECK(producer.push(item));
+				}
+				else
+				{
+					while (false == producer.pushFor(item, std::chrono::microseconds(50)))
+						;
+				}
+			}
+
+			if (1 == pushing.fetch_sub(1))
+				producer.end();
+
+			return;
+		}
+
+		OrderCheck check(Producers);
+		uint64_t item;
+
+		while (producer.consume(item))
+		{
+			check.add(item);
+			consumed.fetch_add(1);
+		}
+
+		CHECK(check.count() == Producers * perProducer);
+	});
+
+	std::printf("bounded %s ok\n", tryOnly ? "tryPush" : "push");
+}
+
+static void batches(uint64_t perProducer)
+{
+	const int Producers = 3;
+	const int Consumers = 2;
+	const size_t BatchSize = 7;
+
+	Producer<uint64_t> producer(16, 8);
+	std::atomic<uint64_t> consumed(0);
+	std::atomic<int> pushing(Producers);
+	Watchdog watchdog(consumed);
+
+	runThreads(Producers + Consumers, [&](int index)
+	{
+		if (index < Producers)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+				CHECK(producer.push(makeItem(index, i)));
+
+			if (1 == pushing.fetch_sub(1))
+				producer.end();
+
+			return;
+		}
+
+		OrderCheck check(Producers);
+		std::vector<uint64_t> batch;
+
+		while (true)
+		{
+			// Items are appended, so keep what is already there to check that.
+			batch.assign(1, 0);
+
+			size_t count = (index % 2 == 0) ?
+				producer.consumeBatch(batch, BatchSize) :
+				producer.consumeBatch(batch, BatchSize, std::chrono::milliseconds(1));
+
+			CHECK(batch.size() == count + 1);
+			CHECK(count <= BatchSize);
+
+			if (0 == count)
+			{
+				if (index % 2 == 0)
+					break;
+
+				// A timed batch that comes back empty may only have timed out.
+				uint64_t item;
+
+				if (false == producer.consume(item))
+					break;
+
+				check.add(item);
+				consumed.fetch_add(1);
+				continue;
+			}
+
+			for (size_t i = 1; i < batch.size(); ++i)
+				check.add(batch[i]);
+
+			consumed.fetch_add(count);
+		}
+	});
+
+	CHECK(consumed.load() == Producers * perProducer);
+
+	std::vector<uint64_t> batch;
+	CHECK(0 == producer.consumeBatch(batch, BatchSize));
+	CHECK(batch.empty());
+
+	std::printf("batches ok\n");
+}
+
+static void timed(uint64_t perProducer)
+{
+	typedef std::chrono::steady_clock clock_type;
+
+	Producer<uint64_t> producer;
+	uint64_t item;
+	std::optional<uint64_t> optional;
+
+	// Nothing is pushed, so these must time out, and not early.
+	clock_type::time_point start = clock_type::now();
+
+	CHECK(false == producer.consumeFor(item, std::chrono::milliseconds(20)));
+	CHECK(clock_type::now() - start >= std::chrono::milliseconds(20));
+
+	start = clock_type::now();
+
+	CHECK(false == producer.consumeUntil(optional, std::chrono::system_clock::now() + std::chrono::milliseconds(20)));
+	CHECK(false == optional.has_value());
+	CHECK(clock_type::now() - start >= std::chrono::milliseconds(15));
+
+	// A push from another thread must end a long wait early.
+	std::thread pusher([&]()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		producer.push(7);
+	});
+
+	start = clock_type::now();
+
+	CHECK(producer.consumeFor(item, std::chrono::seconds(30)));
+	CHECK(7 == item);
+	CHECK(clock_type::now() - start < std::chrono::seconds(10));
+
+	pusher.join();
+
+	// Short deadlines racing with pushes must not lose or duplicate items.
+	const int Producers = 2;
+	const int Consumers = 2;
+
+	std::atomic<uint64_t> consumed(0);
+	std::atomic<int> pushing(Producers);
+	Watchdog watchdog(consumed);
+
+	runThreads(Producers + Consumers, [&](int index)
+	{
+		if (index < Producers)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+			{
+				producer.push(makeItem(index, i));
+
+				if (i % 128 == 0)
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+
+			if (1 == pushing.fetch_sub(1))
+				producer.end();
+
+			return;
+		}
+
+		OrderCheck check(Producers);
+		uint64_t local;
+
+		while (pushing.load() > 0)
+		{
+			if (index % 2 == 0)
+			{
+				if (false == producer.consumeFor(local, std::chrono::microseconds(20)))
+					continue;
+			}
+			else if (false == producer.consumeUntil(local, clock_type::now() + std::chrono::microseconds(20)))
+			{
+				continue;
+			}
+
+			check.add(local);
+			consumed.fetch_add(1);
+		}
+
+		// end() has been called, so consume() only returns what is left.
+		while (producer.consume(local))
+		{
+			check.add(local);
+			consumed.fetch_add(1);
+		}
+	});
+
+	CHECK(consumed.load() == Producers * perProducer);
+	std::printf("timed ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	mpmc(count);
+	mpsc(count);
+	endWakesAll();
+
+	watermarks();
+	bounded(count / 10, false);
+	bounded(count / 10, true);
+
+	batches(count);
+	timed(count / 10);
+
+	return 0;
+}
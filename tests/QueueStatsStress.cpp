@@ -0,0 +1,208 @@
+/**
+ * Stress test for QueueStats, with several threads recording into many instances.
+ *
+ * Threads record pushes, pops and handler times while another takes snapshots.  The
+ * test checks that once they finish, every push and pop is accounted for in the depth,
+ * push count and histograms, and that the maximum depth covers the depth actually
+ * reached.  Far more instances are recorded into than there are thread local slots on
+ * some systems, and instances are destroyed and replaced while threads keep recording,
+ * so that stale registry entries have to be told apart from live ones.  It also checks
+ * the histogram's bucket bounds and percentiles.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude tests/QueueStatsStress.cpp src/QueueStats.cpp src/ShardedCounter.cpp src/Concurrent.cpp
+ *
+ * Adding -fsanitize=thread is recommended.
+ *
+ * Usage: QueueStatsStress [operations per thread]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/QueueStats.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace Concurrent;
+
+static void buckets()
+{
+	// Every value falls within the bounds of its bucket, and bounds are contiguous.
+	for (size_t bucket = 0; bucket + 1 < Histogram::BucketCount; ++bucket)
+	{
+		auto range = Histogram::bucketRange(bucket);
+
+		CHECK(range.first <= range.second);
+		CHECK(range.second + 1 == Histogram::bucketRange(bucket + 1).first);
+		CHECK(bucket == Histogram::bucketFor(range.first));
+		CHECK(bucket == Histogram::bucketFor(range.second));
+	}
+
+	CHECK(Histogram::BucketCount - 1 == Histogram::bucketFor(UINT64_MAX));
+
+	Histogram histogram;
+
+	for (uint64_t value = 1; value <= 1000; ++value)
+		histogram.counts[Histogram::bucketFor(value)]++;
+
+	CHECK(1000 == histogram.count());
+	CHECK(histogram.max() >= 1000 && histogram.max() <= 1125);
+
+	uint64_t median = histogram.percentile(0.5);
+	CHECK(median >= 500 && median <= 563);
+
+	std::printf("buckets ok\n");
+}
+
+static void recording(uint64_t perThread)
+{
+	const int Threads = 4;
+
+	QueueStats stats;
+	std::atomic<uint64_t> done(0);
+	std::atomic<int> running(Threads);
+	Watchdog watchdog(done);
+
+	runThreads(Threads + 1, [&](int index)
+	{
+		if (Threads == index)
+		{
+			// Snapshots taken while threads record must stay consistent enough to read.
+			while (running.load() > 0)
+			{
+				QueueStats::Snapshot snapshot = stats.snapshot();
+
+				CHECK(snapshot.depth >= 0);
+				CHECK(snapshot.maxDepth >= snapshot.depth);
+			}
+
+			return;
+		}
+
+		// Each thread keeps 100 items of its own queued, and 101 between a push and pop.
+		for (uint64_t i = 0; i < perThread; ++i)
+		{
+			stats.onPush(1);
+
+			if (i >= 100)
+				stats.onPop(QueueStats::now() - 1000, QueueStats::now());
+
+			stats.onHandled(500);
+			done.fetch_add(1);
+		}
+
+		for (int i = 0; i < 100; ++i)
+			stats.onPop(1, 1);
+
+		running.fetch_sub(1);
+	});
+
+	QueueStats::Snapshot snapshot = stats.snapshot();
+
+	CHECK(0 == snapshot.depth);
+	CHECK(Threads * perThread == snapshot.pushed);
+	CHECK(Threads * perThread == snapshot.latency.count());
+	CHECK(Threads * perThread == snapshot.handlerTime.count());
+	CHECK(snapshot.maxDepth >= 100);
+	CHECK(snapshot.maxDepth <= Threads * 101);
+
+	// A pop of an item pushed before stats were enabled is ignored.
+	stats.onPop(0, QueueStats::now());
+	CHECK(0 == stats.snapshot().depth);
+
+	std::printf("recording ok\n");
+}
+
+static void instances()
+{
+	const int Threads = 4;
+	const int Instances = 4096;
+
+	std::vector< std::unique_ptr<QueueStats> > all;
+
+	for (int i = 0; i < Instances; ++i)
+		all.emplace_back(new QueueStats());
+
+	std::atomic<uint64_t> done(0);
+	Watchdog watchdog(done);
+
+	runThreads(Threads, [&](int index)
+	{
+		for (int i = 0; i < Instances; ++i)
+		{
+			QueueStats& stats = *all[(i + index * 97) % Instances];
+
+			stats.onPush(1);
+			stats.onPop(1, 2);
+			done.fetch_add(1);
+		}
+	});
+
+	for (const std::unique_ptr<QueueStats>& stats : all)
+	{
+		QueueStats::Snapshot snapshot = stats->snapshot();
+
+		CHECK(Threads == snapshot.pushed);
+		CHECK(Threads == snapshot.latency.count());
+		CHECK(0 == snapshot.handlerTime.count());
+	}
+
+	std::printf("instances ok\n");
+}
+
+static void churn(uint64_t perThread)
+{
+	const int Threads = 4;
+	const int Live = 8;
+
+	std::atomic<uint64_t> done(0);
+	Watchdog watchdog(done);
+
+	runThreads(Threads, [&](int index)
+	{
+		// Each thread keeps replacing its instances, often with one at the address just
+		// freed, so its registry fills with entries of destroyed instances.
+		std::vector< std::unique_ptr<QueueStats> > own;
+
+		for (int i = 0; i < Live; ++i)
+			own.emplace_back(new QueueStats());
+
+		for (uint64_t i = 0; i < perThread; ++i)
+		{
+			std::unique_ptr<QueueStats>& stats = own[i % Live];
+
+			stats->onPush(1);
+			stats->onPop(1, 2);
+
+			QueueStats::Snapshot snapshot = stats->snapshot();
+
+			// A new instance must not pick up a recorder left by a destroyed one.
+			CHECK(snapshot.pushed == snapshot.latency.count());
+
+			if (i % (Live * 3 + index) == 0)
+			{
+				stats.reset(new QueueStats());
+				CHECK(0 == stats->snapshot().pushed);
+			}
+
+			done.fetch_add(1);
+		}
+	});
+
+	std::printf("churn ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	buckets();
+	recording(count);
+	instances();
+	churn(count / 10);
+
+	return 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * Stress test for Select waiting on several Producers of different item types.
+ *
+ * Each producer is fed by its own thread, with pauses so the selecting thread regularly
+ * finds every producer empty and parks.  The test checks that every item is consumed in
+ * order through the Select, that wait() only returns npos once every producer has ended
+ * and drained, and that a push to any producer wakes a parked Select.  A lost wakeup
+ * stalls the test, which a watchdog reports as a failure rather than letting it hang.
+ * It also checks that a busy producer can not starve a quiet one, and that timed and
+ * trying waits report when nothing is ready.
+ *
+ * Select uses Producer and so Concurrent::Queue, so this builds where the rest of the
+ * library does.  From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\SelectStress.cpp src\*.cpp
+ *
+ * Usage: SelectStress [items per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/Select.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace Concurrent;
+
+static void channels(uint64_t perProducer)
+{
+	Producer<uint64_t> numbers;
+	Producer<std::string> strings;
+	Producer<uint64_t> bounded(4, 2);
+
+	Select select;
+	size_t numbersIndex = select.add(numbers);
+	size_t stringsIndex = select.add(strings);
+	size_t boundedIndex = select.add(bounded);
+
+	CHECK(3 == select.size());
+
+	std::atomic<uint64_t> consumed(0);
+	Watchdog watchdog(consumed);
+
+	runThreads(4, [&](int index)
+	{
+		if (index < 3)
+		{
+			for (uint64_t i = 0; i < perProducer; ++i)
+			{
+				if (0 == index)
+					numbers.push(i);
+				else if (1 == index)
+					strings.push(std::to_string(i));
+				else
+					bounded.push(i);
+
+				// Pause now and then so the Select drains everything and parks.
+				if (i % 256 == 0)
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+
+			if (0 == index)
+				numbers.end();
+			else if (1 == index)
+				strings.end();
+			else
+				bounded.end();
+
+			return;
+		}
+
+		std::vector<uint64_t> next(3, 0);
+
+		while (true)
+		{
+			size_t ready = select.wait();
+
+			if (Select::npos == ready)
+				break;
+
+			// Only this thread consumes, so a ready producer must have an item.
+			if (numbersIndex == ready)
+			{
+				uint64_t item;
+				CHECK(numbers.tryConsume(item));
+				CHECK(item == next[0]++);
+			}
+			else if (stringsIndex == ready)
+			{
+				std::string item;
+				CHECK(strings.tryConsume(item));
+				CHECK(item == std::to_string(next[1]++));
+			}
+			else
+			{
+				CHECK(boundedIndex == ready);
+
+				uint64_t item;
+				CHECK(bounded.tryConsume(item));
+				CHECK(item == next[2]++);
+			}
+
+			consumed.fetch_add(1);
+		}
+
+		for (uint64_t count : next)
+			CHECK(count == perProducer);
+	});
+
+	CHECK(Select::npos == select.tryWait());
+	std::printf("channels ok\n");
+}
+
+static void fairness()
+{
+	Producer<int> busy;
+	Producer<int> quiet;
+
+	Select select;
+	size_t busyIndex = select.add(busy);
+	size_t quietIndex = select.add(quiet);
+
+	for (int i = 0; i < 100; ++i)
+		busy.push(i);
+
+	quiet.push(0);
+
+	// With both ready, the quiet producer must come up within one round.
+	int item;
+	bool sawQuiet = false;
+
+	for (int i = 0; i < 2 && false == sawQuiet; ++i)
+	{
+		size_t ready = select.wait();
+
+		if (quietIndex == ready)
+		{
+			CHECK(quiet.tryConsume(item));
+			sawQuiet = true;
+		}
+		else
+		{
+			CHECK(busyIndex == ready);
+			CHECK(busy.tryConsume(item));
+		}
+	}
+
+	CHECK(sawQuiet);
+	std::printf("fairness ok\n");
+}
+
+static void timeouts()
+{
+	Producer<int> first;
+	Producer<int> second;
+
+	Select select;
+	select.add(first);
+	size_t secondIndex = select.add(second);
+
+	CHECK(Select::npos == select.tryWait());
+
+	auto start = std::chrono::steady_clock::now();
+
+	CHECK(Select::npos == select.waitFor(std::chrono::milliseconds(20)));
+	CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+	// A push from another thread must end a long timed wait early.
+	std::thread pusher([&]()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		second.push(1);
+	});
+
+	start = std::chrono::steady_clock::now();
+
+	CHECK(secondIndex == select.waitFor(std::chrono::seconds(30)));
+	CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+
+	pusher.join();
+
+	// Ending only one producer is not enough for an immediate npos.
+	int item;
+	CHECK(second.tryConsume(item));
+
+	second.end();
+	start = std::chrono::steady_clock::now();
+
+	CHECK(Select::npos == select.waitFor(std::chrono::milliseconds(5)));
+	CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(5));
+
+	first.end();
+	CHECK(Select::npos == select.wait());
+
+	std::printf("timeouts ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	channels(count);
+	fairness();
+	timeouts();
+
+	return 0;
+}
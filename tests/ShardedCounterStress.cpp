@@ -0,0 +1,148 @@
+/**
+ * Stress test for ShardedCounter and ShardedGauge under both sharding policies.
+ *
+ * More threads than slots update the same statistic, so slots are shared, while another
+ * thread reads it.  A counter read concurrently must never go down or pass the final
+ * total, and once the updaters finish both counter and gauge must hold the exact sum of
+ * every update.  The gauge is raised on some threads and lowered on others, so its
+ * individual slots go negative, and set() must replace whatever the slots add up to.
+ * Each thread must keep the shard index it was first given, and no two threads may be
+ * given the same one.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude tests/ShardedCounterStress.cpp src/ShardedCounter.cpp src/Concurrent.cpp
+ *
+ * Adding -fsanitize=thread is recommended.
+ *
+ * Usage: ShardedCounterStress [updates per thread]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/ShardedCounter.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+using namespace Concurrent;
+
+static void counter(Sharding sharding, const char* name, uint64_t updates)
+{
+	const int Threads = 2 * std::max(1u, hardwareConcurrency()) + 3;
+	const uint64_t Total = Threads * updates * 3;
+
+	ShardedCounter count(sharding);
+	std::atomic<bool> done(false);
+
+	std::thread reader([&]()
+	{
+		uint64_t previous = 0;
+
+		while (false == done.load())
+		{
+			uint64_t value = count.value();
+
+			CHECK(value >= previous && value <= Total);
+			previous = value;
+
+			std::this_thread::yield();
+		}
+	});
+
+	runThreads(Threads, [&](int)
+	{
+		for (uint64_t i = 0; i < updates; ++i)
+		{
+			++count;
+			count += 1;
+			count.add();
+		}
+	});
+
+	done.store(true);
+	reader.join();
+
+	CHECK(Total == count.value());
+
+	count.reset();
+	CHECK(0 == count.value());
+
+	std::printf("ShardedCounter (%s) ok\n", name);
+}
+
+static void gauge(Sharding sharding, const char* name, uint64_t updates)
+{
+	const int Threads = 2 * std::max(1u, hardwareConcurrency()) + 4;
+
+	ShardedGauge level(sharding);
+	level.set(100);
+
+	// Even threads raise the gauge and odd threads lower it by the same amounts.
+	runThreads(Threads, [&](int index)
+	{
+		for (uint64_t i = 0; i < updates; ++i)
+		{
+			if (index % 2 == 0)
+			{
+				++level;
+				level += 2;
+				level.add(3);
+			}
+			else
+			{
+				--level;
+				level -= 2;
+				level.sub(3);
+			}
+		}
+	});
+
+	CHECK(100 == level.value());
+
+	level.set(-5);
+	CHECK(-5 == level.value());
+
+	level += 5;
+	CHECK(0 == level.value());
+
+	std::printf("ShardedGauge (%s) ok\n", name);
+}
+
+static void indices()
+{
+	const int Threads = 16;
+
+	std::vector<size_t> assigned(Threads);
+
+	runThreads(Threads, [&](int index)
+	{
+		assigned[index] = threadShardIndex();
+
+		for (int i = 0; i < 1000; ++i)
+		{
+			CHECK(assigned[index] == threadShardIndex());
+			cpuShardIndex();
+		}
+	});
+
+	CHECK((size_t)Threads == std::set<size_t>(assigned.begin(), assigned.end()).size());
+	std::printf("shard indices ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t updates = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	indices();
+
+	counter(Sharding::Thread, "thread", updates);
+	counter(Sharding::Cpu, "cpu", updates);
+
+	gauge(Sharding::Thread, "thread", updates);
+	gauge(Sharding::Cpu, "cpu", updates);
+
+	return 0;
+}
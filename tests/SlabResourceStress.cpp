@@ -0,0 +1,263 @@
+/**
+ * Stress test for SlabResource in the producer and consumer pattern it is built for.
+ *
+ * Producer threads allocate blocks and fill them with a pattern naming the block, then
+ * hand them through an MpscQueue to a consumer that checks the pattern and frees them, so
+ * nearly every free is a remote one.  Producers are short-lived threads started in waves,
+ * so the heaps of exited threads are adopted by later ones.  A block handed out twice
+ * would have its pattern overwritten.  Slabs come from a counting upstream resource, and
+ * the test checks they are all returned when the SlabResource is destroyed.  Blocks are
+ * also freed and allocated by thread local destructors that run after the exiting thread
+ * has handed back its heaps.
+ *
+ * SlabResource uses Concurrent::Mutex, so this builds where the rest of the library does.
+ * From the repository root, for example:
+ *
+ *  cl /std:c++17 /EHsc /O2 /Iinclude tests\SlabResourceStress.cpp src\*.cpp
+ *
+ * Usage: SlabResourceStress [blocks per producer]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/MpscQueue.h>
+#include <Concurrent/SlabResource.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <vector>
+
+using namespace Concurrent;
+
+/**
+ * Passes allocations through to the default resource, counting those outstanding.
+ */
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+	std::atomic<int64_t> live = 0;
+
+private:
+	virtual void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		live.fetch_add(1);
+		return std::pmr::get_default_resource()->allocate(bytes, alignment);
+	}
+
+	virtual void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+	{
+		live.fetch_sub(1);
+		std::pmr::get_default_resource()->deallocate(ptr, bytes, alignment);
+	}
+
+	virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return (this == &other);
+	}
+};
+
+static constexpr size_t BlockSize = 48;
+static constexpr size_t BlockAlign = 16;
+
+static void fill(void* block, uint64_t id)
+{
+	uint64_t* words = static_cast<uint64_t*>(block);
+
+	for (size_t i = 0; i < BlockSize / sizeof(uint64_t); ++i)
+		words[i] = id + i;
+}
+
+static void verify(const void* block, uint64_t id)
+{
+	const uint64_t* words = static_cast<const uint64_t*>(block);
+
+	for (size_t i = 0; i < BlockSize / sizeof(uint64_t); ++i)
+		CHECK(id + i == words[i]);
+}
+
+struct Handoff
+{
+	void* block;
+	uint64_t id;
+};
+
+static void crossThread(uint64_t perProducer)
+{
+	const int Waves = 4;
+	const int ProducersPerWave = 3;
+	const uint64_t Total = perProducer * Waves * ProducersPerWave;
+
+	CountingResource upstream;
+
+	{
+		SlabResource slab(BlockSize, BlockAlign, &upstream);
+		MpscQueue<Handoff> queue;
+		std::atomic<uint64_t> nextId(0);
+
+		std::thread consumer([&]()
+		{
+			uint64_t freed = 0;
+			Handoff handoff;
+
+			while (freed < Total)
+			{
+				if (false == queue.tryPop(handoff))
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				verify(handoff.block, handoff.id);
+				std::memset(handoff.block, 0xCD, BlockSize);
+
+				slab.deallocate(handoff.block, BlockSize, BlockAlign);
+				++freed;
+			}
+		});
+
+		for (int wave = 0; wave < Waves; ++wave)
+		{
+			runThreads(ProducersPerWave, [&](int)
+			{
+				for (uint64_t i = 0; i < perProducer; ++i)
+				{
+					void* block = slab.allocate(BlockSize, BlockAlign);
+					CHECK(0 == reinterpret_cast<uintptr_t>(block) % BlockAlign);
+
+					uint64_t id = nextId.fetch_add(1) * 16;
+					fill(block, id);
+
+					// Some blocks are freed locally and replaced, the rest by the consumer.
+					if (i % 5 == 0)
+					{
+						verify(block, id);
+						slab.deallocate(block, BlockSize, BlockAlign);
+
+						block = slab.allocate(BlockSize, BlockAlign);
+						fill(block, id);
+					}
+
+					queue.push(Handoff{ block, id });
+				}
+			});
+		}
+
+		consumer.join();
+
+		// Requests too large for a block are passed upstream.
+		int64_t before = upstream.live.load();
+		void* large = slab.allocate(BlockSize * 4, BlockAlign);
+
+		CHECK(before + 1 == upstream.live.load());
+		slab.deallocate(large, BlockSize * 4, BlockAlign);
+		CHECK(before == upstream.live.load());
+	}
+
+	CHECK(0 == upstream.live.load());
+	std::printf("cross-thread ok\n");
+}
+
+/**
+ * A thread that uses many short-lived resources in turn, as a thread pool worker would.
+ */
+static void shortLived(int count)
+{
+	CountingResource upstream;
+
+	for (int i = 0; i < count; ++i)
+	{
+		SlabResource slab(BlockSize, BlockAlign, &upstream);
+		MpscQueue<uint64_t> queue(&slab);
+
+		for (uint64_t j = 0; j < 100; ++j)
+			queue.push(j);
+
+		uint64_t item;
+
+		for (uint64_t j = 0; j < 100; ++j)
+		{
+			CHECK(queue.tryPop(item));
+			CHECK(j == item);
+		}
+	}
+
+	CHECK(0 == upstream.live.load());
+	std::printf("short-lived ok\n");
+}
+
+/**
+ * Frees its blocks as its thread exits.  It is first used before the thread allocates, so
+ * it is destroyed after the thread's heaps have been handed back.
+ */
+struct ExitFree
+{
+	SlabResource* slab = nullptr;
+	std::vector<void*> blocks;
+
+	~ExitFree()
+	{
+		if (nullptr == slab)
+			return;
+
+		for (size_t i = 0; i < blocks.size(); ++i)
+		{
+			verify(blocks[i], reinterpret_cast<uintptr_t>(blocks[i]));
+			slab->deallocate(blocks[i], BlockSize, BlockAlign);
+
+			// Allocating this late must still hand out a block no one else has.
+			if (i % 10 == 0)
+			{
+				void* block = slab->allocate(BlockSize, BlockAlign);
+
+				fill(block, reinterpret_cast<uintptr_t>(block));
+				verify(block, reinterpret_cast<uintptr_t>(block));
+				slab->deallocate(block, BlockSize, BlockAlign);
+			}
+		}
+	}
+};
+
+static thread_local ExitFree exitFree;
+
+static void threadExit(int rounds)
+{
+	const int Threads = 3;
+
+	CountingResource upstream;
+
+	{
+		SlabResource slab(BlockSize, BlockAlign, &upstream);
+
+		for (int round = 0; round < rounds; ++round)
+		{
+			// Threads exiting together adopt each other's heaps while others still free.
+			runThreads(Threads, [&](int)
+			{
+				exitFree.slab = &slab;
+
+				for (int i = 0; i < 100; ++i)
+				{
+					void* block = slab.allocate(BlockSize, BlockAlign);
+
+					fill(block, reinterpret_cast<uintptr_t>(block));
+					exitFree.blocks.push_back(block);
+				}
+			});
+		}
+	}
+
+	CHECK(0 == upstream.live.load());
+	std::printf("thread exit ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t perProducer = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 20000;
+
+	crossThread(perProducer);
+	shortLived(1000);
+	threadExit(100);
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * Stress test for ThreadLocalPtr and ThreadLocal.
+ *
+ * ThreadLocalPtr instances are created and destroyed on many threads at once, so their
+ * indices are recycled while other threads hold live ones.  Each thread checks that a new
+ * instance starts out null even when it reuses an index, and that a long-lived instance
+ * keeps its value however many others come and go.
+ *
+ * ThreadLocal is updated by waves of short-lived threads while another thread repeatedly
+ * sums all copies with forEach().  The sum must never go down, and once every thread has
+ * finished it must equal the number of updates, including those made by threads that
+ * have exited.  Every copy, and no more than one per thread, must be destroyed with the
+ * ThreadLocal, and combine() must return the default value when no thread has a copy.
+ *
+ * Build from the repository root, for example:
+ *
+ *  g++ -std=c++17 -O2 -pthread -Iinclude tests/ThreadLocalStress.cpp src/ThreadLocal.cpp
+ *
+ * Adding -fsanitize=thread is recommended.
+ *
+ * Usage: ThreadLocalStress [iterations]
+ */
+
+#include "Check.h"
+
+#include <Concurrent/ThreadLocal.h>
+
+#include <cstdint>
+#include <memory>
+
+using namespace Concurrent;
+
+static void pointers(int iterations)
+{
+	const int Threads = 4;
+
+	ThreadLocalPtr<int> shared;
+
+	runThreads(Threads, [&](int index)
+	{
+		int mine = index;
+
+		CHECK(nullptr == shared.get());
+		shared.set(&mine);
+
+		for (int i = 0; i < iterations; ++i)
+		{
+			// Hold a few at once so threads are given different, and recycled, indices.
+			std::unique_ptr< ThreadLocalPtr<int> > local[3];
+
+			for (auto& ptr : local)
+			{
+				ptr = std::make_unique< ThreadLocalPtr<int> >();
+
+				CHECK(nullptr == ptr->get());
+				ptr->set(&mine);
+				CHECK(&mine == ptr->get());
+			}
+
+			CHECK(&mine == shared.get());
+		}
+
+		shared.set(nullptr);
+	});
+
+	std::printf("ThreadLocalPtr ok\n");
+}
+
+static std::atomic<int64_t> liveCounts(0);
+
+/**
+ * A per-thread count that another thread may read while it is updated.
+ */
+struct Count
+{
+	std::atomic<uint64_t> value = 0;
+
+	Count()
+	{
+		liveCounts.fetch_add(1);
+	}
+
+	Count(const Count& other)
+		: value(other.value.load(std::memory_order_relaxed))
+	{
+		liveCounts.fetch_add(1);
+	}
+
+	~Count()
+	{
+		liveCounts.fetch_sub(1);
+	}
+
+	Count& operator=(const Count& other)
+	{
+		value.store(other.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		return *this;
+	}
+};
+
+static Count add(const Count& a, const Count& b)
+{
+	Count result;
+	result.value = a.value.load() + b.value.load();
+
+	return result;
+}
+
+static void values(int iterations)
+{
+	const int Waves = 8;
+	const int ThreadsPerWave = 3;
+
+	{
+		ThreadLocal<Count> counts;
+		std::atomic<bool> done(false);
+
+		CHECK(0 == counts.combine(add).value.load());
+		CHECK(0 == counts.size());
+
+		std::thread reader([&]()
+		{
+			uint64_t previous = 0;
+
+			while (false == done.load())
+			{
+				uint64_t sum = 0;
+
+				counts.forEach([&](const Count& count)
+				{
+					sum += count.value.load(std::memory_order_relaxed);
+				});
+
+				CHECK(sum >= previous);
+				previous = sum;
+
+				std::this_thread::yield();
+			}
+		});
+
+		for (int wave = 0; wave < Waves; ++wave)
+		{
+			runThreads(ThreadsPerWave, [&](int)
+			{
+				for (int i = 0; i < iterations; ++i)
+					counts->value.fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+
+		done.store(true);
+		reader.join();
+
+		uint64_t total = counts.combine(add).value.load();
+
+		CHECK(Waves * ThreadsPerWave == (int)counts.size());
+		CHECK((uint64_t)Waves * ThreadsPerWave * iterations == total);
+
+		// The default value and one copy for each thread that has exited.
+		CHECK(1 + Waves * ThreadsPerWave == liveCounts.load());
+	}
+
+	CHECK(0 == liveCounts.load());
+	std::printf("ThreadLocal ok\n");
+}
+
+int main(int argc, char** argv)
+{
+	int iterations = (argc > 1) ? std::atoi(argv[1]) : 20000;
+
+	pointers(iterations);
+	values(iterations);
+
+	return 0;
+}